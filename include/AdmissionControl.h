@@ -0,0 +1,91 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Clients tracked at once. The least recently seen is forgotten first.
+#define ADMISSION_CLIENTS 16
+
+// Per client: a burst of commands, then one more every refill period.
+// Override with -D to suit the clients on the network.
+#ifndef ADMISSION_CLIENT_BURST
+#define ADMISSION_CLIENT_BURST 10
+#endif
+#ifndef ADMISSION_CLIENT_REFILL_MS
+#define ADMISSION_CLIENT_REFILL_MS 1000
+#endif
+
+// Whole device: one SmartPort frame holds the bus for about 650 ms, so the bus
+// budget refills at about the rate frames can go out
+#ifndef ADMISSION_BUS_BURST
+#define ADMISSION_BUS_BURST 12
+#endif
+#ifndef ADMISSION_BUS_REFILL_MS
+#define ADMISSION_BUS_REFILL_MS 700
+#endif
+
+// Tokens only stops may spend, so a stop gets through while starts are refused
+#define ADMISSION_CLIENT_STOP_RESERVE 2
+#define ADMISSION_BUS_STOP_RESERVE 4
+
+enum AdmissionClass {
+    ADMIT_ANY,          // Not rate limited
+    ADMIT_COMMAND,      // Puts frames on the bus
+    ADMIT_STOP          // Puts a stop on the bus, may use the reserve
+};
+
+struct AdmissionDecision {
+    bool admitted;
+    uint32_t retryAfterS;   // When refused, seconds until a retry could pass
+};
+
+// Token-bucket admission control for the routes that drive the bus. Every
+// client IP has a bucket in a small fixed table, and every command also draws
+// on a device-wide bus budget. Requests are checked on their first body chunk,
+// before any parsing, so a client over its limit costs nothing but the reply.
+//
+// Not thread safe. It is called from the AsyncTCP task and, through
+// FrameServer's admission hook, from the frame task, so callers must
+// serialise access; the web server holds admissionLock around every call.
+class AdmissionControl {
+private:
+    // Tokens are counted in thousandths, and the part of a refill too small
+    // for a whole thousandth is carried over, so frequent refills stay exact
+    struct Bucket {
+        int32_t milli;
+        uint32_t updatedMs;
+        uint32_t carry;         // Elapsed ms times 1000 not yet credited, below refillMs
+    };
+
+    struct Client {
+        uint32_t ip;
+        bool used;
+        Bucket bucket;
+    };
+
+    Client _clients[ADMISSION_CLIENTS];
+    Bucket _bus;
+
+    static void refill(Bucket& bucket, uint32_t burst, uint32_t refillMs, uint32_t nowMs);
+    static uint32_t waitMs(const Bucket& bucket, int32_t needMilli, uint32_t refillMs);
+    Client& client(uint32_t ip, uint32_t nowMs);
+
+public:
+    AdmissionControl();
+
+    // Admit one request from ip, taking a token from its bucket and the bus budget
+    AdmissionDecision admit(uint32_t ip, AdmissionClass type, uint32_t nowMs);
+
+    // A request admitted as ADMIT_STOP turned out to hold more than stops.
+    // Refused, with its token given back, unless it would have passed as
+    // ADMIT_COMMAND.
+    AdmissionDecision promote(uint32_t ip, uint32_t nowMs);
+
+    // Charge extra tokens for a request that turned out to hold several
+    // commands. Neither the client's bucket nor the bus budget is charged
+    // into its stop reserve, so a stop still gets through afterwards.
+    void charge(uint32_t ip, uint32_t tokens, uint32_t nowMs);
+};
+
+#endif // ADMISSION_CONTROL_H
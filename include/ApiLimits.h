@@ -0,0 +1,24 @@
+#ifndef API_LIMITS_H
+#define API_LIMITS_H
+
+// Sizes the REST API shares with the caches and buffers around it, kept apart
+// from ApiRequests.h so those build without ArduinoJson.
+
+// Longest Idempotency-Key accepted on start and stop
+#define API_IDEMPOTENCY_KEY_MAX 64
+
+// Response buffer sizes
+#define API_SMALL_RESPONSE_SIZE 160
+#define API_STATUS_RESPONSE_SIZE 1536
+#define API_ZONES_RESPONSE_SIZE 3072    // Every zone of a controller, all active
+
+// Weak ETag, W/"xxxxxxxx" and the terminator
+#define API_ETAG_SIZE 16
+
+// Returned by a chunked response filler when nothing fit this time, as
+// ESPAsyncWebServer defines it. Returning 0 would end the response.
+#ifndef RESPONSE_TRY_AGAIN
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+#endif
+
+#endif // API_LIMITS_H
@@ -0,0 +1,160 @@
+#ifndef API_REQUESTS_H
+#define API_REQUESTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+#include "HunterRoam.h"
+#include "BusCoalescer.h"
+#include "BootTimeline.h"
+#include "Watering.h"
+#include "ApiLimits.h"
+
+// Request parsing, validation and response serialisation for the JSON
+// endpoints. Kept free of the web server and ESP APIs so it builds and
+// benchmarks on the host (env:native). Nothing here allocates from the heap.
+
+// Longest command list accepted by POST /api/batch. The whole batch must fit in
+// the bus queue at once.
+#define BATCH_MAX_COMMANDS BUS_QUEUE_LENGTH
+
+// JSON document capacity for parsing request bodies. Documents live on the
+// stack and unknown fields are filtered out while parsing, so these only need
+// to hold the fields the API reads.
+#define API_REQUEST_CAPACITY 256
+#define API_SEQUENCE_CAPACITY (JSON_ARRAY_SIZE(SEQUENCE_MAX_STEPS) + SEQUENCE_MAX_STEPS * JSON_OBJECT_SIZE(2) + 64)
+#define API_SCHEDULE_CAPACITY (JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(7) + JSON_ARRAY_SIZE(SCHEDULE_MAX_STEPS) + SCHEDULE_MAX_STEPS * JSON_OBJECT_SIZE(2) + 128)
+#define API_SCHEDULE_JSON_CAPACITY (JSON_OBJECT_SIZE(7) + JSON_ARRAY_SIZE(7) + JSON_ARRAY_SIZE(SCHEDULE_MAX_STEPS) + SCHEDULE_MAX_STEPS * JSON_OBJECT_SIZE(2) + 64)
+#define API_BATCH_CAPACITY (JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(BATCH_MAX_COMMANDS) + BATCH_MAX_COMMANDS * JSON_OBJECT_SIZE(4) + 128)
+
+// JSON document capacity for building the status response
+#define API_STATUS_CAPACITY 2048
+
+struct StartRequest {
+    int controller;     // 0 when the request does not name one
+    int zone;
+    int minutes;
+    char idempotencyKey[API_IDEMPOTENCY_KEY_MAX + 1];  // Empty when the body has none
+};
+
+struct StopRequest {
+    int controller;
+    int zone;
+    char idempotencyKey[API_IDEMPOTENCY_KEY_MAX + 1];
+};
+
+struct ControllerRequest {
+    int pin;
+};
+
+// POST /api/time, either field may be left out
+struct TimeRequest {
+    uint32_t epoch;             // 0 to leave the clock alone
+    char tz[SCHEDULE_TZ_MAX + 1];   // Empty to keep the time zone
+};
+
+// Commands of a POST /api/batch, in order. Ids are assigned when queued.
+struct BatchRequest {
+    int controller;
+    uint8_t count;
+    int failed;         // Index of the command that failed validation, -1 if none
+    BusCommand commands[BATCH_MAX_COMMANDS];
+};
+
+// Outcome of parsing and validating a request body
+struct ApiResult {
+    int code;               // HTTP status, 200 if the request is valid
+    const char* error;      // Static error message, NULL if the request is valid
+    const char* detail;     // Parser error appended to the message, may be NULL
+};
+
+// One interface in the network part of the status response
+struct StatusInterface {
+    bool enabled;           // Brought up by the network mode
+    const char* state;      // "down", "connecting", "up" or "backoff"
+    uint32_t upMs;
+    uint32_t downMs;
+    uint32_t reconnects;
+    uint8_t attempts;
+    char ip[16];            // Empty without an address
+    int32_t rssi;           // WiFi only
+    uint16_t linkSpeed;     // Ethernet only, Mbps
+    bool fullDuplex;        // Ethernet only
+};
+
+// Network part of the status response
+struct StatusNetwork {
+    bool connected;
+    const char* type;       // "Ethernet", "WiFi" or "Disconnected"
+    const char* state;      // Phase of the configured interface
+    uint32_t upMs;          // Uptime it last got an address, 0 if never
+    uint32_t downMs;        // Uptime it last lost one, 0 if never
+    uint8_t attempts;       // Failed attempts since it was last up
+    char ip[16];
+    char gateway[16];
+    char subnet[16];
+    char dns[16];           // WiFi only
+    char ssid[33];          // WiFi only
+    int32_t rssi;           // WiFi only
+    char mac[18];           // Ethernet only
+    uint16_t linkSpeed;     // Ethernet only, Mbps
+    bool fullDuplex;        // Ethernet only
+    StatusInterface ethernet;
+    StatusInterface wifi;
+    uint32_t failovers;     // Traffic moved from Ethernet to WiFi
+    uint32_t failbacks;     // And back again
+};
+
+// Everything reported by GET /api/status
+struct StatusInfo {
+    uint32_t uptimeMs;
+    const char* chipModel;
+    uint16_t chipRevision;
+    uint8_t chipCores;
+    char idfVersion[16];
+    const char* resetReason;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t allocFailures;
+    StatusNetwork network;
+    uint8_t busControllers;
+    uint32_t busQueueDepth;
+    HunterTxMode busTxMode;
+    HunterJitter rmtJitter;
+    HunterJitter bitbangJitter;
+    uint32_t stackHwm;
+    uint32_t bootMs[BOOT_MILESTONE_COUNT];     // 0 until reached
+};
+
+// Copy an Idempotency-Key header or field into key. Returns false unless it
+// is 1 to API_IDEMPOTENCY_KEY_MAX printable ASCII characters without spaces.
+bool copyIdempotencyKey(const char* text, size_t len, char* key);
+
+ApiResult parseStartRequest(const char* body, size_t len, StartRequest& request);
+ApiResult parseStopRequest(const char* body, size_t len, StopRequest& request);
+ApiResult parseControllerRequest(const char* body, size_t len, ControllerRequest& request);
+ApiResult parseSequenceRequest(const char* body, size_t len, SequenceStep* steps, uint8_t& count);
+ApiResult parseBatchRequest(const char* body, size_t len, BatchRequest& request);
+ApiResult parseScheduleRequest(const char* body, size_t len, Schedule& schedule);
+ApiResult parseTimeRequest(const char* body, size_t len, TimeRequest& request);
+
+// Three letter day name for bit day of Schedule::days, "sun" to "sat"
+const char* scheduleDayName(uint8_t day);
+
+// Response writers. Each writes JSON into out and returns its length, or 0 if it does not fit.
+size_t writeErrorResponse(char* out, size_t size, const ApiResult& result);
+size_t writeAcceptedResponse(char* out, size_t size, uint32_t id, int controller, int zone, int minutes = -1);
+size_t writeStatusResponse(char* out, size_t size, const StatusInfo& status);
+size_t writeBatchErrorResponse(char* out, size_t size, const ApiResult& result, int index);
+size_t writeBatchResponse(char* out, size_t size, const BatchRequest& batch, const uint32_t* ids, const char* const* states);
+size_t writeZoneResponse(char* out, size_t size, int controller, int zone, const ZoneState& state, uint32_t nowMs);
+size_t writeZonesResponse(char* out, size_t size, int controller, const ZoneState* zones, uint32_t nowMs);
+
+// Weak ETag of a response body
+void writeEtag(char* out, size_t size, const char* body, size_t len);
+
+// True if an If-None-Match header value names etag, or is "*"
+bool etagMatches(const char* ifNoneMatch, const char* etag);
+
+#endif // API_REQUESTS_H
@@ -0,0 +1,68 @@
+#ifndef BODY_ACCUMULATOR_H
+#define BODY_ACCUMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Request bodies being collected at once, and the largest body accepted.
+// A full sequence or batch with whitespace fits comfortably.
+#define BODY_SLOTS 4
+#define BODY_MAX_SIZE 2048
+
+// A body whose remaining chunks have not arrived in this long is abandoned,
+// its slot goes to the next request that needs one
+#define BODY_TIMEOUT_MS 10000
+
+enum BodyResult {
+    BODY_PENDING,       // More chunks to come
+    BODY_COMPLETE,      // body() returns the whole body
+    BODY_TOO_LARGE,     // total is over BODY_MAX_SIZE, nothing was stored
+    BODY_BUSY,          // Every slot is collecting another body
+    BODY_IGNORED        // Chunk of a body that was rejected or never started
+};
+
+// Collects POST bodies that arrive in several TCP segments, so they are parsed
+// once and whole. Chunks are passed in as ESPAsyncWebServer hands them to a
+// body handler: data, len, the offset index and the announced total. A body
+// that arrives in one chunk is used in place without a copy, anything else is
+// copied into one of a few fixed buffers.
+//
+// Bodies are keyed by their request. Only the AsyncTCP task calls this, so it
+// has no locking.
+class BodyAccumulator {
+private:
+    struct Body {
+        const void* owner;
+        size_t received;
+        size_t total;
+        uint32_t startedMs;
+    };
+
+    Body _bodies[BODY_SLOTS];
+    char _buffers[BODY_SLOTS][BODY_MAX_SIZE];
+
+    // Body in place of a single chunk
+    const void* _directOwner;
+    const char* _direct;
+    size_t _directLen;
+
+    int find(const void* owner);
+
+public:
+    BodyAccumulator();
+
+    // Add a chunk of owner's body
+    BodyResult append(const void* owner, const uint8_t* data, size_t len, size_t index, size_t total, uint32_t nowMs);
+
+    // The whole body once append() returned BODY_COMPLETE, NULL otherwise.
+    // Not NUL terminated, use len. Valid until release().
+    const char* body(const void* owner, size_t& len);
+
+    // Free owner's slot once its body has been parsed
+    void release(const void* owner);
+
+    // Slots collecting a body
+    size_t inUse();
+};
+
+#endif // BODY_ACCUMULATOR_H
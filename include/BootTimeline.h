@@ -0,0 +1,29 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <stdint.h>
+
+// Boot milestones, roughly in the order they are reached. The network ones
+// run alongside the rest and may come first.
+enum BootMilestone {
+    BOOT_SETUP,             // setup() entered, after the ROM and core start up
+    BOOT_NETWORK_STARTED,   // Interface started, not yet connected
+    BOOT_BUS_READY,         // Bus workers running, commands can be queued
+    BOOT_SCHEDULER_READY,   // Schedules loaded and ticking
+    BOOT_LINK_UP,           // First cable or access point
+    BOOT_ADDRESS,           // First IP address
+    BOOT_READY,             // HTTP and the frame protocol listening
+    BOOT_MILESTONE_COUNT
+};
+
+// Record the uptime of a milestone. Only the first time counts, so it is
+// safe to call again on every reconnect. Safe from any task.
+void bootMark(BootMilestone milestone);
+
+// Uptime in ms at which a milestone was reached, 0 if it has not been
+uint32_t bootMilestoneMs(BootMilestone milestone);
+
+// "setup", "network_started", ...
+const char* bootMilestoneName(BootMilestone milestone);
+
+#endif // BOOT_TIMELINE_H
@@ -0,0 +1,102 @@
+#ifndef BUS_COALESCER_H
+#define BUS_COALESCER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HunterFrame.h"
+
+// Commands waiting for the bus. Submissions beyond this are refused. Room for
+// a batch touching every API zone and program at once.
+#define BUS_QUEUE_LENGTH 24
+
+// How long a sent command keeps identical repeats off the bus. Override with
+// -D BUS_COALESCE_WINDOW_MS=<ms>, 0 turns coalescing off.
+#ifndef BUS_COALESCE_WINDOW_MS
+#define BUS_COALESCE_WINDOW_MS 2000
+#endif
+
+enum BusCommandType {
+    BUS_CMD_START,
+    BUS_CMD_STOP,
+    BUS_CMD_PROGRAM
+};
+
+// Where a command came from, kept for the journal
+enum BusCommandSource {
+    BUS_SOURCE_API,         // POST /api/start or /api/stop
+    BUS_SOURCE_BATCH,       // POST /api/batch
+    BUS_SOURCE_SEQUENCE,    // Sequence runner, including scheduled runs
+    BUS_SOURCE_FRAME        // Binary command protocol
+};
+
+struct BusCommand {
+    uint32_t id;
+    BusCommandType type;
+    uint8_t zone;       // Zone, or program number for BUS_CMD_PROGRAM
+    uint8_t minutes;
+    BusCommandSource source;
+};
+
+enum CoalesceResult {
+    COALESCE_QUEUED,        // Added to the end of the queue
+    COALESCE_DUPLICATE,     // Dropped, an identical command is queued or was just sent
+    COALESCE_REPLACED,      // Replaced a queued command for the same zone, at the end of the queue
+    COALESCE_FULL           // Queue full, nothing changed
+};
+
+// Frames kept off the bus since boot
+struct BusCoalesceStats {
+    uint32_t duplicates;    // Identical to a queued or recently sent command
+    uint32_t collapsed;     // Queued stop replaced by a start of the same zone
+    uint32_t replaced;      // Any other queued command replaced by a newer one
+    uint32_t framesSaved;
+};
+
+// Pending command queue for the bus worker. Every zone (and program) has at
+// most one command waiting: a newer command replaces the queued one, since
+// only the final state of a zone matters. The command then moves to the end
+// of the queue, so commands still go out in the order they were last sent;
+// a controller runs one zone at a time and a later start of another zone
+// would otherwise undo it. Repeats of a command sent within the window are
+// dropped, which absorbs client retries and double submits.
+//
+// Not thread safe, the bus worker serialises access.
+class BusCoalescer {
+private:
+    // Last command sent per zone and program, indexed by key()
+    struct SentCommand {
+        BusCommand command;
+        uint32_t sentMs;
+        bool valid;
+    };
+
+    BusCommand _pending[BUS_QUEUE_LENGTH];
+    uint8_t _head;
+    uint8_t _count;
+    uint32_t _windowMs;
+    SentCommand _sent[HUNTER_MAX_ZONE + HUNTER_MAX_PROGRAM + 1];
+    BusCoalesceStats _stats;
+
+    static size_t key(const BusCommand& command);
+    static bool sameCommand(const BusCommand& a, const BusCommand& b);
+    void moveToTail(uint8_t index, BusCommand command);
+
+public:
+    BusCoalescer(uint32_t windowMs = BUS_COALESCE_WINDOW_MS);
+
+    // Queue a command. existingId is set to the id of the queued or sent
+    // command it duplicates or replaces.
+    CoalesceResult submit(const BusCommand& command, uint32_t nowMs, uint32_t& existingId);
+
+    // Take the oldest command for transmission. Returns false if the queue is empty.
+    bool pop(BusCommand& command, uint32_t nowMs);
+
+    // Forget a command that failed to transmit, so a retry goes out
+    void failed(const BusCommand& command);
+
+    size_t pending() const { return _count; }
+    uint32_t windowMs() const { return _windowMs; }
+    BusCoalesceStats getStats() const { return _stats; }
+};
+
+#endif // BUS_COALESCER_H
@@ -0,0 +1,122 @@
+#ifndef BUS_WORKER_H
+#define BUS_WORKER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "HunterRoam.h"
+#include "BusCoalescer.h"
+
+// Recent commands kept for GET /api/commands/{id}
+#define BUS_HISTORY_LENGTH 32
+
+// Result code for a frame that never finished transmitting
+#define BUS_ERROR_TIMEOUT 0xff
+
+#define BUS_TASK_STACK 4096
+#define BUS_TASK_PRIORITY 5
+
+// Bus timing runs on the application core. WiFi, lwIP, AsyncTCP and the
+// other housekeeping tasks are kept on the protocol core (0).
+#ifndef BUS_TASK_CORE
+#define BUS_TASK_CORE 1
+#endif
+
+enum BusCommandState {
+    BUS_STATE_UNKNOWN,       // Never submitted, or already evicted from the history
+    BUS_STATE_QUEUED,
+    BUS_STATE_TRANSMITTING,
+    BUS_STATE_DONE,
+    BUS_STATE_FAILED,
+    BUS_STATE_SUPERSEDED     // Replaced by a newer command for the same zone before it was sent
+};
+
+struct BusCommandStatus {
+    BusCommand command;
+    BusCommandState state;
+    uint8_t result;     // HunterRoam error code, 0 on success
+    uint32_t busUs;     // Time the frame held the bus, once finished
+};
+
+// Bus time used by a controller since boot
+struct BusUsage {
+    uint32_t frames;        // Frames sent, including failed ones
+    uint64_t busyUs;        // Time spent transmitting
+};
+
+// Called from the bus worker task once a command has finished or failed
+typedef void (*BusCompleteCallback)(uint8_t controller, const BusCommandStatus& status, void* arg);
+
+// Owns the HunterRoam controller and serialises every frame through a single
+// FreeRTOS task, so HTTP handlers only enqueue and never wait on the bus.
+// Submissions pass through a BusCoalescer, so repeats and superseded
+// commands never cost bus time.
+class BusWorker {
+private:
+    HunterRoam _controller;
+    int _pin;
+    uint8_t _index;
+    BusCompleteCallback _listener;
+    void* _listenerArg;
+    BusCoalescer _coalescer;
+    TaskHandle_t _task;
+    portMUX_TYPE _lock;
+    BusCommandStatus _history[BUS_HISTORY_LENGTH];
+    HunterJitter _jitter[2];
+    HunterBusStats _stats;
+    BusUsage _usage;
+
+    // Command ids are unique across every controller
+    static std::atomic<uint32_t> _nextId;
+
+    static void taskEntry(void* arg);
+    void run();
+    byte execute(const BusCommand& command);
+    void setState(uint32_t id, BusCommandState state, uint8_t result, uint32_t busUs);
+
+    // Coalesce a command and record it in the history. Called with _lock held.
+    CoalesceResult enqueue(BusCommand& command, uint32_t& id);
+
+public:
+    BusWorker(int pin, HunterTxMode mode, uint8_t index = 0);
+
+    // Start the worker task
+    void begin();
+
+    bool isRunning() { return _task != NULL; }
+
+    // Queue a command. Returns its id, or 0 if the queue is full. A command that
+    // repeats a queued or just sent one returns the id of the original.
+    uint32_t submit(BusCommandType type, uint8_t zone, uint8_t minutes = 0, BusCommandSource source = BUS_SOURCE_API);
+
+    // Queue several commands as one ordered unit, with nothing from other
+    // callers in between. Fills in an id and coalescing result per command.
+    // Returns false, queueing nothing, if the queue cannot take them all.
+    bool submitBatch(const BusCommand* commands, uint8_t count, uint32_t* ids, CoalesceResult* results);
+
+    // Look up a recent command. Returns false if the id is unknown or evicted.
+    bool lookup(uint32_t id, BusCommandStatus& status);
+
+    // Number of commands waiting for the bus
+    uint32_t queueDepth();
+
+    int getPin() { return _pin; }
+    uint8_t getIndex() { return _index; }
+
+    // Register the completion listener. Set before begin(), it is read without a lock.
+    void onComplete(BusCompleteCallback callback, void* arg);
+    HunterTxMode getTxMode() { return _controller.getTxMode(); }
+    HunterJitter getJitter(HunterTxMode mode);
+    HunterBusStats getStats();
+    BusUsage getUsage();
+    BusCoalesceStats getCoalesceStats();
+    uint32_t coalesceWindowMs() { return _coalescer.windowMs(); }
+    String errorHint(byte error);
+
+    static const char* stateName(BusCommandState state);
+    static const char* typeName(BusCommandType type);
+    static const char* coalesceName(CoalesceResult result);
+};
+
+#endif // BUS_WORKER_H
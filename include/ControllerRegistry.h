@@ -0,0 +1,82 @@
+#ifndef CONTROLLER_REGISTRY_H
+#define CONTROLLER_REGISTRY_H
+
+#include <Arduino.h>
+#include "BusWorker.h"
+#include "Watering.h"
+
+// NVS namespace and key holding the pins of the added controllers
+#define CONTROLLER_PREFS_NAMESPACE "controllers"
+#define CONTROLLER_PREFS_PINS "pins"
+
+// Pins a controller may never take: boot strapping (0, 3, 45, 46), the
+// flash and octal PSRAM bus (26-37), USB (19, 20) and the UART0 console
+// (43, 44). The Ethernet pins are added at runtime with reserve().
+#define CONTROLLER_RESERVED_PINS { 0, 3, 19, 20, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 43, 44, 45, 46 }
+
+// Pins reserved at runtime
+#define CONTROLLER_RESERVED_MAX 8
+
+enum ControllerAddResult {
+    CONTROLLER_ADDED,
+    CONTROLLER_BAD_PIN,     // Not an output capable GPIO
+    CONTROLLER_PIN_RESERVED,    // Flash, USB, strapping or network pin
+    CONTROLLER_PIN_IN_USE,
+    CONTROLLER_FULL,
+    CONTROLLER_FAILED       // The bus worker did not start
+};
+
+// Hunter controllers attached to the device, one per REM pin. Controller 0 is
+// the built-in SmartPort pin, more can be added at runtime and are restored
+// from NVS at boot. Every controller has its own bus worker task and RMT
+// channel, so frames to different controllers go out at the same time.
+class ControllerRegistry {
+private:
+    BusWorker _primary;
+    BusWorker* _controllers[CONTROLLER_MAX];
+    uint8_t _count;
+    bool _removed[CONTROLLER_MAX];      // Forgotten, idle but holding its pin until restart
+    int _reserved[CONTROLLER_RESERVED_MAX];
+    uint8_t _reservedCount;
+    HunterTxMode _mode;
+    BusCompleteCallback _listener;
+    void* _listenerArg;
+
+    bool isReserved(int pin);
+    ControllerAddResult attach(int pin, uint8_t& index);
+    void save();
+
+public:
+    ControllerRegistry(int primaryPin, HunterTxMode mode);
+
+    // Completion listener for every controller, current and added later. Set before begin().
+    void onComplete(BusCompleteCallback callback, void* arg);
+
+    // Keep controllers off a pin used elsewhere, such as the Ethernet SPI bus. Call before begin().
+    void reserve(int pin);
+
+    // Start the primary controller and restore the added ones
+    void begin();
+
+    // Attach a controller on another pin and remember it across reboots.
+    // Adding the pin of a removed controller gives back its slot.
+    ControllerAddResult add(int pin, uint8_t& index);
+
+    // Forget an added controller, so it is not restored at the next boot and
+    // takes no more commands. Its worker keeps its slot and pin until then.
+    // False for controller 0 or an unknown index.
+    bool remove(uint8_t index);
+    bool isRemoved(uint8_t index) { return index < CONTROLLER_MAX && _removed[index]; }
+
+    // NULL if there is no controller at index
+    BusWorker* get(uint8_t index);
+    BusWorker& primary() { return _primary; }
+    uint8_t count() { return _count; }
+
+    // Find a recent command on any controller
+    bool lookup(uint32_t id, BusCommandStatus& status, uint8_t& index);
+
+    static const char* resultName(ControllerAddResult result);
+};
+
+#endif // CONTROLLER_REGISTRY_H
@@ -0,0 +1,81 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "BusWorker.h"
+#include "NetworkState.h"
+
+// Events waiting to be pushed. Producers never block, events beyond this are dropped.
+#define EVENTS_QUEUE_LENGTH 16
+
+// Subscribers at once, further connections are closed straight away
+#define EVENTS_MAX_CLIENTS 4
+
+// Messages a subscriber may have unsent before it is disconnected as too slow
+#define EVENTS_CLIENT_BACKLOG 8
+
+#define EVENTS_MESSAGE_SIZE 192
+#define EVENTS_TASK_STACK 4096
+#define EVENTS_TASK_PRIORITY 2
+#define EVENTS_TASK_CORE 0      // With the network, off the bus core
+
+enum PushEventType {
+    PUSH_EVENT_COMMAND,
+    PUSH_EVENT_NETWORK
+};
+
+struct PushEvent {
+    PushEventType type;
+    uint8_t controller;
+    BusCommandStatus command;   // PUSH_EVENT_COMMAND
+    bool connected;             // PUSH_EVENT_NETWORK
+    NetworkLink link;
+};
+
+// Server-Sent Events stream at /api/events. Zone, command and network
+// changes are queued from whichever task sees them and pushed to every
+// subscriber by a dedicated task, so neither the bus worker nor the web
+// server ever waits on a slow client.
+class EventStream {
+private:
+    AsyncEventSource _source;
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+    SemaphoreHandle_t _mutex;   // Guards _clients
+    AsyncEventSourceClient* _clients[EVENTS_MAX_CLIENTS];
+    uint32_t _nextId;
+    volatile uint32_t _dropped;
+    volatile uint32_t _evicted;
+
+    static void taskEntry(void* arg);
+    void run();
+    void post(const PushEvent& event);
+    void onConnect(AsyncEventSourceClient* client);
+    void onDisconnect(AsyncEventSourceClient* client);
+    void broadcast(const char* event, const char* message);
+
+public:
+    EventStream();
+
+    // Start the push task and attach the stream to the server
+    void begin(AsyncWebServer& server);
+
+    // Queue events, safe from any task
+    void commandFinished(uint8_t controller, const BusCommandStatus& status);
+    void networkChanged(const NetworkState& state);
+
+    uint8_t clientCount();
+
+    // Events lost to a full queue
+    uint32_t dropped() { return _dropped; }
+
+    // Subscribers disconnected for falling behind
+    uint32_t evicted() { return _evicted; }
+};
+
+#endif // EVENT_STREAM_H
@@ -0,0 +1,101 @@
+#ifndef FRAME_PROTOCOL_H
+#define FRAME_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary command framing, as spoken by the original serial firmware and
+// documented in util/serialTester/test.py.
+//
+// Request, 8 bytes:  [BEGIN][conn id][type][data 1][data 2][Fletcher16 hi][lo][END]
+// Reply, 7 bytes:    [BEGIN][conn id][type][data][Fletcher16 lo][hi][END]
+//
+// The request checksum covers conn id, type and data. The reply carries the
+// checksum of the whole request frame, low byte first, so the client knows
+// which frame is being answered.
+#define FRAME_BEGIN 0xff
+#define FRAME_END 0xaf
+
+#define FRAME_START 0x65        // data: zone, minutes
+#define FRAME_STOP 0x72         // data: zone, unused
+#define FRAME_SYN 0xee
+#define FRAME_ACK 0xae
+#define FRAME_EMPTY 0x00
+#define FRAME_ERR 0xdd
+
+// Error types, sent as the data byte of an ERR reply
+#define FRAME_BAD_CMD 0x69
+#define FRAME_BAD_SPRINKLER 0x6f
+#define FRAME_BAD_DURATION 0x70
+#define FRAME_BUSY 0x71         // Bus queue full or rate limited, retry later
+
+#define FRAME_REQUEST_SIZE 8
+#define FRAME_REPLY_SIZE 7
+
+// Replies kept for retransmitted requests, and for how long
+#define FRAME_REPLAY_SLOTS 16
+#define FRAME_REPLAY_MS 5000
+
+struct Frame {
+    uint8_t conn;
+    uint8_t type;
+    uint8_t data[2];
+    uint16_t checksum;      // Of the whole request frame, echoed in the reply
+};
+
+uint16_t fletcher16(const uint8_t* data, size_t len);
+
+// Decode one request frame. Returns false if it is malformed or its checksum
+// does not match, such frames are dropped without a reply.
+bool parseFrame(const uint8_t* bytes, Frame& frame);
+
+// Build the reply to a request
+void buildReply(uint8_t* out, const Frame& request, uint8_t type, uint8_t data);
+
+// Picks request frames out of a byte stream fed one byte at a time. Noise
+// between frames is skipped, and a corrupt frame is dropped by resynchronising
+// on the next BEGIN byte, so the stream never stays out of step.
+class FrameAssembler {
+private:
+    uint8_t _buffer[FRAME_REQUEST_SIZE];
+    uint8_t _length;
+
+public:
+    FrameAssembler() : _length(0) {}
+
+    // Add a byte. Returns true when it completes a valid frame.
+    bool push(uint8_t byte, Frame& frame);
+
+    void reset() { _length = 0; }
+};
+
+// Replies to recent requests, so a client that missed a reply and resends the
+// same frame gets the original answer without the command running twice. A
+// request is identified by its source address, conn id and frame checksum.
+//
+// Not thread safe, the command server serialises access.
+class FrameReplayCache {
+private:
+    struct Entry {
+        uint32_t source;
+        uint8_t conn;
+        uint16_t checksum;
+        uint32_t storedMs;
+        bool used;
+        uint8_t reply[FRAME_REPLY_SIZE];
+    };
+
+    Entry _entries[FRAME_REPLAY_SLOTS];
+    uint8_t _next;
+
+public:
+    FrameReplayCache();
+
+    // Copy the earlier reply into out. Returns false if the request is new.
+    bool lookup(uint32_t source, const Frame& request, uint32_t nowMs, uint8_t* out);
+
+    // Remember the reply to a request, replacing the oldest
+    void store(uint32_t source, const Frame& request, const uint8_t* reply, uint32_t nowMs);
+};
+
+#endif // FRAME_PROTOCOL_H
@@ -0,0 +1,65 @@
+#ifndef FRAME_SERVER_H
+#define FRAME_SERVER_H
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include "BusWorker.h"
+#include "FrameProtocol.h"
+#include "AdmissionControl.h"
+
+// UDP port for the binary command protocol
+#define FRAME_UDP_PORT 5640
+
+// Build with -D FRAME_TCP to also accept the protocol on a raw TCP port
+#ifdef FRAME_TCP
+#include <AsyncTCP.h>
+#define FRAME_TCP_PORT 5640
+#define FRAME_TCP_CLIENTS 4
+#endif
+
+// Asks the owner whether a command from ip may go ahead. Called from the UDP
+// and TCP tasks, so the owner has to guard whatever state it keeps.
+typedef AdmissionDecision (*FrameAdmitCallback)(uint32_t ip, AdmissionClass type, void* arg);
+
+// Serves the compact framed protocol of the original serial firmware, for
+// clients that find HTTP and JSON too heavy. Start and stop frames go to the
+// bus worker of controller 0 exactly as /api/start and /api/stop do, are rate
+// limited the same way, and are answered with ACK or ERR straight away.
+class FrameServer {
+private:
+    BusWorker& _bus;
+    FrameAdmitCallback _admit;
+    void* _admitArg;
+    AsyncUDP _udp;
+    FrameReplayCache _replay;
+    portMUX_TYPE _lock;     // Guards _replay, UDP and TCP are served from different tasks
+
+#ifdef FRAME_TCP
+    struct TcpClient {
+        AsyncClient* client;
+        FrameAssembler assembler;
+    };
+
+    AsyncServer _tcp;
+    TcpClient _clients[FRAME_TCP_CLIENTS];
+
+    void onTcpClient(AsyncClient* client);
+#endif
+
+    // Answer one frame. Returns false if it gets no reply.
+    bool handle(uint32_t source, const Frame& frame, uint8_t* reply);
+
+    // Run a start or stop frame, returns the reply type and fills in its data
+    uint8_t dispatch(uint32_t source, const Frame& frame, uint8_t& data);
+
+public:
+    FrameServer(BusWorker& bus);
+
+    // Admission check for commands. Set before begin(), without one every command is admitted.
+    void onAdmit(FrameAdmitCallback callback, void* arg);
+
+    // Start listening
+    void begin();
+};
+
+#endif // FRAME_SERVER_H
@@ -0,0 +1,64 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "Metrics.h"
+
+// Heap use by the handlers of one route
+struct HeapRouteStats {
+    uint32_t allocations;   // malloc, calloc and realloc calls made by the handlers
+    uint32_t bytes;         // Bytes they asked for, wraps
+    uint32_t largest;       // Largest single request, the hardest to place in a fragmented heap
+};
+
+// A failed heap allocation
+struct HeapFailure {
+    uint32_t size;
+    uint32_t caps;          // MALLOC_CAP_* flags it asked for
+    uint32_t ms;            // millis() it happened, 0 if never
+};
+
+// Heap allocations counted per route, and failed allocations.
+//
+// The web server brackets each handler, and each POST body handler, with
+// enter() and leave(). The allocator hooks report every allocation with the
+// task that made it, and only those made by the handling task in between are
+// counted, so the network stack and other tasks allocating at the same time
+// are left out. Handlers run one at a time on the AsyncTCP task, so there is
+// only one route to track. Everything is atomic, the hooks run on every task.
+class HeapStats {
+private:
+    std::atomic<const void*> _task;     // Task being tracked, NULL between handlers
+    std::atomic<uint8_t> _route;
+    std::atomic<uint32_t> _allocations[ROUTE_COUNT];
+    std::atomic<uint32_t> _bytes[ROUTE_COUNT];
+    std::atomic<uint32_t> _largest[ROUTE_COUNT];
+    std::atomic<uint32_t> _failures;
+    std::atomic<uint32_t> _failureSize;
+    std::atomic<uint32_t> _failureCaps;
+    std::atomic<uint32_t> _failureMs;
+
+public:
+    HeapStats();
+
+    // Count allocations made by task under route until leave()
+    void enter(const void* task, MetricsRoute route);
+    void leave();
+
+    // Allocator hooks, safe from any task
+    void allocated(const void* task, size_t size);
+    void failed(size_t size, uint32_t caps);
+
+    HeapRouteStats route(MetricsRoute route) const;
+
+    // Allocations that found no block big enough
+    uint32_t failures() const { return _failures; }
+    HeapFailure lastFailure() const;
+};
+
+// Shared by the allocator hooks and the web server
+extern HeapStats heapStats;
+
+#endif // HEAP_STATS_H
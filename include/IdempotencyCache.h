@@ -0,0 +1,70 @@
+#ifndef IDEMPOTENCY_CACHE_H
+#define IDEMPOTENCY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ApiLimits.h"
+#include "BusCoalescer.h"
+
+// Keys remembered at once. The least recently used is forgotten first.
+#define IDEMPOTENCY_SLOTS 16
+
+// How long a key replays its response. Longer than any client retry loop.
+#define IDEMPOTENCY_WINDOW_MS 600000
+
+enum IdempotencyResult {
+    IDEMPOTENCY_MISS,       // New key, or its window has passed
+    IDEMPOTENCY_HIT,        // Same key and request, replay the stored response
+    IDEMPOTENCY_MISMATCH    // Same key sent with a different request
+};
+
+struct IdempotencyStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t mismatches;
+};
+
+// Responses to recent start and stop requests that carried an Idempotency-Key,
+// so a client that timed out and retries gets the original reply and the
+// command is not queued again. Keys are scoped to the client IP, and the
+// request they were first used with is kept as a fingerprint.
+//
+// Only touched from the AsyncTCP task, so there is no locking.
+class IdempotencyCache {
+private:
+    struct Entry {
+        bool used;
+        uint32_t client;
+        uint32_t fingerprint;
+        uint32_t storedMs;
+        uint32_t usedMs;
+        int code;
+        uint16_t length;
+        char key[API_IDEMPOTENCY_KEY_MAX + 1];
+        char body[API_SMALL_RESPONSE_SIZE];
+    };
+
+    Entry _entries[IDEMPOTENCY_SLOTS];
+    IdempotencyStats _stats;
+
+    Entry* find(uint32_t client, const char* key);
+
+public:
+    IdempotencyCache();
+
+    // Look a key up. On a hit, body points at the stored response until the
+    // next store().
+    IdempotencyResult lookup(uint32_t client, const char* key, uint32_t fingerprint, uint32_t nowMs,
+                             int& code, const char*& body, size_t& length);
+
+    // Remember the response to a request, replacing the least recently used key
+    void store(uint32_t client, const char* key, uint32_t fingerprint, int code,
+               const char* body, size_t length, uint32_t nowMs);
+
+    IdempotencyStats getStats() { return _stats; }
+
+    // Identifies a command, so a key reused for another one is caught
+    static uint32_t fingerprint(BusCommandType type, int controller, int zone, int minutes = 0);
+};
+
+#endif // IDEMPOTENCY_CACHE_H
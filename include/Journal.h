@@ -0,0 +1,89 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "BusWorker.h"
+#include "JournalLog.h"
+
+// Finished commands held in RAM until the next flash write. Commands beyond
+// this are dropped, the bus worker never waits on flash.
+#define JOURNAL_BUFFER_LENGTH 32
+
+// Write to flash once this many commands are waiting, or after JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_THRESHOLD 16
+#define JOURNAL_FLUSH_MS 10000
+
+// Records per GET /api/history response, unless the client asks for fewer
+#define JOURNAL_HISTORY_LIMIT 500
+
+#define JOURNAL_TASK_STACK 3072
+#define JOURNAL_TASK_PRIORITY 1
+#define JOURNAL_TASK_CORE 0     // Off the bus core
+
+// Progress of one GET /api/history response, fixed when the request arrives
+struct JournalCursor {
+    uint32_t seq;           // Next record to write
+    uint32_t end;           // First record not in this response
+    uint32_t oldest;
+    uint8_t stage;
+    bool started;           // A record has been written
+};
+
+// Persistent log of every finished bus command, whatever sent it.
+//
+// The bus worker hands each command over without blocking. Commands collect
+// in a RAM buffer and a low priority task writes them to the JournalLog ring
+// in batches, so a burst of commands costs one flash write and the sector
+// erases stay rare. History is read straight from flash and the buffer a
+// record at a time, nothing is loaded whole.
+class Journal {
+private:
+    JournalLog _log;
+    JournalRecord _pending[JOURNAL_BUFFER_LENGTH];
+    JournalRecord _flushing[JOURNAL_BUFFER_LENGTH];
+    uint8_t _count;
+    uint32_t _nextSeq;
+    portMUX_TYPE _lock;         // Guards _pending, _count and _nextSeq
+    SemaphoreHandle_t _mutex;   // Guards _log and the flash
+    TaskHandle_t _task;
+    volatile uint32_t _dropped;
+    volatile uint32_t _lost;
+
+    static void taskEntry(void* arg);
+    void run();
+    void flush();
+    bool read(uint32_t seq, JournalRecord& record);
+    size_t fill(char* out, size_t size, JournalCursor& cursor);
+
+public:
+    Journal();
+
+    // Find the end of the log in flash and start the writer task
+    void begin();
+
+    bool isMounted() { return _log.isMounted(); }
+
+    // Queue a finished command, safe from any task
+    void record(uint8_t controller, const BusCommandStatus& status);
+
+    // Start a history response from seq since, at most limit records
+    void beginHistory(uint32_t since, uint32_t limit, JournalCursor& cursor);
+
+    // Write as many whole records as fit into out. Returns the bytes
+    // written, RESPONSE_TRY_AGAIN if not even one record fit, 0 once the
+    // response is complete.
+    size_t write(char* out, size_t size, JournalCursor& cursor);
+
+    uint32_t capacity() { return _log.capacity(); }
+
+    // Commands lost to a full buffer
+    uint32_t dropped() { return _dropped; }
+
+    // Commands lost to a failed flash write
+    uint32_t lost() { return _lost; }
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,94 @@
+#ifndef JOURNAL_LOG_H
+#define JOURNAL_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Hal.h"
+#include "BusCoalescer.h"
+
+// Bumped whenever the record layout changes, older records are then skipped
+#define JOURNAL_RECORD_VERSION 1
+
+// Flash used by the journal, at most this many sectors of the partition.
+// 64 sectors keep the last 8192 commands. Override with -D.
+#ifndef JOURNAL_MAX_SECTORS
+#define JOURNAL_MAX_SECTORS 64
+#endif
+
+// One finished bus command, exactly as stored in flash
+struct JournalRecord {
+    uint32_t seq;           // From 1, never reused. All ones in erased flash.
+    uint32_t time;          // Unix time, 0 if the clock was not set
+    uint32_t uptimeMs;
+    uint32_t id;            // Bus command id, restarts from 1 at boot
+    uint32_t busUs;         // Time the frame held the bus
+    uint8_t source;         // BusCommandSource
+    uint8_t command;        // BusCommandType
+    uint8_t controller;
+    uint8_t zone;           // Zone, or program number
+    uint8_t minutes;
+    uint8_t result;         // HunterRoam error code, 0 on success
+    uint8_t version;
+    uint8_t reserved[3];
+    uint16_t check;         // Fletcher-16 of everything before it
+};
+
+#define JOURNAL_RECORD_SIZE 32
+#define JOURNAL_RECORDS_PER_SECTOR (HAL_FLASH_SECTOR / JOURNAL_RECORD_SIZE)
+
+static_assert(sizeof(JournalRecord) == JOURNAL_RECORD_SIZE, "Journal records must stay 32 bytes");
+
+// Append-only ring of fixed size records in raw flash.
+//
+// Record seq always lives at slot (seq - 1) modulo the ring size, so reading
+// from any seq is a single flash read with no index. A sector is erased only
+// when the writer enters it, so each sector is erased once per trip round the
+// ring and the wear is spread evenly. Records are never rewritten in place.
+//
+// Mounting reads the first record of every sector to find the newest one,
+// then scans that sector for the end. A record torn by a reset fails its
+// check and is skipped, along with the rest of its slot, so a seq may be
+// missing but never repeated.
+//
+// Not thread safe, the Journal serialises access.
+class JournalLog {
+private:
+    uint32_t _sectors;
+    uint32_t _next;         // Seq of the next record written
+    uint32_t _oldest;       // Lowest seq that may still be stored
+    int32_t _open;          // Sector erased for writing, -1 if none
+
+    uint32_t slots() { return _sectors * JOURNAL_RECORDS_PER_SECTOR; }
+    uint32_t offsetOf(uint32_t seq) { return ((seq - 1) % slots()) * JOURNAL_RECORD_SIZE; }
+    bool readSlot(uint32_t offset, JournalRecord& record);
+
+public:
+    JournalLog() : _sectors(0), _next(1), _oldest(1), _open(-1) {}
+
+    // Find the end of the journal. Returns false if there is not enough flash.
+    bool mount();
+
+    bool isMounted() { return _sectors > 0; }
+    uint32_t capacity() { return _sectors > 0 ? slots() : 0; }
+    uint32_t nextSeq() { return _next; }
+    uint32_t oldestSeq() { return _oldest; }
+
+    // Write records whose seq were handed out from nextSeq() onwards, in
+    // order. A seq may be skipped. Runs within a sector go out as one flash
+    // write. Returns the number of records written.
+    uint8_t append(JournalRecord* records, uint8_t count);
+
+    // Returns false if seq is not stored, was overwritten or is damaged
+    bool read(uint32_t seq, JournalRecord& record);
+
+    // Fill in the version and check before a record is written
+    static void seal(JournalRecord& record);
+    static bool valid(const JournalRecord& record);
+};
+
+// Write a record as a JSON object. Returns the length, or 0 if it does not fit.
+size_t journalRecordJson(const JournalRecord& record, char* out, size_t size);
+
+const char* journalSourceName(uint8_t source);
+
+#endif // JOURNAL_LOG_H
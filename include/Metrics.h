@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "Watering.h"
+#include "BootTimeline.h"
+
+// Upper bounds of the request latency histogram buckets, in milliseconds.
+// A last +Inf bucket is implied.
+#define METRICS_LATENCY_BUCKETS_MS { 1, 5, 10, 25, 50, 100, 250, 1000 }
+#define METRICS_LATENCY_BUCKETS 8
+
+// Status codes counted separately, anything else is counted as "other"
+#define METRICS_STATUS_CODES { 200, 201, 202, 304, 400, 404, 409, 413, 422, 429, 500, 503 }
+#define METRICS_STATUS_CODE_COUNT 12
+
+// POST requests whose body is still arriving
+#define METRICS_ARRIVALS 8
+
+// Routes requests are counted under. /api/sequence covers its controls too.
+enum MetricsRoute {
+    ROUTE_PING,
+    ROUTE_STATUS,
+    ROUTE_START,
+    ROUTE_STOP,
+    ROUTE_BATCH,
+    ROUTE_COMMANDS,
+    ROUTE_ZONES,
+    ROUTE_BUS_STATS,
+    ROUTE_CONTROLLERS,
+    ROUTE_SEQUENCE,
+    ROUTE_SCHEDULES,
+    ROUTE_TIME,
+    ROUTE_HISTORY,
+    ROUTE_TASKS,
+    ROUTE_DEBUG,
+    ROUTE_EVENTS,
+    ROUTE_METRICS,
+    ROUTE_OTHER,
+    ROUTE_COUNT
+};
+
+struct MetricsBus {
+    uint32_t frames;
+    uint64_t busyUs;
+    uint32_t queueDepth;
+};
+
+// Figures sampled once per scrape
+struct MetricsGauges {
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t allocFailures;
+    uint32_t allocations[ROUTE_COUNT];      // Made by each route's handlers
+    uint32_t allocatedBytes[ROUTE_COUNT];
+    uint8_t controllers;
+    MetricsBus bus[CONTROLLER_MAX];
+    uint32_t ethernetReconnects;
+    uint32_t wifiReconnects;
+    uint32_t idempotencyHits;
+    uint32_t idempotencyMisses;
+    uint32_t idempotencyMismatches;
+    uint32_t journalDropped;       // Lost to a full buffer or a failed flash write
+    uint32_t bootMs[BOOT_MILESTONE_COUNT];     // 0 until reached
+};
+
+// Progress of one GET /metrics. The series present when the scrape started
+// are fixed, so a request finishing between chunks cannot shift the lines.
+struct MetricsScrape {
+    uint32_t line;
+    uint16_t codes[ROUTE_COUNT];    // Bit c set if _requests[route][c] was counted
+};
+
+// Request counters and latency histograms for GET /metrics, in the Prometheus
+// text format. Counters are lock-free atomics updated as each response is
+// queued. Exposition writes straight into the response buffer a chunk at a
+// time, resuming from the line it stopped at.
+//
+// Latency runs from request arrival (headers parsed) to the response being
+// queued.
+class Metrics {
+private:
+    struct Arrival {
+        const void* owner;
+        uint32_t us;
+    };
+
+    std::atomic<uint32_t> _requests[ROUTE_COUNT][METRICS_STATUS_CODE_COUNT + 1];
+    std::atomic<uint32_t> _latency[ROUTE_COUNT][METRICS_LATENCY_BUCKETS + 1];
+    std::atomic<uint64_t> _latencySumUs[ROUTE_COUNT];   // 32 bits would wrap after 71 minutes
+    std::atomic<int32_t> _inFlight;
+
+    // Only touched from the AsyncTCP task
+    Arrival _arrivals[METRICS_ARRIVALS];
+    uint8_t _nextArrival;
+
+public:
+    Metrics();
+
+    // A request's body started arriving. Its latency is measured from now.
+    void arrived(const void* request, uint32_t nowUs);
+
+    // A request is about to be handled. Returns when it arrived.
+    uint32_t handling(const void* request, uint32_t nowUs);
+
+    // The response to a request was queued
+    void finished(MetricsRoute route, int code, uint32_t latencyUs);
+
+    int32_t inFlight() { return _inFlight; }
+
+    // Requests answered on a route since boot, whatever the status
+    uint32_t requests(MetricsRoute route);
+
+    void beginScrape(MetricsScrape& scrape);
+
+    // Write as many whole lines as fit into out, carrying on from where the
+    // scrape stopped. Returns the bytes written, RESPONSE_TRY_AGAIN if not
+    // even one line fit, 0 once everything is out.
+    size_t write(char* out, size_t size, MetricsScrape& scrape, const MetricsGauges& gauges);
+
+    static MetricsRoute route(const char* url);
+    static const char* routeName(MetricsRoute route);
+};
+
+#endif // METRICS_H
@@ -0,0 +1,122 @@
+#ifndef NETWORK_STATE_H
+#define NETWORK_STATE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Delay before the first reconnection attempt after a failure, doubled on
+// each further failure up to the maximum. Override with -D.
+#ifndef NETWORK_RETRY_MIN_MS
+#define NETWORK_RETRY_MIN_MS 1000
+#endif
+#ifndef NETWORK_RETRY_MAX_MS
+#define NETWORK_RETRY_MAX_MS 60000
+#endif
+
+// Link events, translated from the Arduino WiFi/ETH events by iSprinklrNetwork
+enum NetworkEvent {
+    NET_EVENT_ETH_LINK_UP,      // Cable plugged in
+    NET_EVENT_ETH_GOT_IP,
+    NET_EVENT_ETH_LOST_IP,
+    NET_EVENT_ETH_LINK_DOWN,    // Cable pulled or interface stopped
+    NET_EVENT_WIFI_LINK_UP,     // Associated with the access point
+    NET_EVENT_WIFI_GOT_IP,
+    NET_EVENT_WIFI_LOST_IP,
+    NET_EVENT_WIFI_LINK_DOWN
+};
+
+enum NetworkLink {
+    NET_LINK_NONE,
+    NET_LINK_ETHERNET,
+    NET_LINK_WIFI
+};
+
+enum LinkPhase {
+    LINK_DOWN,          // Not started, no cable or not associated
+    LINK_CONNECTING,    // Link up or connection attempt running, no address yet
+    LINK_UP,            // Has an address
+    LINK_BACKOFF        // Attempt failed, waiting before the next one
+};
+
+// One interface, as seen at a single moment
+struct LinkStatus {
+    LinkPhase phase;
+    uint32_t upMs;          // millis() the link last got an address, 0 if never
+    uint32_t downMs;        // millis() it last lost one, 0 if never
+    uint32_t reconnects;    // Times it got an address back after losing it
+    uint8_t attempts;       // Failed attempts since it was last up
+};
+
+// Connection state machine for both interfaces, fed from the network event
+// task and read from any other. Every field is atomic, so readers never need
+// a lock, and it is free of the Arduino network stack so it builds on the
+// host.
+//
+// The state only records what happened. iSprinklrNetwork reports failed
+// attempts and gets back how long to wait before the next one.
+class NetworkState {
+private:
+    struct Link {
+        std::atomic<uint8_t> phase;
+        std::atomic<uint32_t> upMs;
+        std::atomic<uint32_t> downMs;
+        std::atomic<uint32_t> reconnects;
+        std::atomic<uint8_t> attempts;
+        bool seen;              // Had an address at some point since boot
+    };
+
+    Link _eth;
+    Link _wifi;
+    std::atomic<uint32_t> _lastChangeMs;
+    std::atomic<uint8_t> _lastActive;   // Last link in use, NET_LINK_NONE only before the first
+    std::atomic<uint32_t> _failovers;
+    std::atomic<uint32_t> _failbacks;
+
+    Link* find(NetworkLink link);
+    const Link* find(NetworkLink link) const;
+    void setPhase(Link& link, LinkPhase phase);
+    void linkDown(Link& link);
+    void updateActive();
+
+public:
+    NetworkState();
+
+    void onEvent(NetworkEvent event);
+
+    // A connection attempt failed. Returns the delay before the next one.
+    uint32_t failed(NetworkLink link);
+
+    // A new attempt has started
+    void retrying(NetworkLink link);
+
+    bool ethernetUp() const { return _eth.phase == LINK_UP; }
+    bool wifiUp() const { return _wifi.phase == LINK_UP; }
+    bool isConnected() const { return ethernetUp() || wifiUp(); }
+
+    // Ethernet is preferred when both interfaces are up
+    NetworkLink activeLink() const;
+
+    // "Ethernet", "WiFi" or "Disconnected"
+    const char* typeName() const;
+
+    LinkStatus status(NetworkLink link) const;
+
+    // millis() of the last phase change on either interface
+    uint32_t lastChangeMs() const { return _lastChangeMs; }
+
+    // Times an interface got an IP back after losing it
+    uint32_t ethernetReconnects() const { return _eth.reconnects; }
+    uint32_t wifiReconnects() const { return _wifi.reconnects; }
+
+    // Times traffic moved from Ethernet to WiFi, and back again
+    uint32_t failovers() const { return _failovers; }
+    uint32_t failbacks() const { return _failbacks; }
+
+    // Wait before attempt number attempts + 1, doubling from NETWORK_RETRY_MIN_MS
+    static uint32_t backoffMs(uint8_t attempts);
+
+    // "down", "connecting", "up" or "backoff"
+    static const char* phaseName(LinkPhase phase);
+};
+
+#endif // NETWORK_STATE_H
@@ -0,0 +1,38 @@
+#ifndef RESPONSE_POOL_H
+#define RESPONSE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "ApiLimits.h"
+
+// Response bodies in flight at once. A slot is held until the client
+// disconnects, further requests get a static "busy" reply.
+#define RESPONSE_POOL_SLOTS 8
+#define RESPONSE_SLOT_SIZE API_ZONES_RESPONSE_SIZE   // The largest pooled reply
+
+// Fixed set of response buffers, so JSON replies are serialised and sent
+// without touching the heap. The web server streams a body straight out of
+// its slot and releases the slot once the connection closes.
+class ResponsePool {
+private:
+    char _slots[RESPONSE_POOL_SLOTS][RESPONSE_SLOT_SIZE];
+    std::atomic<bool> _used[RESPONSE_POOL_SLOTS];
+    std::atomic<uint32_t> _exhausted;
+
+public:
+    ResponsePool();
+
+    // A free slot of RESPONSE_SLOT_SIZE bytes, or NULL if all are in use
+    char* acquire();
+
+    // Return a slot from acquire(). NULL is ignored.
+    void release(char* slot);
+
+    size_t inUse();
+
+    // Times acquire() found no free slot
+    uint32_t exhausted() { return _exhausted; }
+};
+
+#endif // RESPONSE_POOL_H
@@ -0,0 +1,47 @@
+#ifndef SCHEDULE_QUEUE_H
+#define SCHEDULE_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "Watering.h"
+
+// When a schedule next starts strictly after the time after, in local time as
+// set by TZ. Daylight saving changes are followed. Returns 0 if the schedule
+// has no days.
+time_t scheduleNextRun(const Schedule& schedule, time_t after);
+
+struct ScheduleEntry {
+    time_t at;          // Next start
+    uint8_t slot;       // Index into the schedule table
+};
+
+// Min-heap of next start times, one entry per enabled schedule. A scheduler
+// tick only looks at the top, so it costs O(1) when nothing is due, and a
+// start costs one pop and one push.
+//
+// Not thread safe, the scheduler serialises access.
+class ScheduleQueue {
+private:
+    ScheduleEntry _heap[SCHEDULE_MAX];
+    uint8_t _count;
+
+    void swap(uint8_t a, uint8_t b);
+
+public:
+    ScheduleQueue() : _count(0) {}
+
+    void clear() { _count = 0; }
+    uint8_t size() { return _count; }
+
+    // Returns false if the queue is full
+    bool push(time_t at, uint8_t slot);
+
+    // Earliest entry, false if the queue is empty
+    bool peek(ScheduleEntry& entry);
+
+    // Remove the earliest entry if it is due at or before now
+    bool popDue(time_t now, ScheduleEntry& entry);
+};
+
+#endif // SCHEDULE_QUEUE_H
@@ -0,0 +1,102 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+#include "SequenceRunner.h"
+#include "ScheduleQueue.h"
+#include "Watering.h"
+
+// NVS namespace and keys holding the schedule table and time zone
+#define SCHEDULE_PREFS_NAMESPACE "schedules"
+#define SCHEDULE_PREFS_TABLE "table"
+#define SCHEDULE_PREFS_VERSION "version"
+#define SCHEDULE_PREFS_TZ "tz"
+
+// How often the scheduler looks for a due schedule
+#define SCHEDULE_TICK_MS 1000
+
+// A clock step larger than this, SNTP or manual, recomputes every start time
+#define SCHEDULE_CLOCK_STEP_S 60
+
+// Time zone until one is set through /api/time, as a POSIX TZ string. Override with -D.
+#ifndef SCHEDULE_TZ
+#define SCHEDULE_TZ "UTC0"
+#endif
+#ifndef SCHEDULE_NTP_SERVER
+#define SCHEDULE_NTP_SERVER "pool.ntp.org"
+#endif
+
+enum TimeSource {
+    TIME_NONE,          // Clock not set since boot
+    TIME_SNTP,
+    TIME_MANUAL         // Set through POST /api/time
+};
+
+enum ScheduleResult {
+    SCHEDULE_OK,
+    SCHEDULE_NOT_FOUND,
+    SCHEDULE_FULL
+};
+
+// Wall clock as seen by the scheduler
+struct SchedulerClock {
+    time_t now;
+    bool valid;             // now is a real date, schedules can run
+    TimeSource source;
+    char tz[SCHEDULE_TZ_MAX + 1];
+};
+
+// Runs stored schedules on the device, so watering does not depend on a host
+// running cron. Schedules are kept in NVS and each start hands the zone list
+// to the sequence runner, exactly like POST /api/sequence.
+//
+// A one second FreeRTOS timer checks the top of a min-heap of next start
+// times. Schedule changes and clock steps rebuild the heap on the next tick.
+// The tick never waits for the table lock, if a request holds it the check
+// is left to the next tick.
+// A start the sequence runner is too busy for is tried once more on the next
+// tick.
+class Scheduler {
+private:
+    SequenceRunner& _sequence;
+    Schedule _schedules[SCHEDULE_MAX];
+    ScheduleQueue _queue;
+    SemaphoreHandle_t _mutex;
+    TimerHandle_t _timer;
+    time_t _lastTick;           // 0 forces a rebuild on the next tick
+    uint8_t _retrySlot;         // Schedule the sequence runner was too busy for, SCHEDULE_MAX if none
+    char _tz[SCHEDULE_TZ_MAX + 1];
+
+    static volatile TimeSource _source;
+
+    static void timerCallback(TimerHandle_t timer);
+    static void onTimeSync(struct timeval* tv);
+    void onTick();
+    void rebuild(time_t now);
+    void save();
+
+public:
+    Scheduler(SequenceRunner& sequence);
+
+    // Restore the schedules, start SNTP and the tick timer
+    void begin();
+
+    // Schedules are numbered from 1. next is 0 if the clock is not set or the
+    // schedule is disabled.
+    bool get(uint8_t id, Schedule& schedule, time_t& next);
+    ScheduleResult add(const Schedule& schedule, uint8_t& id);
+    ScheduleResult replace(uint8_t id, const Schedule& schedule);
+    ScheduleResult remove(uint8_t id);
+
+    // Manual clock and time zone, for networks without SNTP
+    void setTime(time_t epoch);
+    void setTimeZone(const char* tz);
+    SchedulerClock clock();
+
+    static const char* sourceName(TimeSource source);
+};
+
+#endif // SCHEDULER_H
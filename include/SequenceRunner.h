@@ -0,0 +1,99 @@
+#ifndef SEQUENCE_RUNNER_H
+#define SEQUENCE_RUNNER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+#include "BusWorker.h"
+#include "Watering.h"
+
+// Delay before retrying a step the bus queue refused
+#define SEQUENCE_RETRY_MS 1000
+
+// Longest start() waits for the run list lock when called from a request
+#define SEQUENCE_LOCK_MS 20
+
+// Delay before the step timer tries again when the run list is locked
+#define SEQUENCE_LOCK_RETRY_MS 10
+
+enum SequenceState {
+    SEQ_IDLE,
+    SEQ_RUNNING,
+    SEQ_PAUSED,
+    SEQ_DONE,
+    SEQ_CANCELLED
+};
+
+enum SequenceResult {
+    SEQ_OK,
+    SEQ_NOT_ACTIVE,     // Nothing to act on in the current state
+    SEQ_BUS_BUSY        // The bus queue refused the stop command
+};
+
+// Snapshot of the run list for GET /api/sequence
+struct SequenceProgress {
+    uint32_t id;
+    SequenceState state;
+    uint8_t step;           // Index of the current step
+    uint8_t steps;          // Number of steps in the run list
+    uint8_t zone;           // Zone of the current step
+    uint32_t remainingMs;   // Time left on the current step
+    uint32_t totalRemainingMs;
+};
+
+// Runs an ordered list of zones on the device. Each step is started through
+// the bus worker and a one-shot FreeRTOS timer moves on to the next step when
+// its time is up, so a full cycle needs a single request from the API host.
+class SequenceRunner {
+private:
+    BusWorker& _bus;
+    TimerHandle_t _timer;
+    SemaphoreHandle_t _mutex;
+    SequenceStep _steps[SEQUENCE_MAX_STEPS];
+    uint8_t _count;
+    uint8_t _current;
+    SequenceState _state;
+    uint32_t _id;
+    uint32_t _stepEndMs;        // millis() when the current step ends
+    uint32_t _pausedRemainingMs;
+    bool _pendingStart;         // The bus refused the current step, retry it
+    uint32_t _pendingMs;
+    bool _stopAtEnd;            // The step is not a whole number of minutes, stop it when the time is up
+
+    static void timerCallback(TimerHandle_t timer);
+    void onTimer();
+    void startStep(uint8_t index, uint32_t durationMs);
+    bool stopCurrent();
+    uint32_t remainingMs();
+    void armTimer(uint32_t ms);
+
+public:
+    SequenceRunner(BusWorker& bus);
+
+    // Create the step timer
+    void begin();
+
+    // Replace any current run list and start the first step. Returns the
+    // sequence id, 0 on failure or if the run list stayed locked for
+    // waitMs. The timer task passes 0, it must never block.
+    uint32_t start(const SequenceStep* steps, uint8_t count, uint32_t waitMs = SEQUENCE_LOCK_MS);
+
+    // Stop the current zone and drop the run list
+    SequenceResult cancel();
+
+    // Stop the current zone and hold the remaining time
+    SequenceResult pause();
+
+    // Restart the current zone for the time it had left
+    SequenceResult resume();
+
+    // Move straight on to the next step
+    SequenceResult skip();
+
+    SequenceProgress progress();
+
+    static const char* stateName(SequenceState state);
+};
+
+#endif // SEQUENCE_RUNNER_H
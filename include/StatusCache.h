@@ -0,0 +1,48 @@
+#ifndef STATUS_CACHE_H
+#define STATUS_CACHE_H
+
+#include <Arduino.h>
+#include "ApiRequests.h"
+#include "ControllerRegistry.h"
+#include "NetworkState.h"
+
+// How long a status snapshot is served before it is rebuilt
+#define STATUS_REFRESH_MS 5000
+
+// Serialised GET /api/status response, rebuilt at most once per
+// STATUS_REFRESH_MS. Fields are gathered in tiers: chip, IDF version and
+// reset reason once at boot, addresses when the network state changes, and
+// heap, bus and signal figures on every refresh.
+//
+// Only used from the AsyncTCP task, apart from begin().
+class StatusCache {
+private:
+    ControllerRegistry& _controllers;
+    StatusInfo _status;
+    char _body[API_STATUS_RESPONSE_SIZE];
+    size_t _length;
+    char _etag[API_ETAG_SIZE];
+    uint32_t _refreshedMs;
+    uint32_t _networkChangeMs;
+    bool _networkValid;
+
+    void collectStatic();
+    void collectNetwork();
+    void collectInterface(StatusInterface& out, const NetworkState& link, NetworkLink which, bool enabled);
+    void collectDynamic();
+
+public:
+    StatusCache(ControllerRegistry& controllers);
+
+    // Gather the fields that never change after boot
+    void begin();
+
+    // Rebuild the response if the snapshot is stale. Returns false if it does not fit.
+    bool refresh();
+
+    const char* body() { return _body; }
+    size_t length() { return _length; }
+    const char* etag() { return _etag; }
+};
+
+#endif // STATUS_CACHE_H
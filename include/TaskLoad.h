@@ -0,0 +1,44 @@
+#ifndef TASK_LOAD_H
+#define TASK_LOAD_H
+
+#include <stdint.h>
+
+// Tasks whose run time is remembered between samples. Tasks beyond this are
+// reported over the time since boot.
+#define TASK_LOAD_MAX_TASKS 40
+
+// Run time of one task, as read from FreeRTOS
+struct TaskLoadSample {
+    uint32_t number;        // Unique task number, never reused
+    uint32_t runTime;       // Run time counter, wraps
+};
+
+// CPU share of each task over the time since the previous sample. FreeRTOS
+// only keeps a run time counter per task, which wraps every 71 minutes at
+// 1 MHz, so the share is worked out from the change between two samples.
+//
+// Not thread safe, sample from one task.
+class TaskLoad {
+private:
+    uint32_t _numbers[TASK_LOAD_MAX_TASKS];
+    uint32_t _runTime[TASK_LOAD_MAX_TASKS];
+    uint8_t _count;
+    uint32_t _totalRunTime;
+    uint32_t _sampledMs;
+    uint32_t _windowMs;
+
+    uint32_t previous(uint32_t number);
+
+public:
+    TaskLoad();
+
+    // Take a sample. permille gets each task's share of one core since the
+    // previous sample, in tenths of a percent. The first sample covers the
+    // time since boot.
+    void update(const TaskLoadSample* samples, uint16_t count, uint32_t totalRunTime, uint16_t* permille);
+
+    // Length of the window the last update() covered, the uptime for the first
+    uint32_t windowMs() { return _windowMs; }
+};
+
+#endif // TASK_LOAD_H
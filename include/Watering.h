@@ -0,0 +1,64 @@
+#ifndef WATERING_H
+#define WATERING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Zones, controllers, sequences and schedules as the whole firmware sees
+// them. Shared by the API, the bus side and the scheduler without pulling in
+// ArduinoJson.
+
+// Limits enforced by the REST API, tighter than what the SmartPort accepts
+#define API_MIN_ZONE 1
+#define API_MAX_ZONE 20
+#define API_MAX_MINUTES 120
+
+// Controllers in the registry, one per REM pin. The ESP32-S3 has 4 RMT TX
+// channels, one per controller.
+#define CONTROLLER_MAX 4
+
+// Longest run list accepted by POST /api/sequence
+#define SEQUENCE_MAX_STEPS 48
+
+// Schedules stored on the device, and the longest run list of each
+#define SCHEDULE_MAX 8
+#define SCHEDULE_MAX_STEPS 16
+#define SCHEDULE_NAME_MAX 23
+
+// Bumped whenever the Schedule layout changes, an older stored table is then ignored
+#define SCHEDULE_TABLE_VERSION 1
+
+// Longest POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#define SCHEDULE_TZ_MAX 47
+
+// Clock readings before 2024-01-01 are an unset clock
+#define SCHEDULE_MIN_EPOCH 1704067200
+
+struct SequenceStep {
+    uint8_t zone;
+    uint8_t minutes;
+};
+
+// A watering schedule, run by the on-device scheduler. Stored in NVS as is,
+// with SCHEDULE_TABLE_VERSION.
+struct Schedule {
+    bool used;                  // Slot holds a schedule
+    bool enabled;
+    uint8_t days;               // Bit 0 Sunday to bit 6 Saturday
+    uint16_t startMinute;       // Local time, minutes past midnight
+    uint8_t count;
+    char name[SCHEDULE_NAME_MAX + 1];
+    SequenceStep steps[SCHEDULE_MAX_STEPS];
+};
+
+// One zone of the device-side zone table
+struct ZoneState {
+    bool active;
+    uint32_t startMs;           // millis() when the zone was started
+    uint32_t endMs;             // millis() when it is expected to stop
+    uint32_t lastId;            // Last command for the zone, 0 if none since boot
+    const char* lastCommand;    // "start" or "stop"
+    uint8_t lastResult;         // HunterRoam error code, 0 on success
+};
+
+#endif // WATERING_H
@@ -9,21 +9,92 @@
 #include <WiFi.h>
 #include "iSprinklrNetwork.h"
 #include "HunterRoam.h"
+#include "BusWorker.h"
+#include "ControllerRegistry.h"
+#include "SequenceRunner.h"
+#include "ApiRequests.h"
+#include "ResponsePool.h"
+#include "StatusCache.h"
+#include "EventStream.h"
+#include "ZoneTable.h"
+#include "BodyAccumulator.h"
+#include "Metrics.h"
+#include "AdmissionControl.h"
+#include "IdempotencyCache.h"
+#include "Scheduler.h"
+#include "FrameServer.h"
+#include "Journal.h"
+#include "BootTimeline.h"
+#include "TaskLoad.h"
+#include "HeapStats.h"
 
-// Define SmartPort pin
+// Define SmartPort pin, controller 0. More controllers are added through /api/controllers.
 #define SMARTPORT_PIN 18
 
-// ESP System headers
-#include "esp_system.h"
-#include "esp_chip_info.h"
-#ifdef ESP_IDF_VERSION_MAJOR
-#include "esp_idf_version.h"
+// SmartPort transmitter backend, build with -D SMARTPORT_TX_BITBANG to use the
+// digitalWrite fallback instead of the RMT peripheral
+#ifdef SMARTPORT_TX_BITBANG
+#define SMARTPORT_TX_MODE HUNTER_TX_BITBANG
+#else
+#define SMARTPORT_TX_MODE HUNTER_TX_RMT
 #endif
 
+// Handles a complete POST body
+typedef std::function<void(AsyncWebServerRequest *request, const char *body, size_t len)> JsonBodyHandler;
+
 class WebServer {
 private:
     AsyncWebServer server;
-    HunterRoam hunter_controller;
+    ControllerRegistry controllers;
+    BusWorker& bus;             // Controller 0, also drives the sequence runner
+    SequenceRunner sequence;
+    Scheduler schedules;
+    ResponsePool responses;
+    StatusCache status;
+    EventStream events;
+    ZoneTable zones;
+    BodyAccumulator bodies;
+    Metrics metrics;
+    AdmissionControl admission;
+    portMUX_TYPE admissionLock;     // HTTP and the frame protocol are served from different tasks
+    FrameServer frames;
+    IdempotencyCache idempotency;
+    Journal journal;
+    TaskLoad taskLoad;              // Run time at the previous /api/tasks, AsyncTCP task only
+    std::atomic<bool> routed;       // Routes are set up, the listeners may start
+    std::atomic<bool> listening;    // Started by begin() or the first address, whichever is later
+    
+    AdmissionDecision admit(uint32_t ip, AdmissionClass type);
+    static AdmissionDecision admitFrame(uint32_t ip, AdmissionClass type, void* arg);
+
+    // Register a POST route whose handler gets the whole body, however it was
+    // split. Bus routes pass their admission class to be rate limited.
+    void onJsonBody(const char* uri, JsonBodyHandler handler, AdmissionClass admit = ADMIT_ANY,
+                    WebRequestMethodComposite method = HTTP_POST);
+    void sendTooManyRequests(AsyncWebServerRequest *request, uint32_t retryAfterS);
+    void sendError(AsyncWebServerRequest *request, const ApiResult& result);
+    void sendBatchError(AsyncWebServerRequest *request, const ApiResult& result, int index);
+    void sendAccepted(AsyncWebServerRequest *request, uint32_t id, int controller, int zone, int minutes = -1,
+                      const char* key = NULL, uint32_t fingerprint = 0);
+    // Take the Idempotency-Key header into key, and answer a retry from the
+    // cache. Returns true if the request has been answered.
+    bool replayIdempotent(AsyncWebServerRequest *request, char* key, uint32_t fingerprint);
+    void sendPooled(AsyncWebServerRequest *request, int code, char* slot, size_t len, const char* etag = NULL);
+    void sendStatic(AsyncWebServerRequest *request, int code, const char* json);
+    static void onCommandFinished(uint8_t controller, const BusCommandStatus& status, void* arg);
+    static void onNetworkChange(const NetworkState& state, void* arg);
+    static void onAllocFailed(size_t size, uint32_t caps, const char* function);
+    void listen();
+    BusWorker* findController(AsyncWebServerRequest *request, int index);
+    void collectMetrics(MetricsGauges& gauges);
+    void sendZones(AsyncWebServerRequest *request);
+    void sendSequenceProgress(AsyncWebServerRequest *request, int code);
+    void sendSequenceResult(AsyncWebServerRequest *request, SequenceResult result);
+    void sendSchedules(AsyncWebServerRequest *request);
+    void sendSchedule(AsyncWebServerRequest *request, int code, uint8_t id);
+    void sendTime(AsyncWebServerRequest *request);
+    void sendTasks(AsyncWebServerRequest *request);
+    void sendHeap(AsyncWebServerRequest *request);
     
 public:
     WebServer();
@@ -0,0 +1,48 @@
+#ifndef ZONE_TABLE_H
+#define ZONE_TABLE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "Watering.h"
+#include "BusWorker.h"
+
+// How often finished zones are cleared from the table
+#define ZONE_EXPIRE_MS 1000
+
+// What the device believes each zone is doing, so clients can ask instead of
+// keeping their own shadow state. One fixed slot per zone and controller,
+// filled in as start and stop commands finish on the bus and cleared by a
+// timer once a zone's run time is up.
+//
+// Written from the bus worker and timer tasks, read from the AsyncTCP task.
+// Every access is one short critical section.
+class ZoneTable {
+private:
+    ZoneState _zones[CONTROLLER_MAX][API_MAX_ZONE];
+    portMUX_TYPE _lock;
+    TimerHandle_t _timer;
+
+    static void timerCallback(TimerHandle_t timer);
+
+public:
+    ZoneTable();
+
+    // Start the expiry timer
+    void begin();
+
+    // Record a command that finished or failed on a controller. Zones outside
+    // the API range and programs are ignored.
+    void commandFinished(uint8_t controller, const BusCommandStatus& status);
+
+    // Clear zones whose run time is over
+    void expire();
+
+    // Copy one zone. Returns false if the controller or zone is out of range.
+    bool get(uint8_t controller, uint8_t zone, ZoneState& state);
+
+    // Copy every zone of a controller into zones[API_MAX_ZONE] in one read
+    bool snapshot(uint8_t controller, ZoneState* zones);
+};
+
+#endif // ZONE_TABLE_H
@@ -5,13 +5,23 @@
 #include <WiFi.h>
 #include <ETH.h>
 #include <SPI.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "NetworkState.h"
+
+// A WiFi attempt without an address after this long is dropped and retried
+#define NETWORK_CONNECT_TIMEOUT_MS 20000
 
 // Network connection options
 enum NetworkMode {
     MODE_ETHERNET,    // Use Ethernet only
-    MODE_WIFI         // Use WiFi only
+    MODE_WIFI,        // Use WiFi only
+    MODE_BOTH         // Keep both up, Ethernet preferred and WiFi taking over while it is down
 };
 
+// Called from the network event task whenever an interface gains or loses its IP
+typedef void (*NetworkChangeCallback)(const NetworkState& state, void* arg);
+
 // Fixed IP configuration
 struct FixedIPConfig {
     bool enabled;
@@ -25,7 +35,6 @@ struct FixedIPConfig {
 class iSprinklrNetwork {
 private:
     NetworkMode _mode;
-    bool _connected;
     String _ssid;
     String _password;
     
@@ -41,15 +50,36 @@ private:
     // Fixed IP configuration
     FixedIPConfig _fixedIP;
     
+    // One-shot timers for each interface's next connection attempt or attempt timeout
+    TimerHandle_t _ethTimer;
+    TimerHandle_t _wifiTimer;
+    bool _ethStarted;
+    bool _wifiStarted;
+    
     static iSprinklrNetwork* _instance;
     
     // Private constructor for singleton
     iSprinklrNetwork();
     
+    // Whether the mode brings up this interface
+    bool uses(NetworkLink link);
+    
+    // Start an interface without waiting for it to connect
+    bool startEthernet();
+    bool startWiFi();
+    
+    // Record a failed attempt and arm the timer with its backoff
+    void retryLater(NetworkLink link);
+    void armRetry(NetworkLink link, uint32_t delayMs);
+    static void retryCallback(TimerHandle_t timer);
+    void retry(NetworkLink link);
+    
 public:
     static iSprinklrNetwork* getInstance();
     
-    // Initialize network with the specified mode
+    // Start the network in the specified mode. Returns once the interfaces
+    // are started, connecting and reconnecting carry on in the background.
+    // False if none of them could be started.
     bool begin(NetworkMode mode = MODE_ETHERNET);
     
     // Configure WiFi settings
@@ -58,6 +88,9 @@ public:
     // Configure Ethernet settings
     void configureEthernet(int csPin, int intPin, int rstPin, int misoPin, int mosiPin, int sclkPin, int addr);
     
+    // The W5500 SPI and control pins, whatever the mode. Returns how many were written to pins, at most 6.
+    uint8_t ethernetPins(int* pins);
+    
     // Configure Fixed IP settings
     void configureFixedIP(const IPAddress& ip, const IPAddress& gateway, const IPAddress& subnet, 
                           const IPAddress& dns1 = IPAddress(0,0,0,0), const IPAddress& dns2 = IPAddress(0,0,0,0));
@@ -72,7 +105,7 @@ public:
     static void WiFiEventCallback(arduino_event_id_t event);
     
     // Get connection status
-    bool isConnected() { return _connected; }
+    bool isConnected();
     
     // Get current IP address
     IPAddress getIP();
@@ -82,6 +115,16 @@ public:
     
     // Get current network type (returns "Ethernet" or "WiFi")
     String getNetworkType();
+    
+    // Link state of both interfaces
+    const NetworkState& getLinkState();
+    
+    // Point outgoing traffic at the active interface, MODE_BOTH only. Called
+    // from the network event task after every link event.
+    void updateDefaultRoute();
+    
+    // Register the link change listener
+    void onChange(NetworkChangeCallback callback, void* arg);
 };
 
 #endif // ISPRINKLR_NETWORK_H
@@ -0,0 +1,142 @@
+#include "Hal.h"
+#include <string.h>
+
+#ifdef ARDUINO
+
+#include "esp_partition.h"
+
+static const esp_partition_t* flashPartition() {
+    static const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HAL_FLASH_PARTITION);
+    return partition;
+}
+
+size_t halFlashSize() {
+    const esp_partition_t* partition = flashPartition();
+    return partition != NULL ? partition->size : 0;
+}
+
+bool halFlashRead(uint32_t offset, void* out, size_t len) {
+    const esp_partition_t* partition = flashPartition();
+    return partition != NULL && esp_partition_read(partition, offset, out, len) == ESP_OK;
+}
+
+bool halFlashWrite(uint32_t offset, const void* data, size_t len) {
+    const esp_partition_t* partition = flashPartition();
+    return partition != NULL && esp_partition_write(partition, offset, data, len) == ESP_OK;
+}
+
+bool halFlashErase(uint32_t offset) {
+    const esp_partition_t* partition = flashPartition();
+    return partition != NULL && esp_partition_erase_range(partition, offset, HAL_FLASH_SECTOR) == ESP_OK;
+}
+
+#else
+
+/**
+ * Host implementation. Nothing sleeps: delays advance the simulated clock,
+ * which is what halMillis and halMicros report.
+ */
+
+static int64_t simulatedUs = 0;
+static size_t pinWriteCount = 0;
+static HalPinWrite pinLog[HAL_PIN_LOG_LENGTH];
+static uint8_t flash[HAL_NATIVE_FLASH_SIZE];
+static size_t flashErases = 0;
+static size_t flashWrites = 0;
+
+void halPinMode(int pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void halDigitalWrite(int pin, uint8_t level) {
+    if (pinWriteCount < HAL_PIN_LOG_LENGTH) {
+        pinLog[pinWriteCount].pin = pin;
+        pinLog[pinWriteCount].level = level;
+        pinLog[pinWriteCount].us = simulatedUs;
+    }
+    pinWriteCount++;
+}
+
+void halDelay(uint32_t ms) {
+    simulatedUs += (int64_t)ms * 1000;
+}
+
+void halDelayMicroseconds(uint32_t us) {
+    simulatedUs += us;
+}
+
+uint32_t halMillis() {
+    return (uint32_t)(simulatedUs / 1000);
+}
+
+int64_t halMicros() {
+    return simulatedUs;
+}
+
+void halNativeReset() {
+    simulatedUs = 0;
+    pinWriteCount = 0;
+}
+
+void halNativeAdvance(uint32_t us) {
+    simulatedUs += us;
+}
+
+size_t halNativePinWriteCount() {
+    return pinWriteCount;
+}
+
+const HalPinWrite* halNativePinLog() {
+    return pinLog;
+}
+
+size_t halFlashSize() {
+    return HAL_NATIVE_FLASH_SIZE;
+}
+
+bool halFlashRead(uint32_t offset, void* out, size_t len) {
+    if (offset + len > HAL_NATIVE_FLASH_SIZE) {
+        return false;
+    }
+    memcpy(out, flash + offset, len);
+    return true;
+}
+
+bool halFlashWrite(uint32_t offset, const void* data, size_t len) {
+    if (offset + len > HAL_NATIVE_FLASH_SIZE) {
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++) {
+        flash[offset + i] &= bytes[i];
+    }
+    flashWrites++;
+    return true;
+}
+
+bool halFlashErase(uint32_t offset) {
+    if (offset % HAL_FLASH_SECTOR != 0 || offset >= HAL_NATIVE_FLASH_SIZE) {
+        return false;
+    }
+    memset(flash + offset, 0xff, HAL_FLASH_SECTOR);
+    flashErases++;
+    return true;
+}
+
+void halNativeFlashReset() {
+    memset(flash, 0xff, sizeof(flash));
+    flashErases = 0;
+    flashWrites = 0;
+}
+
+size_t halNativeFlashErases() {
+    return flashErases;
+}
+
+size_t halNativeFlashWrites() {
+    return flashWrites;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef Hal_h
+#define Hal_h
+
+/**
+ * Small hardware abstraction layer: pin writes, delays, millis, the
+ * microsecond clock and a raw flash region.
+ *
+ * On the ESP32 every call forwards to the Arduino core or ESP-IDF. Off-device
+ * (env:native) pin writes go to an in-memory log, delays advance a simulated
+ * clock instead of sleeping and flash is a RAM array, so the libraries and
+ * request logic can be built, tested and benchmarked on the host.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Flash erase unit
+#define HAL_FLASH_SECTOR 4096
+
+// Raw flash region for the command journal: the data partition with this
+// label on the ESP32, a RAM array on the host. Like NOR flash, writes can only
+// clear bits and an erase sets a whole sector back to 0xff.
+#define HAL_FLASH_PARTITION "spiffs"
+
+// Size of the region in bytes, 0 if there is none
+size_t halFlashSize();
+bool halFlashRead(uint32_t offset, void* out, size_t len);
+bool halFlashWrite(uint32_t offset, const void* data, size_t len);
+
+// Erase the sector starting at offset
+bool halFlashErase(uint32_t offset);
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+inline void halPinMode(int pin, uint8_t mode) { pinMode(pin, mode); }
+inline void halDigitalWrite(int pin, uint8_t level) { digitalWrite(pin, level); }
+inline void halDelay(uint32_t ms) { delay(ms); }
+inline void halDelayMicroseconds(uint32_t us) { delayMicroseconds(us); }
+inline uint32_t halMillis() { return millis(); }
+inline int64_t halMicros() { return esp_timer_get_time(); }
+
+#else
+
+#include <string>
+
+// The few Arduino names the shared code relies on
+typedef uint8_t byte;
+typedef std::string String;
+
+#define LOW 0x0
+#define HIGH 0x1
+#define OUTPUT 0x03
+#define IRAM_ATTR
+
+void halPinMode(int pin, uint8_t mode);
+void halDigitalWrite(int pin, uint8_t level);
+void halDelay(uint32_t ms);
+void halDelayMicroseconds(uint32_t us);
+uint32_t halMillis();
+int64_t halMicros();
+
+// Simulation hooks for host tests
+
+// Pin writes kept in the log, enough for the longest SmartPort frame
+#define HAL_PIN_LOG_LENGTH 512
+
+struct HalPinWrite {
+    int pin;
+    uint8_t level;
+    int64_t us;         // Simulated time of the write
+};
+
+// Clear the pin log and rewind the clock to 0
+void halNativeReset();
+
+// Move the simulated clock forward
+void halNativeAdvance(uint32_t us);
+
+// Number of pin writes since the last reset, the log keeps the first HAL_PIN_LOG_LENGTH
+size_t halNativePinWriteCount();
+const HalPinWrite* halNativePinLog();
+
+// Size of the simulated flash region
+#define HAL_NATIVE_FLASH_SIZE (16 * HAL_FLASH_SECTOR)
+
+// Erase the whole simulated flash and clear its counters
+void halNativeFlashReset();
+
+// Sector erases and write calls since the last reset
+size_t halNativeFlashErases();
+size_t halNativeFlashWrites();
+
+#endif
+
+#endif
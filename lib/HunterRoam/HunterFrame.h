@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef HunterFrame_h
+#define HunterFrame_h
+
+/**
+ * Allocation-free encoder for SmartPort frames.
+ *
+ * Every encoder is constexpr and works on fixed-size std::array frames, so
+ * frames can be built at compile time and the transmit path never touches
+ * the heap. The output is bit-identical to the original vector based
+ * HunterRoam::hunterBitfield encoding (see test/test_hunter_frame).
+ *
+ * This header only depends on the standard library so it can be built and
+ * tested off-device.
+ */
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HUNTER_ZONE_FRAME_LEN 15
+#define HUNTER_PROGRAM_FRAME_LEN 7
+
+#define HUNTER_MIN_ZONE 1
+#define HUNTER_MAX_ZONE 48
+#define HUNTER_MAX_TIME 240
+#define HUNTER_MIN_PROGRAM 1
+#define HUNTER_MAX_PROGRAM 4
+
+typedef std::array<uint8_t, HUNTER_ZONE_FRAME_LEN> HunterZoneFrame;
+typedef std::array<uint8_t, HUNTER_PROGRAM_FRAME_LEN> HunterProgramFrame;
+
+// Base frames the zone and program fields are patched into
+constexpr HunterZoneFrame HUNTER_ZONE_BASE_FRAME = {
+	0xff, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x04, 0x00, 0x00, 0x01, 0x00, 0x01, 0xb8, 0x3f
+};
+constexpr HunterProgramFrame HUNTER_PROGRAM_BASE_FRAME = {
+	0xff, 0x40, 0x03, 0x96, 0x09, 0xbd, 0x7f
+};
+
+/**
+ * Set a value with an arbitrary bit width to a bit position within a frame.
+ * The value is written least significant bit first, each bit counted from the
+ * most significant bit of its byte.
+ *
+ * @param bits frame to write the value to
+ * @param pos position within the frame
+ * @param val to write
+ * @param len in bits of the value
+ */
+template <size_t N>
+constexpr void hunterSetBits(std::array<uint8_t, N> &bits, uint8_t pos, uint8_t val, uint8_t len) {
+	while (len > 0) {
+		uint8_t mask = 0x80 >> (pos % 8);
+		if (val & 0x1) {
+			bits[pos / 8] = bits[pos / 8] | mask;
+		} else {
+			bits[pos / 8] = bits[pos / 8] & ~mask;
+		}
+		len--;
+		val = val >> 1;
+		pos++;
+	}
+}
+
+/**
+ * Compare two frames. std::array's operator== is only constexpr from C++20.
+ */
+template <size_t N>
+constexpr bool hunterFrameEqual(const std::array<uint8_t, N> &a, const std::array<uint8_t, N> &b) {
+	for (size_t i = 0; i < N; i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+constexpr bool hunterValidZone(int zone) {
+	return zone >= HUNTER_MIN_ZONE && zone <= HUNTER_MAX_ZONE;
+}
+
+constexpr bool hunterValidTime(int time) {
+	return time >= 0 && time <= HUNTER_MAX_TIME;
+}
+
+constexpr bool hunterValidProgram(int num) {
+	return num >= HUNTER_MIN_PROGRAM && num <= HUNTER_MAX_PROGRAM;
+}
+
+/**
+ * Encode a zone start frame. Callers validate the arguments first.
+ *
+ * @param zone zone number (1-48)
+ * @param time time in minutes (0-240), 0 stops the zone
+ */
+constexpr HunterZoneFrame hunterZoneFrame(uint8_t zone, uint8_t time) {
+	HunterZoneFrame frame = HUNTER_ZONE_BASE_FRAME;
+
+	// Bits 9:10 are 0x1 for zones > 12 and 0x2 otherwise
+	hunterSetBits(frame, 9, zone > 12 ? 0x1 : 0x2, 2);
+
+	// Zone + 0x17 is at bits 23:29 and 36:42
+	hunterSetBits(frame, 23, zone + 0x17, 7);
+	hunterSetBits(frame, 36, zone + 0x17, 7);
+
+	// Zone + 0x23 is at bits 49:55 and 62:68
+	hunterSetBits(frame, 49, zone + 0x23, 7);
+	hunterSetBits(frame, 62, zone + 0x23, 7);
+
+	// Zone + 0x2f is at bits 75:81 and 88:94
+	hunterSetBits(frame, 75, zone + 0x2f, 7);
+	hunterSetBits(frame, 88, zone + 0x2f, 7);
+
+	// Time is encoded in three places and broken up by nibble
+	// Low nibble: bits 31:34, 57:60, and 83:86
+	// High nibble: bits 44:47, 70:73, and 96:99
+	hunterSetBits(frame, 31, time, 4);
+	hunterSetBits(frame, 44, time >> 4, 4);
+	hunterSetBits(frame, 57, time, 4);
+	hunterSetBits(frame, 70, time >> 4, 4);
+	hunterSetBits(frame, 83, time, 4);
+	hunterSetBits(frame, 96, time >> 4, 4);
+
+	// Bottom nibble of zone - 1 is at bits 109:112
+	hunterSetBits(frame, 109, zone - 1, 4);
+
+	return frame;
+}
+
+/**
+ * Encode a program start frame. Callers validate the argument first.
+ *
+ * @param num program number (1-4)
+ */
+constexpr HunterProgramFrame hunterProgramFrame(uint8_t num) {
+	HunterProgramFrame frame = HUNTER_PROGRAM_BASE_FRAME;
+
+	// Program number - 1 is at bits 31:32
+	hunterSetBits(frame, 31, num - 1, 2);
+
+	return frame;
+}
+
+#endif
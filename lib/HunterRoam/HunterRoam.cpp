@@ -18,16 +18,35 @@
  * 			        ------ Eloi Codina Torras - July 2020 ------
  */
 
+#include <string.h>
+#include <stdlib.h>
 #include "HunterRoam.h"
+#if HUNTER_HAS_RMT
+#include "driver/gpio.h"
+#endif
 
 /**
  * Constructor for the object HunterRoam.
  * 
  * @param pin GPIO number where the REM wire is connected to.
+ * @param mode transmitter backend. The RMT channel is only claimed on the first frame.
  */
-HunterRoam::HunterRoam(int pin) {
+HunterRoam::HunterRoam(int pin, HunterTxMode mode) {
 	_pin = pin;
-	pinMode(pin, OUTPUT);
+	_mode = mode;
+	_callback = NULL;
+	_callbackArg = NULL;
+	_pulseCount = 0;
+	_edgeCount = 0;
+	_busy = false;
+	_pendingJitter = false;
+	memset(_jitter, 0, sizeof(_jitter));
+	memset(&_stats, 0, sizeof(_stats));
+#if HUNTER_HAS_RMT
+	_rmtChannel = NULL;
+	_rmtEncoder = NULL;
+#endif
+	halPinMode(pin, OUTPUT);
 }
 
 /**
@@ -52,140 +71,440 @@ String HunterRoam::errorHint(byte error) {
 }
 
 /**
- * Write low bit on the bus.
+ * Select the transmitter backend. Waits for a frame in flight to finish first.
+ *
+ * @param mode HUNTER_TX_RMT for hardware-timed frames, HUNTER_TX_BITBANG for the
+ * 			digitalWrite fallback
  */
-void HunterRoam::sendLow() {
-	digitalWrite(_pin, HIGH);
-	delayMicroseconds(SHORT_INTERVAL);
-	digitalWrite(_pin, LOW);
-	delayMicroseconds(LONG_INTERVAL);
+void HunterRoam::setTxMode(HunterTxMode mode) {
+	if (mode == _mode) {
+		return;
+	}
+	waitIdle(HUNTER_WAIT_FOREVER);
+	if (_mode == HUNTER_TX_RMT) {
+		endRmt();
+	}
+	_mode = mode;
+	halPinMode(_pin, OUTPUT);
+	halDigitalWrite(_pin, LOW);
 }
 
 /**
- * Write high bit on the bus
- * 
- * Arguments: none
+ * Register a function to be called once a frame has been clocked out.
+ * With the RMT backend it runs in ISR context and must be IRAM safe.
+ *
+ * @param callback function to call, or NULL to disable
+ * @param arg passed unchanged to the callback
  */
-void HunterRoam::sendHigh() {
-	digitalWrite(_pin, HIGH);
-	delayMicroseconds(LONG_INTERVAL);
-	digitalWrite(_pin, LOW);
-	delayMicroseconds(SHORT_INTERVAL);
+void HunterRoam::onComplete(HunterTxCallback callback, void *arg) {
+	_callback = callback;
+	_callbackArg = arg;
 }
 
 /**
- * Write the bit sequence out of the bus
- * 
+ * Check if a frame is still being transmitted.
+ */
+bool HunterRoam::isBusy() {
+	if (!_busy && _pendingJitter) {
+		recordJitter();
+	}
+	return _busy;
+}
+
+/**
+ * Block until the frame in flight has been transmitted.
+ *
+ * @param timeoutMs maximum time to wait, HUNTER_WAIT_FOREVER to wait forever
+ * @return true if the bus is idle
+ */
+bool HunterRoam::waitIdle(uint32_t timeoutMs) {
+#if HUNTER_HAS_RMT
+	if (_busy && _rmtChannel != NULL) {
+		int timeout = (timeoutMs == HUNTER_WAIT_FOREVER) ? -1 : (int)timeoutMs;
+		if (rmt_tx_wait_all_done(_rmtChannel, timeout) != ESP_OK) {
+			return false;
+		}
+	}
+#else
+	(void)timeoutMs;
+#endif
+	return !isBusy();
+}
+
+/**
+ * Get the measured edge jitter of a transmitter backend.
+ *
+ * @param mode backend to report on
+ */
+HunterJitter HunterRoam::getJitter(HunterTxMode mode) {
+	isBusy();
+	return _jitter[mode];
+}
+
+/**
+ * Get the measured pulse widths of every frame sent so far.
+ */
+HunterBusStats HunterRoam::getStats() {
+	isBusy();
+	return _stats;
+}
+
+/**
+ * Nominal width of a pulse class in microseconds.
+ *
+ * @param pulse pulse class
+ */
+uint32_t HunterRoam::nominalWidth(HunterPulseClass pulse) {
+	switch (pulse) {
+		case HUNTER_PULSE_START:
+			return START_INTERVAL;
+		case HUNTER_PULSE_SHORT:
+			return SHORT_INTERVAL;
+		default:
+			return LONG_INTERVAL;
+	}
+}
+
+/**
+ * Expand the frame into the nominal pulse widths, in microseconds, alternating
+ * between HIGH and LOW starting with the reset pulse.
+ *
  * @param buffer blob containing the bits to transmit
+ * @param len number of bytes in the blob
  * @param extrabit if true, then write an extra 1 bit
+ * @return number of pulses
  */
-void HunterRoam::writeBus(std::vector<byte> buffer, bool extrabit) {
+size_t HunterRoam::encodePulses(const byte *buffer, size_t len, bool extrabit) {
+	size_t count = 0;
+
 	// Resetimpulse
-	digitalWrite(_pin, HIGH);
-	delay(325); //milliseconds
-	digitalWrite(_pin, LOW);
-	delay(65); //milliseconds
+	_pulses[count++] = RESET_INTERVAL;
+	_pulses[count++] = RESET_GAP_INTERVAL;
 
 	// Startimpulse
-	digitalWrite(_pin, HIGH);
-	delayMicroseconds(START_INTERVAL);
-	digitalWrite(_pin, LOW);
-	delayMicroseconds(SHORT_INTERVAL);
-
-	// Write the bits out
-	for (auto &sendByte : buffer) {
-		for (byte inner = 0; inner < 8; inner++) {
-			// Send high order bits first
-			(sendByte & 0x80) ? sendHigh() : sendLow();
+	_pulses[count++] = START_INTERVAL;
+	_pulses[count++] = SHORT_INTERVAL;
+
+	// The bits, high order bits first
+	for (size_t i = 0; i < len; i++) {
+		byte sendByte = buffer[i];
+		for (byte inner = 0; inner < 8 && count + 6 <= HUNTER_MAX_PULSES; inner++) {
+			bool high = sendByte & 0x80;
+			_pulses[count++] = high ? LONG_INTERVAL : SHORT_INTERVAL;
+			_pulses[count++] = high ? SHORT_INTERVAL : LONG_INTERVAL;
 			sendByte <<= 1;
 		}
 	}
 
 	// Include an extra 1 bit
 	if (extrabit) {
-		sendHigh();
+		_pulses[count++] = LONG_INTERVAL;
+		_pulses[count++] = SHORT_INTERVAL;
 	}
 
-	// Write the stop pulse
-	sendLow();
+	// The stop pulse
+	_pulses[count++] = SHORT_INTERVAL;
+	_pulses[count++] = LONG_INTERVAL;
+
+	return count;
 }
 
-/**	
- * Set a value with an arbitrary bit width to a bit position within a blob.
- * 
- * @param bits blob to write the value to
- * @param pos position within the blob
- * @param val to write
- * @param len in bits of the value
- */
-void HunterRoam::hunterBitfield(std::vector <byte> &bits, byte pos, byte val, byte len) {
-	while (len > 0) {
-		if (val & 0x1) {
-			bits[pos / 8] = bits[pos / 8] | 0x80 >> (pos % 8);
+/**
+ * Write the bit sequence out of the bus
+ *
+ * @param buffer blob containing the bits to transmit
+ * @param len number of bytes in the blob
+ * @param extrabit if true, then write an extra 1 bit
+ */
+void HunterRoam::writeBus(const byte *buffer, size_t len, bool extrabit) {
+	// The pulse and symbol buffers belong to the frame in flight
+	waitIdle(HUNTER_WAIT_FOREVER);
+
+	_pulseCount = encodePulses(buffer, len, extrabit);
+	_edgeCount = 0;
+	_busy = true;
+	_pendingJitter = true;
+
+	if (_mode == HUNTER_TX_RMT && writeRmt()) {
+		return;
+	}
+
+	writeBitBang();
+	_busy = false;
+	if (_callback != NULL) {
+		_callback(_callbackArg);
+	}
+	recordJitter();
+}
+
+/**
+ * Bit-bang the pulses with digitalWrite, timestamping each edge.
+ * Blocks for the whole frame.
+ */
+void HunterRoam::writeBitBang() {
+	for (size_t i = 0; i < _pulseCount; i++) {
+		halDigitalWrite(_pin, (i % 2 == 0) ? HIGH : LOW);
+		_edges[i] = (uint32_t)halMicros();
+		if (_pulses[i] >= 10000) {
+			halDelay(_pulses[i] / 1000); //milliseconds
 		} else {
-			bits[pos / 8] = bits[pos / 8] & ~(0x80 >> (pos % 8));
+			halDelayMicroseconds(_pulses[i]);
 		}
-		len--;
-		val = val >> 1;
-		pos++;
 	}
+	_edgeCount = _pulseCount;
 }
 
+#if HUNTER_HAS_RMT
+
 /**
- * Start a zone
- * 
- * @param zone zone number (1-48)
- * @param time time in minutes (0-240)
+ * Lazily create the RMT channel. The pin is handed over from the GPIO matrix
+ * to the RMT peripheral, with its input path kept enabled so the edge
+ * interrupt can timestamp what actually appears on the wire.
+ *
+ * @return true if the channel is ready
  */
-byte HunterRoam::startZone(byte zone, byte time) {
+bool HunterRoam::beginRmt() {
+	if (_rmtChannel != NULL) {
+		return true;
+	}
 
-	// Start out with a base frame
-	std::vector<byte> buffer = {0xff,0x00,0x00,0x00,0x10,0x00,0x00,0x04,0x00,0x00,0x01,0x00,0x01,0xb8,0x3f};
+	rmt_tx_channel_config_t channelConfig = {};
+	channelConfig.gpio_num = (gpio_num_t)_pin;
+	channelConfig.clk_src = RMT_CLK_SRC_DEFAULT;
+	channelConfig.resolution_hz = HUNTER_RMT_RESOLUTION_HZ;
+	channelConfig.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+	channelConfig.trans_queue_depth = 1;
+	if (rmt_new_tx_channel(&channelConfig, &_rmtChannel) != ESP_OK) {
+		_rmtChannel = NULL;
+		return false;
+	}
 
-	if (zone < 1 || zone > 48) {
-		return 1;
+	rmt_copy_encoder_config_t encoderConfig = {};
+	rmt_tx_event_callbacks_t callbacks = {};
+	callbacks.on_trans_done = rmtDoneIsr;
+	if (rmt_new_copy_encoder(&encoderConfig, &_rmtEncoder) != ESP_OK ||
+		rmt_tx_register_event_callbacks(_rmtChannel, &callbacks, this) != ESP_OK ||
+		rmt_enable(_rmtChannel) != ESP_OK) {
+		endRmt();
+		return false;
 	}
 
-	if (time < 0 || time > 240) {
-		return 2;
+	gpio_input_enable((gpio_num_t)_pin);
+	esp_err_t err = gpio_install_isr_service(0);
+	if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+		endRmt();
+		return false;
+	}
+	gpio_set_intr_type((gpio_num_t)_pin, GPIO_INTR_ANYEDGE);
+	gpio_isr_handler_add((gpio_num_t)_pin, edgeIsr, this);
+	gpio_intr_disable((gpio_num_t)_pin);
+	return true;
+}
+
+/**
+ * Release the RMT channel so the pin can be bit-banged again.
+ */
+void HunterRoam::endRmt() {
+	if (_rmtChannel != NULL) {
+		gpio_isr_handler_remove((gpio_num_t)_pin);
+		rmt_disable(_rmtChannel);
+		rmt_del_channel(_rmtChannel);
+		_rmtChannel = NULL;
 	}
+	if (_rmtEncoder != NULL) {
+		rmt_del_encoder(_rmtEncoder);
+		_rmtEncoder = NULL;
+	}
+}
+
+/**
+ * Convert the pulses to RMT symbols and queue them. Returns without waiting,
+ * completion is signalled from rmtDoneIsr.
+ *
+ * @return false if the RMT backend is unavailable and the caller should bit-bang
+ */
+bool HunterRoam::writeRmt() {
+	if (!beginRmt()) {
+		Serial.println("HunterRoam: RMT unavailable, falling back to bit-bang");
+		_mode = HUNTER_TX_BITBANG;
+		halPinMode(_pin, OUTPUT);
+		return false;
+	}
+
+	// Pack the pulses into half-symbols, splitting the ones that overflow a half
+	size_t halves = 0;
+	for (size_t i = 0; i < _pulseCount; i++) {
+		uint32_t remaining = _pulses[i];
+		uint32_t level = (i % 2 == 0) ? 1 : 0;
+		while (remaining > 0) {
+			uint32_t duration = remaining > HUNTER_RMT_MAX_DURATION ? HUNTER_RMT_MAX_DURATION : remaining;
+			rmt_symbol_word_t &symbol = _symbols[halves / 2];
+			if (halves % 2 == 0) {
+				symbol.level0 = level;
+				symbol.duration0 = duration;
+			} else {
+				symbol.level1 = level;
+				symbol.duration1 = duration;
+			}
+			remaining -= duration;
+			halves++;
+		}
+	}
+	// A zero duration half terminates the transmission
+	if (halves % 2 == 1) {
+		_symbols[halves / 2].level1 = 0;
+		_symbols[halves / 2].duration1 = 0;
+		halves++;
+	}
+
+	rmt_transmit_config_t transmitConfig = {};
+	transmitConfig.loop_count = 0;
+	transmitConfig.flags.eot_level = 0;
+
+	gpio_intr_enable((gpio_num_t)_pin);
+	if (rmt_transmit(_rmtChannel, _rmtEncoder, _symbols, (halves / 2) * sizeof(rmt_symbol_word_t), &transmitConfig) != ESP_OK) {
+		gpio_intr_disable((gpio_num_t)_pin);
+		return false;
+	}
+	return true;
+}
 
-	// The bus protocol is a little bizzare, not sure why
+/**
+ * GPIO interrupt on every edge of the REM pin while the RMT is transmitting.
+ * The measured jitter includes interrupt latency, so it is an upper bound.
+ */
+void IRAM_ATTR HunterRoam::edgeIsr(void *arg) {
+	HunterRoam *self = (HunterRoam *)arg;
+	size_t count = self->_edgeCount;
+	if (count < HUNTER_MAX_PULSES) {
+		self->_edges[count] = (uint32_t)halMicros();
+		self->_edgeCount = count + 1;
+	}
+}
 
-	// Bits 9:10 are 0x1 for zones > 12 and 0x2 otherwise
-	if (zone > 12) {
-		hunterBitfield(buffer, 9, 0x1, 2);
-	} else {
-		hunterBitfield(buffer, 9, 0x2, 2);
+/**
+ * RMT transmit done interrupt.
+ */
+bool IRAM_ATTR HunterRoam::rmtDoneIsr(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event, void *arg) {
+	HunterRoam *self = (HunterRoam *)arg;
+	gpio_intr_disable((gpio_num_t)self->_pin);
+	self->_busy = false;
+	if (self->_callback != NULL) {
+		self->_callback(self->_callbackArg);
 	}
+	return false;
+}
+
+#else
+
+/**
+ * Without ESP-IDF there is no RMT peripheral, every frame is bit-banged.
+ */
+bool HunterRoam::beginRmt() {
+	return false;
+}
 
-	// Zone + 0x17 is at bits 23:29 and 36:42
-	hunterBitfield(buffer, 23, zone + 0x17, 7);
-	hunterBitfield(buffer, 36, zone + 0x17, 7);
+void HunterRoam::endRmt() {
+}
 
-	// Zone + 0x23 is at bits 49:55 and 62:68
-	hunterBitfield(buffer, 49, zone + 0x23, 7);
-	hunterBitfield(buffer, 62, zone + 0x23, 7);
+bool HunterRoam::writeRmt() {
+	_mode = HUNTER_TX_BITBANG;
+	return false;
+}
 
-	// Zone + 0x2f is at bits 75:81 and 88:94
-	hunterBitfield(buffer, 75, zone + 0x2f, 7);
-	hunterBitfield(buffer, 88, zone + 0x2f, 7);
+#endif
 
-	// Time is encoded in three places and broken up by nibble
-	// Low nibble: bits 31:34, 57:60, and 83:86
-	// High nibble: bits 44:47, 70:73, and 96:99
-	hunterBitfield(buffer, 31, time, 4);
-	hunterBitfield(buffer, 44, time >> 4, 4);
-	hunterBitfield(buffer, 57, time, 4);
-	hunterBitfield(buffer, 70, time >> 4, 4);
-	hunterBitfield(buffer, 83, time, 4);
-	hunterBitfield(buffer, 96, time >> 4, 4);
+/**
+ * Compare the captured edges of the last frame against the nominal pulse widths
+ * and fold the deviation into the jitter of the backend that sent it, and the
+ * measured widths into the per pulse class statistics. The reset
+ * pulse and gap are left out, they are timed in milliseconds and are not critical.
+ */
+void HunterRoam::recordJitter() {
+	_pendingJitter = false;
+	HunterJitter &jitter = _jitter[_mode];
 
-	// Bottom nibble of zone - 1 is at bits 109:112
-	hunterBitfield(buffer, 109, zone - 1, 4);
+	// The last pulse ends without an edge
+	size_t count = _edgeCount;
+	if (count != _pulseCount) {
+		jitter.dropped++;
+		return;
+	}
+
+	uint32_t frameMax = 0;
+	for (size_t i = 2; i + 1 < count; i++) {
+		int32_t actual = (int32_t)(_edges[i + 1] - _edges[i]);
+		uint32_t deviation = abs(actual - (int32_t)_pulses[i]);
+		if (deviation > frameMax) {
+			frameMax = deviation;
+		}
+		jitter.sumUs += deviation;
+		jitter.pulses++;
+		recordPulse(_pulses[i], actual);
+	}
+
+	jitter.frames++;
+	_stats.frames++;
+	jitter.lastMaxUs = frameMax;
+	if (frameMax > jitter.maxUs) {
+		jitter.maxUs = frameMax;
+	}
+}
+
+/**
+ * Add one measured pulse to the statistics of its class.
+ *
+ * @param nominal width the pulse should have had, in microseconds
+ * @param actual measured width, in microseconds
+ */
+void HunterRoam::recordPulse(uint32_t nominal, int32_t actual) {
+	static const int32_t edges[] = HUNTER_HISTOGRAM_EDGES;
+
+	HunterPulseClass pulse = HUNTER_PULSE_LONG;
+	if (nominal == START_INTERVAL) {
+		pulse = HUNTER_PULSE_START;
+	} else if (nominal == SHORT_INTERVAL) {
+		pulse = HUNTER_PULSE_SHORT;
+	}
+
+	HunterPulseStats &stats = _stats.pulses[pulse];
+	if (stats.count == 0 || actual < stats.minUs) {
+		stats.minUs = actual;
+	}
+	if (stats.count == 0 || actual > stats.maxUs) {
+		stats.maxUs = actual;
+	}
+	stats.sumUs += actual;
+	stats.count++;
+
+	int32_t deviation = actual - (int32_t)nominal;
+	size_t bucket = 0;
+	while (bucket < HUNTER_HISTOGRAM_BUCKETS - 1 && deviation >= edges[bucket]) {
+		bucket++;
+	}
+	stats.histogram[bucket]++;
+}
+
+/**
+ * Start a zone
+ * 
+ * @param zone zone number (1-48)
+ * @param time time in minutes (0-240)
+ */
+byte HunterRoam::startZone(byte zone, byte time) {
+	if (!hunterValidZone(zone)) {
+		return 1;
+	}
+
+	if (!hunterValidTime(time)) {
+		return 2;
+	}
+
+	// The bus protocol is a little bizzare, see HunterFrame.h for the layout
+	HunterZoneFrame buffer = hunterZoneFrame(zone, time);
 
 	// Write the bits out of the bus
-	writeBus(buffer, true);
+	writeBus(buffer.data(), buffer.size(), true);
 
 	return 0;
 }
@@ -205,16 +524,12 @@ byte HunterRoam::stopZone(byte zone) {
  * @param num - program number (1-4)
  */
 byte HunterRoam::startProgram(byte num) {
-	// Start with a basic program frame
-	std::vector<byte> buffer = {0xff, 0x40, 0x03, 0x96, 0x09 ,0xbd ,0x7f};
-
-	if (num < 1 || num > 4) {
+	if (!hunterValidProgram(num)) {
 		return 3;
 	}
 
-	// Program number - 1 is at bits 31:32
-	hunterBitfield(buffer, 31, num - 1, 2);
-	writeBus(buffer, false);
+	HunterProgramFrame buffer = hunterProgramFrame(num);
+	writeBus(buffer.data(), buffer.size(), false);
 
 	return 0;
 }
\ No newline at end of file
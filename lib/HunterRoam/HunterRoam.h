@@ -3,29 +3,137 @@
 #ifndef HunterRoam_h
 #define HunterRoam_h
 
-#include <vector>
-#include <Arduino.h>
+#include "Hal.h"
+#include "HunterFrame.h"
+
+// The RMT backend needs ESP-IDF, host builds always bit-bang through the HAL
+#ifdef ESP_PLATFORM
+#define HUNTER_HAS_RMT 1
+#include "driver/rmt_tx.h"
+#else
+#define HUNTER_HAS_RMT 0
+#endif
 
 #define START_INTERVAL 900
 #define SHORT_INTERVAL 208
 #define LONG_INTERVAL 1875
+#define RESET_INTERVAL 325000
+#define RESET_GAP_INTERVAL 65000
 
 #define HUNTER_PIN 16 // D0
 
+// Timeout for HunterRoam::waitIdle that never expires
+#define HUNTER_WAIT_FOREVER 0xffffffff
+
+// Longest frame: reset, gap, start pulse, zone frame, extra bit and stop bit
+#define HUNTER_MAX_PULSES (4 + 2 * (HUNTER_ZONE_FRAME_LEN * 8 + 2))
+
+// RMT runs at 1 tick per microsecond and a half-symbol holds at most 32767 ticks,
+// so the reset (10 halves) and gap (2 halves) pulses are split across symbols
+#define HUNTER_RMT_RESOLUTION_HZ 1000000
+#define HUNTER_RMT_MAX_DURATION 32767
+#define HUNTER_RMT_MAX_SYMBOLS ((HUNTER_MAX_PULSES + 10 + 1) / 2)
+
+// Transmitter backends
+enum HunterTxMode {
+    HUNTER_TX_BITBANG,  // digitalWrite + delayMicroseconds, blocks for the whole frame
+    HUNTER_TX_RMT       // clocked out by the RMT peripheral, returns as soon as it is queued
+};
+
+// Measured edge jitter of the start and data pulses for one backend
+struct HunterJitter {
+    uint32_t frames;     // frames measured
+    uint32_t dropped;    // frames where not every edge was captured
+    uint32_t pulses;     // pulses measured across all frames
+    uint32_t maxUs;      // worst absolute deviation from nominal
+    uint32_t lastMaxUs;  // worst absolute deviation in the most recent frame
+    uint64_t sumUs;      // sum of absolute deviations, mean = sumUs / pulses
+};
+
+// Pulse classes timed by writeBus
+enum HunterPulseClass {
+    HUNTER_PULSE_START,
+    HUNTER_PULSE_SHORT,
+    HUNTER_PULSE_LONG,
+    HUNTER_PULSE_CLASSES
+};
+
+// Histogram of signed deviation from nominal, bucket edges in microseconds:
+// < -100, -100..-20, -20..-5, -5..5, 5..20, 20..100, >= 100
+#define HUNTER_HISTOGRAM_BUCKETS 7
+#define HUNTER_HISTOGRAM_EDGES { -100, -20, -5, 5, 20, 100 }
+
+// Measured widths of one pulse class
+struct HunterPulseStats {
+    uint32_t count;
+    int32_t minUs;
+    int32_t maxUs;
+    int64_t sumUs;       // mean = sumUs / count
+    uint32_t histogram[HUNTER_HISTOGRAM_BUCKETS];
+};
+
+// Per frame timing of every start and data pulse since boot
+struct HunterBusStats {
+    uint32_t frames;
+    HunterPulseStats pulses[HUNTER_PULSE_CLASSES];
+};
+
+// Called once a frame has left the pin. Runs in ISR context for HUNTER_TX_RMT.
+typedef void (*HunterTxCallback)(void *arg);
+
 class HunterRoam {
     public:
-        HunterRoam(int pin);
+        HunterRoam(int pin, HunterTxMode mode = HUNTER_TX_BITBANG);
         byte stopZone(byte zone);
         byte startZone(byte zone, byte time);
         byte startProgram(byte num);
         String errorHint(byte error);
-    
+
+        void setTxMode(HunterTxMode mode);
+        HunterTxMode getTxMode() { return _mode; }
+        void onComplete(HunterTxCallback callback, void *arg);
+        bool isBusy();
+        bool waitIdle(uint32_t timeoutMs);
+        HunterJitter getJitter(HunterTxMode mode);
+        HunterBusStats getStats();
+        static uint32_t nominalWidth(HunterPulseClass pulse);
+
     private:
         int _pin;
-        void hunterBitfield(std::vector <byte> &bits, byte pos, byte val, byte len);
-        void writeBus(std::vector<byte> buffer, bool extrabit);
-        void sendLow(void);
-        void sendHigh(void);
+        HunterTxMode _mode;
+        HunterTxCallback _callback;
+        void *_callbackArg;
+
+        // Nominal pulse widths of the frame being sent, alternating HIGH/LOW
+        uint32_t _pulses[HUNTER_MAX_PULSES];
+        size_t _pulseCount;
+
+        // Edge timestamps (low 32 bits of esp_timer_get_time) of the frame being sent
+        volatile uint32_t _edges[HUNTER_MAX_PULSES];
+        volatile size_t _edgeCount;
+        volatile bool _busy;
+        bool _pendingJitter;
+        HunterJitter _jitter[2];
+        HunterBusStats _stats;
+
+#if HUNTER_HAS_RMT
+        rmt_channel_handle_t _rmtChannel;
+        rmt_encoder_handle_t _rmtEncoder;
+        rmt_symbol_word_t _symbols[HUNTER_RMT_MAX_SYMBOLS];
+#endif
+
+        void writeBus(const byte *buffer, size_t len, bool extrabit);
+        size_t encodePulses(const byte *buffer, size_t len, bool extrabit);
+        void writeBitBang(void);
+        bool writeRmt(void);
+        bool beginRmt(void);
+        void endRmt(void);
+        void recordJitter(void);
+        void recordPulse(uint32_t nominal, int32_t actual);
+#if HUNTER_HAS_RMT
+        static void IRAM_ATTR edgeIsr(void *arg);
+        static bool IRAM_ATTR rmtDoneIsr(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event, void *arg);
+#endif
 };
 
 #endif
\ No newline at end of file
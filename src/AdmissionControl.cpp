@@ -0,0 +1,130 @@
+#include "AdmissionControl.h"
+#include <string.h>
+
+AdmissionControl::AdmissionControl() {
+    memset(_clients, 0, sizeof(_clients));
+    _bus.milli = ADMISSION_BUS_BURST * 1000;
+    _bus.updatedMs = 0;
+    _bus.carry = 0;
+}
+
+void AdmissionControl::refill(Bucket& bucket, uint32_t burst, uint32_t refillMs, uint32_t nowMs) {
+    uint32_t elapsed = nowMs - bucket.updatedMs;
+    int32_t full = burst * 1000;
+
+    // Capped so a long idle spell cannot overflow
+    if (elapsed >= burst * refillMs * 2) {
+        bucket.milli = full;
+        bucket.carry = 0;
+    } else {
+        uint32_t credit = elapsed * 1000 + bucket.carry;
+        bucket.milli += credit / refillMs;
+        bucket.carry = credit % refillMs;
+        if (bucket.milli >= full) {
+            bucket.milli = full;
+            bucket.carry = 0;
+        }
+    }
+    bucket.updatedMs = nowMs;
+}
+
+uint32_t AdmissionControl::waitMs(const Bucket& bucket, int32_t needMilli, uint32_t refillMs) {
+    if (bucket.milli >= needMilli) {
+        return 0;
+    }
+    return (uint32_t)(needMilli - bucket.milli) * refillMs / 1000;
+}
+
+AdmissionControl::Client& AdmissionControl::client(uint32_t ip, uint32_t nowMs) {
+    Client* oldest = &_clients[0];
+    for (int i = 0; i < ADMISSION_CLIENTS; i++) {
+        Client& c = _clients[i];
+        if (c.used && c.ip == ip) {
+            return c;
+        }
+        if (!c.used) {
+            oldest = &c;
+            break;
+        }
+        if (nowMs - c.bucket.updatedMs > nowMs - oldest->bucket.updatedMs) {
+            oldest = &c;
+        }
+    }
+
+    // A forgotten client starts over with a full bucket
+    oldest->used = true;
+    oldest->ip = ip;
+    oldest->bucket.milli = ADMISSION_CLIENT_BURST * 1000;
+    oldest->bucket.updatedMs = nowMs;
+    oldest->bucket.carry = 0;
+    return *oldest;
+}
+
+AdmissionDecision AdmissionControl::admit(uint32_t ip, AdmissionClass type, uint32_t nowMs) {
+    AdmissionDecision decision = { true, 0 };
+    if (type == ADMIT_ANY) {
+        return decision;
+    }
+
+    Client& c = client(ip, nowMs);
+    refill(c.bucket, ADMISSION_CLIENT_BURST, ADMISSION_CLIENT_REFILL_MS, nowMs);
+    refill(_bus, ADMISSION_BUS_BURST, ADMISSION_BUS_REFILL_MS, nowMs);
+
+    // Commands must leave the reserve untouched, stops may spend it
+    bool stop = type == ADMIT_STOP;
+    int32_t clientNeed = 1000 + (stop ? 0 : ADMISSION_CLIENT_STOP_RESERVE * 1000);
+    int32_t busNeed = 1000 + (stop ? 0 : ADMISSION_BUS_STOP_RESERVE * 1000);
+
+    uint32_t clientWait = waitMs(c.bucket, clientNeed, ADMISSION_CLIENT_REFILL_MS);
+    uint32_t busWait = waitMs(_bus, busNeed, ADMISSION_BUS_REFILL_MS);
+    if (clientWait > 0 || busWait > 0) {
+        uint32_t wait = clientWait > busWait ? clientWait : busWait;
+        decision.admitted = false;
+        decision.retryAfterS = (wait + 999) / 1000;
+        return decision;
+    }
+
+    c.bucket.milli -= 1000;
+    _bus.milli -= 1000;
+    return decision;
+}
+
+AdmissionDecision AdmissionControl::promote(uint32_t ip, uint32_t nowMs) {
+    AdmissionDecision decision = { true, 0 };
+    Client& c = client(ip, nowMs);
+    refill(c.bucket, ADMISSION_CLIENT_BURST, ADMISSION_CLIENT_REFILL_MS, nowMs);
+    refill(_bus, ADMISSION_BUS_BURST, ADMISSION_BUS_REFILL_MS, nowMs);
+
+    // The token is already taken, what is left must cover the reserve
+    uint32_t clientWait = waitMs(c.bucket, ADMISSION_CLIENT_STOP_RESERVE * 1000, ADMISSION_CLIENT_REFILL_MS);
+    uint32_t busWait = waitMs(_bus, ADMISSION_BUS_STOP_RESERVE * 1000, ADMISSION_BUS_REFILL_MS);
+    if (clientWait > 0 || busWait > 0) {
+        uint32_t wait = clientWait > busWait ? clientWait : busWait;
+        decision.admitted = false;
+        decision.retryAfterS = (wait + 999) / 1000;
+        c.bucket.milli += 1000;
+        _bus.milli += 1000;
+    }
+    return decision;
+}
+
+// Take tokens, but never below the reserve, or below the level already reached
+static int32_t chargeAbove(int32_t milli, uint32_t tokens, int32_t reserveMilli) {
+    int32_t floor = milli < reserveMilli ? milli : reserveMilli;
+    milli -= tokens * 1000;
+    return milli < floor ? floor : milli;
+}
+
+void AdmissionControl::charge(uint32_t ip, uint32_t tokens, uint32_t nowMs) {
+    if (tokens == 0) {
+        return;
+    }
+    Client& c = client(ip, nowMs);
+    refill(c.bucket, ADMISSION_CLIENT_BURST, ADMISSION_CLIENT_REFILL_MS, nowMs);
+    refill(_bus, ADMISSION_BUS_BURST, ADMISSION_BUS_REFILL_MS, nowMs);
+
+    // Further commands wait for the refill, stops from this client and
+    // everyone else still pass
+    c.bucket.milli = chargeAbove(c.bucket.milli, tokens, ADMISSION_CLIENT_STOP_RESERVE * 1000);
+    _bus.milli = chargeAbove(_bus.milli, tokens, ADMISSION_BUS_STOP_RESERVE * 1000);
+}
@@ -0,0 +1,694 @@
+#include "ApiRequests.h"
+#include <stdio.h>
+#include <string.h>
+
+static const ApiResult API_OK = { 200, NULL, NULL };
+
+static ApiResult apiError(const char* error, const char* detail = NULL) {
+    ApiResult result = { 400, error, detail };
+    return result;
+}
+
+// Parse a request body keeping only the named top-level fields, so a small
+// stack document is enough whatever else the client sends
+static DeserializationError parseFields(JsonDocument& doc, const char* body, size_t len,
+                                        const char* const* fields, size_t count) {
+    StaticJsonDocument<128> filter;
+    for (size_t i = 0; i < count; i++) {
+        filter[fields[i]] = true;
+    }
+    return deserializeJson(doc, body, len, DeserializationOption::Filter(filter));
+}
+
+// Optional idempotency_key field, left empty when absent
+static bool parseIdempotencyKey(JsonVariantConst value, char* key) {
+    key[0] = '\0';
+    if (value.isNull()) {
+        return true;
+    }
+    const char* text = value.as<const char*>();
+    return text != NULL && copyIdempotencyKey(text, strlen(text), key);
+}
+
+// Optional controller field, defaults to the built-in controller 0
+static bool parseController(JsonVariantConst value, int& controller) {
+    controller = value.isNull() ? 0 : value.as<int>();
+    return controller >= 0 && controller < CONTROLLER_MAX;
+}
+
+bool copyIdempotencyKey(const char* text, size_t len, char* key) {
+    if (len == 0 || len > API_IDEMPOTENCY_KEY_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] < 0x21 || text[i] > 0x7e) {
+            return false;
+        }
+    }
+    memcpy(key, text, len);
+    key[len] = '\0';
+    return true;
+}
+
+ApiResult parseStartRequest(const char* body, size_t len, StartRequest& request) {
+    static const char* const fields[] = { "zone", "minutes", "controller", "idempotency_key" };
+    StaticJsonDocument<API_REQUEST_CAPACITY> doc;
+    DeserializationError error = parseFields(doc, body, len, fields, 4);
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    // Validate required parameters
+    if (!doc.containsKey("zone") || !doc.containsKey("minutes")) {
+        return apiError("Missing required parameters");
+    }
+
+    request.zone = doc["zone"].as<int>();
+    request.minutes = doc["minutes"].as<int>();
+
+    if (!parseController(doc["controller"], request.controller)) {
+        return apiError("Controller must be between 0 and 3");
+    }
+
+    // Validate zone is within valid range (1-20)
+    if (request.zone < API_MIN_ZONE || request.zone > API_MAX_ZONE) {
+        return apiError("Zone must be between 1 and 20");
+    }
+
+    // Validate minutes is within valid range (0-120)
+    // Allow 0 minutes for testing stop functionality (HunterRoam::stopZone uses 0 minutes)
+    if (request.minutes < 0 || request.minutes > API_MAX_MINUTES) {
+        return apiError("Minutes must be between 0 and 120");
+    }
+
+    if (!parseIdempotencyKey(doc["idempotency_key"], request.idempotencyKey)) {
+        return apiError("Idempotency key must be 1 to 64 printable characters");
+    }
+
+    return API_OK;
+}
+
+ApiResult parseStopRequest(const char* body, size_t len, StopRequest& request) {
+    static const char* const fields[] = { "zone", "controller", "idempotency_key" };
+    StaticJsonDocument<API_REQUEST_CAPACITY> doc;
+    DeserializationError error = parseFields(doc, body, len, fields, 3);
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    // Validate required parameters
+    if (!doc.containsKey("zone")) {
+        return apiError("Missing required parameter: zone");
+    }
+
+    request.zone = doc["zone"].as<int>();
+
+    if (!parseController(doc["controller"], request.controller)) {
+        return apiError("Controller must be between 0 and 3");
+    }
+
+    // Validate zone is within valid range (1-20)
+    if (request.zone < API_MIN_ZONE || request.zone > API_MAX_ZONE) {
+        return apiError("Zone must be between 1 and 20");
+    }
+
+    if (!parseIdempotencyKey(doc["idempotency_key"], request.idempotencyKey)) {
+        return apiError("Idempotency key must be 1 to 64 printable characters");
+    }
+
+    return API_OK;
+}
+
+ApiResult parseControllerRequest(const char* body, size_t len, ControllerRequest& request) {
+    static const char* const fields[] = { "pin" };
+    StaticJsonDocument<API_REQUEST_CAPACITY> doc;
+    DeserializationError error = parseFields(doc, body, len, fields, 1);
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    // The registry checks the pin is usable
+    if (!doc.containsKey("pin")) {
+        return apiError("Missing required parameter: pin");
+    }
+
+    request.pin = doc["pin"].as<int>();
+    return API_OK;
+}
+
+ApiResult parseSequenceRequest(const char* body, size_t len, SequenceStep* steps, uint8_t& count) {
+    StaticJsonDocument<128> filter;
+    filter["steps"][0]["zone"] = true;
+    filter["steps"][0]["minutes"] = true;
+
+    // Too big for the stack. Only the AsyncTCP task parses requests, so one
+    // document is enough.
+    static StaticJsonDocument<API_SEQUENCE_CAPACITY> doc;
+    DeserializationError error = deserializeJson(doc, body, len, DeserializationOption::Filter(filter));
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    JsonArray list = doc["steps"].as<JsonArray>();
+    if (list.isNull() || list.size() == 0) {
+        return apiError("Missing required parameter: steps");
+    }
+
+    if (list.size() > SEQUENCE_MAX_STEPS) {
+        return apiError("Too many steps");
+    }
+
+    // Validate every step before the caller touches the bus
+    count = 0;
+    for (JsonObject step : list) {
+        if (!step.containsKey("zone") || !step.containsKey("minutes")) {
+            return apiError("Each step needs zone and minutes");
+        }
+
+        int zone = step["zone"].as<int>();
+        int minutes = step["minutes"].as<int>();
+
+        if (zone < API_MIN_ZONE || zone > API_MAX_ZONE) {
+            return apiError("Zone must be between 1 and 20");
+        }
+
+        if (minutes < 1 || minutes > API_MAX_MINUTES) {
+            return apiError("Minutes must be between 1 and 120");
+        }
+
+        steps[count].zone = zone;
+        steps[count].minutes = minutes;
+        count++;
+    }
+
+    return API_OK;
+}
+
+static const char* const dayNames[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+const char* scheduleDayName(uint8_t day) {
+    return day < 7 ? dayNames[day] : "";
+}
+
+// "HH:MM", 24 hour clock
+static bool parseStartTime(const char* text, uint16_t& minute) {
+    if (text == NULL || strlen(text) != 5 || text[2] != ':') {
+        return false;
+    }
+    for (int i = 0; i < 5; i++) {
+        if (i != 2 && (text[i] < '0' || text[i] > '9')) {
+            return false;
+        }
+    }
+    int hours = (text[0] - '0') * 10 + (text[1] - '0');
+    int minutes = (text[3] - '0') * 10 + (text[4] - '0');
+    if (hours > 23 || minutes > 59) {
+        return false;
+    }
+    minute = hours * 60 + minutes;
+    return true;
+}
+
+ApiResult parseScheduleRequest(const char* body, size_t len, Schedule& schedule) {
+    StaticJsonDocument<192> filter;
+    filter["name"] = true;
+    filter["enabled"] = true;
+    filter["days"] = true;
+    filter["start"] = true;
+    filter["steps"][0]["zone"] = true;
+    filter["steps"][0]["minutes"] = true;
+
+    // Only the AsyncTCP task parses requests, so one document is enough
+    static StaticJsonDocument<API_SCHEDULE_CAPACITY> doc;
+    DeserializationError error = deserializeJson(doc, body, len, DeserializationOption::Filter(filter));
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    memset(&schedule, 0, sizeof(schedule));
+    schedule.used = true;
+    schedule.enabled = doc["enabled"] | true;
+
+    const char* name = doc["name"] | "";
+    if (strlen(name) > SCHEDULE_NAME_MAX) {
+        return apiError("Name must be at most 23 characters");
+    }
+    strcpy(schedule.name, name);
+
+    if (!parseStartTime(doc["start"].as<const char*>(), schedule.startMinute)) {
+        return apiError("Start must be a time of day as HH:MM");
+    }
+
+    JsonArray days = doc["days"].as<JsonArray>();
+    if (days.isNull() || days.size() == 0) {
+        return apiError("Missing required parameter: days");
+    }
+    for (JsonVariant day : days) {
+        const char* text = day.as<const char*>();
+        uint8_t d = 0;
+        while (d < 7 && (text == NULL || strcmp(text, dayNames[d]) != 0)) {
+            d++;
+        }
+        if (d == 7) {
+            return apiError("Days must be sun, mon, tue, wed, thu, fri or sat");
+        }
+        schedule.days |= 1 << d;
+    }
+
+    JsonArray list = doc["steps"].as<JsonArray>();
+    if (list.isNull() || list.size() == 0) {
+        return apiError("Missing required parameter: steps");
+    }
+    if (list.size() > SCHEDULE_MAX_STEPS) {
+        return apiError("Too many steps");
+    }
+    for (JsonObject step : list) {
+        if (!step.containsKey("zone") || !step.containsKey("minutes")) {
+            return apiError("Each step needs zone and minutes");
+        }
+
+        int zone = step["zone"].as<int>();
+        int minutes = step["minutes"].as<int>();
+
+        if (zone < API_MIN_ZONE || zone > API_MAX_ZONE) {
+            return apiError("Zone must be between 1 and 20");
+        }
+
+        if (minutes < 1 || minutes > API_MAX_MINUTES) {
+            return apiError("Minutes must be between 1 and 120");
+        }
+
+        schedule.steps[schedule.count].zone = zone;
+        schedule.steps[schedule.count].minutes = minutes;
+        schedule.count++;
+    }
+
+    return API_OK;
+}
+
+ApiResult parseTimeRequest(const char* body, size_t len, TimeRequest& request) {
+    static const char* const fields[] = { "epoch", "tz" };
+    StaticJsonDocument<API_REQUEST_CAPACITY> doc;
+    DeserializationError error = parseFields(doc, body, len, fields, 2);
+
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    if (!doc.containsKey("epoch") && !doc.containsKey("tz")) {
+        return apiError("Missing required parameter: epoch or tz");
+    }
+
+    request.epoch = 0;
+    if (doc.containsKey("epoch")) {
+        request.epoch = doc["epoch"].as<uint32_t>();
+        if (request.epoch < SCHEDULE_MIN_EPOCH) {
+            return apiError("Epoch must be seconds since 1970, after 2024");
+        }
+    }
+
+    request.tz[0] = '\0';
+    if (doc.containsKey("tz")) {
+        const char* tz = doc["tz"].as<const char*>();
+        if (tz == NULL || tz[0] == '\0' || strlen(tz) > SCHEDULE_TZ_MAX) {
+            return apiError("Time zone must be a POSIX TZ string of at most 47 characters");
+        }
+        strcpy(request.tz, tz);
+    }
+
+    return API_OK;
+}
+
+// Read one batch command into command. Returns the validation error, or NULL if it is valid.
+static const char* parseBatchCommand(JsonObjectConst item, BusCommand& command) {
+    const char* type = item["command"];
+    if (type == NULL) {
+        return "Missing required parameter: command";
+    }
+
+    command.id = 0;
+    command.minutes = 0;
+    command.source = BUS_SOURCE_BATCH;
+    if (strcmp(type, "program") == 0) {
+        if (!item.containsKey("program")) {
+            return "Missing required parameter: program";
+        }
+        int program = item["program"].as<int>();
+        if (!hunterValidProgram(program)) {
+            return "Program must be between 1 and 4";
+        }
+        command.type = BUS_CMD_PROGRAM;
+        command.zone = program;
+        return NULL;
+    }
+
+    if (strcmp(type, "start") == 0) {
+        command.type = BUS_CMD_START;
+    } else if (strcmp(type, "stop") == 0) {
+        command.type = BUS_CMD_STOP;
+    } else {
+        return "Command must be start, stop or program";
+    }
+
+    if (!item.containsKey("zone")) {
+        return "Missing required parameter: zone";
+    }
+    int zone = item["zone"].as<int>();
+    if (zone < API_MIN_ZONE || zone > API_MAX_ZONE) {
+        return "Zone must be between 1 and 20";
+    }
+    command.zone = zone;
+
+    if (command.type == BUS_CMD_START) {
+        if (!item.containsKey("minutes")) {
+            return "Missing required parameter: minutes";
+        }
+        int minutes = item["minutes"].as<int>();
+        if (minutes < 0 || minutes > API_MAX_MINUTES) {
+            return "Minutes must be between 0 and 120";
+        }
+        command.minutes = minutes;
+    }
+    return NULL;
+}
+
+ApiResult parseBatchRequest(const char* body, size_t len, BatchRequest& request) {
+    StaticJsonDocument<256> filter;
+    filter["controller"] = true;
+    filter["commands"][0]["command"] = true;
+    filter["commands"][0]["zone"] = true;
+    filter["commands"][0]["minutes"] = true;
+    filter["commands"][0]["program"] = true;
+
+    // Too big for the stack, and only the AsyncTCP task parses requests
+    static StaticJsonDocument<API_BATCH_CAPACITY> doc;
+    DeserializationError error = deserializeJson(doc, body, len, DeserializationOption::Filter(filter));
+
+    request.count = 0;
+    request.failed = -1;
+    if (error) {
+        return apiError("Invalid JSON: ", error.c_str());
+    }
+
+    if (!parseController(doc["controller"], request.controller)) {
+        return apiError("Controller must be between 0 and 3");
+    }
+
+    JsonArrayConst list = doc["commands"].as<JsonArrayConst>();
+    if (list.isNull() || list.size() == 0) {
+        return apiError("Missing required parameter: commands");
+    }
+
+    if (list.size() > BATCH_MAX_COMMANDS) {
+        return apiError("Too many commands");
+    }
+
+    // Validate every command before any of them reaches the bus
+    for (JsonObjectConst item : list) {
+        const char* invalid = parseBatchCommand(item, request.commands[request.count]);
+        if (invalid != NULL) {
+            request.failed = request.count;
+            return apiError(invalid);
+        }
+        request.count++;
+    }
+
+    return API_OK;
+}
+
+size_t writeErrorResponse(char* out, size_t size, const ApiResult& result) {
+    // Messages are static and never need escaping
+    int written = snprintf(out, size, "{\"error\":\"%s%s\"}",
+                           result.error ? result.error : "", result.detail ? result.detail : "");
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+size_t writeAcceptedResponse(char* out, size_t size, uint32_t id, int controller, int zone, int minutes) {
+    // Numbers only, no escaping needed
+    int written;
+    if (minutes >= 0) {
+        written = snprintf(out, size, "{\"status\":\"accepted\",\"id\":%u,\"controller\":%d,\"zone\":%d,\"minutes\":%d}",
+                           (unsigned)id, controller, zone, minutes);
+    } else {
+        written = snprintf(out, size, "{\"status\":\"accepted\",\"id\":%u,\"controller\":%d,\"zone\":%d}",
+                           (unsigned)id, controller, zone);
+    }
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+size_t writeBatchErrorResponse(char* out, size_t size, const ApiResult& result, int index) {
+    if (index < 0) {
+        return writeErrorResponse(out, size, result);
+    }
+    int written = snprintf(out, size, "{\"error\":\"%s%s\",\"index\":%d}",
+                           result.error ? result.error : "", result.detail ? result.detail : "", index);
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+size_t writeBatchResponse(char* out, size_t size, const BatchRequest& batch, const uint32_t* ids, const char* const* states) {
+    static const char* const types[] = { "start", "stop", "program" };
+
+    int written = snprintf(out, size, "{\"status\":\"accepted\",\"controller\":%d,\"commands\":[", batch.controller);
+    if (written < 0 || (size_t)written >= size) {
+        return 0;
+    }
+    size_t pos = written;
+
+    for (uint8_t i = 0; i < batch.count; i++) {
+        const BusCommand& command = batch.commands[i];
+        written = snprintf(out + pos, size - pos, "%s{\"id\":%u,\"status\":\"%s\",\"command\":\"%s\",\"%s\":%u}",
+                           i > 0 ? "," : "", (unsigned)ids[i], states[i], types[command.type],
+                           command.type == BUS_CMD_PROGRAM ? "program" : "zone", command.zone);
+        if (written < 0 || (size_t)written >= size - pos) {
+            return 0;
+        }
+        pos += written;
+    }
+
+    if (pos + 3 > size) {
+        return 0;
+    }
+    out[pos++] = ']';
+    out[pos++] = '}';
+    out[pos] = '\0';
+    return pos;
+}
+
+static void addJitter(JsonObject bus, const char* name, const HunterJitter& jitter) {
+    JsonObject j = bus.createNestedObject(name);
+    j["frames"] = jitter.frames;
+    j["dropped"] = jitter.dropped;
+    j["max_us"] = jitter.maxUs;
+    j["last_max_us"] = jitter.lastMaxUs;
+    j["mean_us"] = jitter.pulses ? (float)jitter.sumUs / jitter.pulses : 0;
+}
+
+static JsonObject addInterface(JsonObject interfaces, const char* name, const StatusInterface& link) {
+    JsonObject i = interfaces.createNestedObject(name);
+    i["state"] = link.state;
+    i["ip"] = (const char*)link.ip;
+    i["up_ms"] = link.upMs;
+    i["down_ms"] = link.downMs;
+    i["reconnects"] = link.reconnects;
+    i["failed_attempts"] = link.attempts;
+    return i;
+}
+
+size_t writeStatusResponse(char* out, size_t size, const StatusInfo& status) {
+    StaticJsonDocument<API_STATUS_CAPACITY> doc;
+
+    // Basic status
+    doc["status"] = "ok";
+    doc["uptime_ms"] = status.uptimeMs;
+
+    // ESP Chip Information
+    JsonObject chip = doc.createNestedObject("chip");
+    chip["model"] = status.chipModel;
+    chip["revision"] = status.chipRevision;
+    chip["cores"] = status.chipCores;
+
+    doc["idf_version"] = (const char*)status.idfVersion;
+    doc["reset_reason"] = status.resetReason;
+
+    // Memory Information
+    JsonObject memory = doc.createNestedObject("memory");
+    memory["free_heap"] = status.freeHeap;
+    memory["min_free_heap"] = status.minFreeHeap;
+    memory["largest_free_block"] = status.largestFreeBlock;
+    memory["alloc_failures"] = status.allocFailures;
+
+    // Network Status
+    const StatusNetwork& net = status.network;
+    JsonObject network = doc.createNestedObject("network");
+    network["connected"] = net.connected;
+    network["type"] = net.type;
+    network["state"] = net.state;
+    network["up_ms"] = net.upMs;
+    network["down_ms"] = net.downMs;
+    network["failed_attempts"] = net.attempts;
+    network["ip"] = (const char*)net.ip;
+
+    // Additional information based on network type
+    if (strcmp(net.type, "WiFi") == 0) {
+        network["ssid"] = (const char*)net.ssid;
+        network["rssi"] = net.rssi;
+        network["gateway"] = (const char*)net.gateway;
+        network["subnet"] = (const char*)net.subnet;
+        network["dns"] = (const char*)net.dns;
+    } else if (strcmp(net.type, "Ethernet") == 0) {
+        char speed[16];
+        snprintf(speed, sizeof(speed), "%u Mbps", net.linkSpeed);
+        network["mac"] = (const char*)net.mac;
+        network["gateway"] = (const char*)net.gateway;
+        network["subnet"] = (const char*)net.subnet;
+        network["speed"] = (char*)speed;
+        network["duplex"] = net.fullDuplex ? "Full" : "Half";
+    }
+
+    // Every interface the mode brings up, whichever one carries traffic
+    JsonObject interfaces = network.createNestedObject("interfaces");
+    if (net.ethernet.enabled) {
+        JsonObject eth = addInterface(interfaces, "ethernet", net.ethernet);
+        if (strcmp(net.ethernet.state, "up") == 0) {
+            eth["speed_mbps"] = net.ethernet.linkSpeed;
+            eth["duplex"] = net.ethernet.fullDuplex ? "Full" : "Half";
+        }
+    }
+    if (net.wifi.enabled) {
+        JsonObject wifi = addInterface(interfaces, "wifi", net.wifi);
+        if (strcmp(net.wifi.state, "up") == 0) {
+            wifi["rssi"] = net.wifi.rssi;
+        }
+    }
+    network["failovers"] = net.failovers;
+    network["failbacks"] = net.failbacks;
+
+    // SmartPort bus transmitter and measured edge jitter per backend
+    JsonObject bus = doc.createNestedObject("bus");
+    bus["controllers"] = status.busControllers;
+    bus["queue_depth"] = status.busQueueDepth;
+    bus["tx_mode"] = status.busTxMode == HUNTER_TX_RMT ? "rmt" : "bitbang";
+    addJitter(bus, "rmt_jitter", status.rmtJitter);
+    addJitter(bus, "bitbang_jitter", status.bitbangJitter);
+
+    // Task Information
+    JsonObject task = doc.createNestedObject("task");
+    task["stack_hwm"] = status.stackHwm;
+
+    // Uptime in ms at each boot milestone reached so far
+    JsonObject boot = doc.createNestedObject("boot");
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+        if (status.bootMs[i] != 0) {
+            boot[bootMilestoneName((BootMilestone)i)] = status.bootMs[i];
+        }
+    }
+
+    if (measureJson(doc) >= size) {
+        return 0;
+    }
+    return serializeJson(doc, out, size);
+}
+
+// Append the fields of one zone to out at pos. Returns the new length, or 0 if it does not fit.
+static size_t appendZoneFields(char* out, size_t size, size_t pos, int zone, const ZoneState& state, uint32_t nowMs) {
+    int written = snprintf(out + pos, size - pos, "\"zone\":%d,\"active\":%s", zone, state.active ? "true" : "false");
+    if (written < 0 || (size_t)written >= size - pos) {
+        return 0;
+    }
+    pos += written;
+
+    if (state.active) {
+        // An entry past its end is only waiting for the expiry timer
+        uint32_t remainingMs = (int32_t)(state.endMs - nowMs) > 0 ? state.endMs - nowMs : 0;
+        written = snprintf(out + pos, size - pos, ",\"started_ms\":%u,\"ends_ms\":%u,\"remaining_s\":%u",
+                           (unsigned)state.startMs, (unsigned)state.endMs, (unsigned)(remainingMs / 1000));
+        if (written < 0 || (size_t)written >= size - pos) {
+            return 0;
+        }
+        pos += written;
+    }
+
+    if (state.lastId != 0) {
+        written = snprintf(out + pos, size - pos, ",\"last_id\":%u,\"last_command\":\"%s\",\"last_result\":%u",
+                           (unsigned)state.lastId, state.lastCommand, state.lastResult);
+        if (written < 0 || (size_t)written >= size - pos) {
+            return 0;
+        }
+        pos += written;
+    }
+    return pos;
+}
+
+size_t writeZoneResponse(char* out, size_t size, int controller, int zone, const ZoneState& state, uint32_t nowMs) {
+    int written = snprintf(out, size, "{\"uptime_ms\":%u,\"controller\":%d,", (unsigned)nowMs, controller);
+    if (written < 0 || (size_t)written >= size) {
+        return 0;
+    }
+    size_t pos = appendZoneFields(out, size, written, zone, state, nowMs);
+    if (pos == 0 || pos + 2 > size) {
+        return 0;
+    }
+    out[pos++] = '}';
+    out[pos] = '\0';
+    return pos;
+}
+
+size_t writeZonesResponse(char* out, size_t size, int controller, const ZoneState* zones, uint32_t nowMs) {
+    int written = snprintf(out, size, "{\"uptime_ms\":%u,\"controller\":%d,\"zones\":[", (unsigned)nowMs, controller);
+    if (written < 0 || (size_t)written >= size) {
+        return 0;
+    }
+    size_t pos = written;
+
+    for (int zone = API_MIN_ZONE; zone <= API_MAX_ZONE; zone++) {
+        if (pos + 2 > size) {
+            return 0;
+        }
+        if (zone > API_MIN_ZONE) {
+            out[pos++] = ',';
+        }
+        out[pos++] = '{';
+        pos = appendZoneFields(out, size, pos, zone, zones[zone - API_MIN_ZONE], nowMs);
+        if (pos == 0 || pos + 2 > size) {
+            return 0;
+        }
+        out[pos++] = '}';
+    }
+
+    if (pos + 3 > size) {
+        return 0;
+    }
+    out[pos++] = ']';
+    out[pos++] = '}';
+    out[pos] = '\0';
+    return pos;
+}
+
+void writeEtag(char* out, size_t size, const char* body, size_t len) {
+    // FNV-1a, enough to tell snapshots apart
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)body[i];
+        hash *= 16777619u;
+    }
+    snprintf(out, size, "W/\"%08x\"", (unsigned)hash);
+}
+
+bool etagMatches(const char* ifNoneMatch, const char* etag) {
+    if (ifNoneMatch == NULL || etag[0] == '\0') {
+        return false;
+    }
+    if (strcmp(ifNoneMatch, "*") == 0) {
+        return true;
+    }
+
+    // The header may list several tags, with or without the weak prefix.
+    // Comparing the quoted part is enough.
+    const char* tag = strchr(etag, '"');
+    return tag != NULL && strstr(ifNoneMatch, tag) != NULL;
+}
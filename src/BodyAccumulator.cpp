@@ -0,0 +1,113 @@
+#include "BodyAccumulator.h"
+#include <string.h>
+
+BodyAccumulator::BodyAccumulator() {
+    memset(_bodies, 0, sizeof(_bodies));
+    _directOwner = NULL;
+    _direct = NULL;
+    _directLen = 0;
+}
+
+int BodyAccumulator::find(const void* owner) {
+    for (int i = 0; i < BODY_SLOTS; i++) {
+        if (_bodies[i].owner == owner) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+BodyResult BodyAccumulator::append(const void* owner, const uint8_t* data, size_t len, size_t index, size_t total, uint32_t nowMs) {
+    if (owner == NULL) {
+        return BODY_IGNORED;
+    }
+
+    if (index == 0) {
+        // A new request may reuse the address of one that went away mid-body
+        release(owner);
+
+        if (total > BODY_MAX_SIZE) {
+            return BODY_TOO_LARGE;
+        }
+
+        // Common case, the whole body in one segment
+        if (len == total) {
+            _directOwner = owner;
+            _direct = (const char*)data;
+            _directLen = len;
+            return BODY_COMPLETE;
+        }
+
+        int unused = -1;
+        for (int i = 0; i < BODY_SLOTS; i++) {
+            if (_bodies[i].owner == NULL || nowMs - _bodies[i].startedMs >= BODY_TIMEOUT_MS) {
+                unused = i;
+                break;
+            }
+        }
+        if (unused < 0) {
+            return BODY_BUSY;
+        }
+
+        Body& body = _bodies[unused];
+        body.owner = owner;
+        body.received = 0;
+        body.total = total;
+        body.startedMs = nowMs;
+    }
+
+    int slot = find(owner);
+    if (slot < 0) {
+        return BODY_IGNORED;
+    }
+
+    // Chunks arrive in order, anything else means the body is corrupt
+    Body& body = _bodies[slot];
+    if (index != body.received || index + len > body.total) {
+        body.owner = NULL;
+        return BODY_IGNORED;
+    }
+
+    memcpy(_buffers[slot] + index, data, len);
+    body.received += len;
+    return body.received == body.total ? BODY_COMPLETE : BODY_PENDING;
+}
+
+const char* BodyAccumulator::body(const void* owner, size_t& len) {
+    if (owner != NULL && owner == _directOwner) {
+        len = _directLen;
+        return _direct;
+    }
+    int slot = find(owner);
+    if (owner == NULL || slot < 0 || _bodies[slot].received != _bodies[slot].total) {
+        len = 0;
+        return NULL;
+    }
+    len = _bodies[slot].total;
+    return _buffers[slot];
+}
+
+void BodyAccumulator::release(const void* owner) {
+    if (owner == NULL) {
+        return;
+    }
+    if (owner == _directOwner) {
+        _directOwner = NULL;
+        _direct = NULL;
+        _directLen = 0;
+    }
+    int slot = find(owner);
+    if (slot >= 0) {
+        _bodies[slot].owner = NULL;
+    }
+}
+
+size_t BodyAccumulator::inUse() {
+    size_t count = 0;
+    for (int i = 0; i < BODY_SLOTS; i++) {
+        if (_bodies[i].owner != NULL) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,34 @@
+#include "BootTimeline.h"
+#include <atomic>
+#include "Hal.h"
+
+static std::atomic<uint32_t> milestones[BOOT_MILESTONE_COUNT];
+
+static const char* const milestoneNames[BOOT_MILESTONE_COUNT] = {
+    "setup",
+    "network_started",
+    "bus_ready",
+    "scheduler_ready",
+    "link_up",
+    "address",
+    "ready"
+};
+
+void bootMark(BootMilestone milestone) {
+    if (milestone >= BOOT_MILESTONE_COUNT) {
+        return;
+    }
+
+    // 0 means not reached, a milestone in the very first millisecond reads as 1
+    uint32_t now = halMillis();
+    uint32_t unset = 0;
+    milestones[milestone].compare_exchange_strong(unset, now > 0 ? now : 1);
+}
+
+uint32_t bootMilestoneMs(BootMilestone milestone) {
+    return milestone < BOOT_MILESTONE_COUNT ? milestones[milestone].load() : 0;
+}
+
+const char* bootMilestoneName(BootMilestone milestone) {
+    return milestone < BOOT_MILESTONE_COUNT ? milestoneNames[milestone] : "unknown";
+}
@@ -0,0 +1,106 @@
+#include "BusCoalescer.h"
+#include <string.h>
+
+BusCoalescer::BusCoalescer(uint32_t windowMs) {
+    _head = 0;
+    _count = 0;
+    _windowMs = windowMs;
+    memset(_pending, 0, sizeof(_pending));
+    memset(_sent, 0, sizeof(_sent));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+size_t BusCoalescer::key(const BusCommand& command) {
+    // Out of range commands share slot 0 and are never coalesced, they fail on the bus anyway
+    if (command.type == BUS_CMD_PROGRAM) {
+        return hunterValidProgram(command.zone) ? HUNTER_MAX_ZONE + command.zone : 0;
+    }
+    return hunterValidZone(command.zone) ? command.zone : 0;
+}
+
+bool BusCoalescer::sameCommand(const BusCommand& a, const BusCommand& b) {
+    if (a.type != b.type || a.zone != b.zone) {
+        return false;
+    }
+    return a.type != BUS_CMD_START || a.minutes == b.minutes;
+}
+
+void BusCoalescer::moveToTail(uint8_t index, BusCommand command) {
+    // By value, command may be the entry being moved
+    for (uint8_t i = index; i + 1 < _count; i++) {
+        _pending[(_head + i) % BUS_QUEUE_LENGTH] = _pending[(_head + i + 1) % BUS_QUEUE_LENGTH];
+    }
+    _pending[(_head + _count - 1) % BUS_QUEUE_LENGTH] = command;
+}
+
+CoalesceResult BusCoalescer::submit(const BusCommand& command, uint32_t nowMs, uint32_t& existingId) {
+    existingId = 0;
+
+    if (_windowMs > 0 && key(command) != 0) {
+        // A queued command for the same zone has not reached the bus yet
+        for (uint8_t i = 0; i < _count; i++) {
+            BusCommand& queued = _pending[(_head + i) % BUS_QUEUE_LENGTH];
+            if (key(queued) != key(command)) {
+                continue;
+            }
+
+            existingId = queued.id;
+            _stats.framesSaved++;
+
+            // Whatever was queued after it would otherwise go out later and
+            // could undo it, a start of another zone stops this one
+            if (sameCommand(queued, command)) {
+                _stats.duplicates++;
+                moveToTail(i, queued);
+                return COALESCE_DUPLICATE;
+            }
+
+            if (queued.type == BUS_CMD_STOP && command.type == BUS_CMD_START) {
+                _stats.collapsed++;
+            } else {
+                _stats.replaced++;
+            }
+            moveToTail(i, command);
+            return COALESCE_REPLACED;
+        }
+
+        // The same command just went out
+        const SentCommand& sent = _sent[key(command)];
+        if (sent.valid && sameCommand(sent.command, command) && nowMs - sent.sentMs < _windowMs) {
+            existingId = sent.command.id;
+            _stats.framesSaved++;
+            _stats.duplicates++;
+            return COALESCE_DUPLICATE;
+        }
+    }
+
+    if (_count == BUS_QUEUE_LENGTH) {
+        return COALESCE_FULL;
+    }
+    _pending[(_head + _count) % BUS_QUEUE_LENGTH] = command;
+    _count++;
+    return COALESCE_QUEUED;
+}
+
+bool BusCoalescer::pop(BusCommand& command, uint32_t nowMs) {
+    if (_count == 0) {
+        return false;
+    }
+
+    command = _pending[_head];
+    _head = (_head + 1) % BUS_QUEUE_LENGTH;
+    _count--;
+
+    SentCommand& sent = _sent[key(command)];
+    sent.command = command;
+    sent.sentMs = nowMs;
+    sent.valid = true;
+    return true;
+}
+
+void BusCoalescer::failed(const BusCommand& command) {
+    SentCommand& sent = _sent[key(command)];
+    if (sent.valid && sent.command.id == command.id) {
+        sent.valid = false;
+    }
+}
@@ -0,0 +1,301 @@
+#include "BusWorker.h"
+
+std::atomic<uint32_t> BusWorker::_nextId(1);
+
+BusWorker::BusWorker(int pin, HunterTxMode mode, uint8_t index) : _controller(pin, mode) {
+    _pin = pin;
+    _index = index;
+    _listener = NULL;
+    _listenerArg = NULL;
+    _task = NULL;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    memset(_history, 0, sizeof(_history));
+    memset(_jitter, 0, sizeof(_jitter));
+    memset(&_stats, 0, sizeof(_stats));
+    memset(&_usage, 0, sizeof(_usage));
+}
+
+void BusWorker::begin() {
+    if (_task != NULL) {
+        return;
+    }
+
+    // One task per controller, named after its pin
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "bus_worker_%d", _pin);
+    if (xTaskCreatePinnedToCore(taskEntry, name, BUS_TASK_STACK, this, BUS_TASK_PRIORITY, &_task, BUS_TASK_CORE) != pdPASS) {
+        Serial.println("ERROR: Failed to start bus worker task!");
+        _task = NULL;
+        return;
+    }
+    Serial.print("Bus worker started on pin ");
+    Serial.println(_pin);
+}
+
+void BusWorker::onComplete(BusCompleteCallback callback, void* arg) {
+    _listenerArg = arg;
+    _listener = callback;
+}
+
+uint32_t BusWorker::submit(BusCommandType type, uint8_t zone, uint8_t minutes, BusCommandSource source) {
+    if (_task == NULL) {
+        return 0;
+    }
+
+    BusCommand command;
+    command.type = type;
+    command.zone = zone;
+    command.minutes = minutes;
+    command.source = source;
+
+    portENTER_CRITICAL(&_lock);
+    uint32_t id;
+    CoalesceResult result = enqueue(command, id);
+    portEXIT_CRITICAL(&_lock);
+
+    if (result == COALESCE_QUEUED) {
+        xTaskNotifyGive(_task);
+    }
+    return id;
+}
+
+bool BusWorker::submitBatch(const BusCommand* commands, uint8_t count, uint32_t* ids, CoalesceResult* results) {
+    if (_task == NULL) {
+        return false;
+    }
+
+    // Either every command is queued back to back or none is. Commands that
+    // coalesce take no queue space, so checking for count free slots is enough.
+    bool queued = false;
+    portENTER_CRITICAL(&_lock);
+    if (BUS_QUEUE_LENGTH - _coalescer.pending() < count) {
+        portEXIT_CRITICAL(&_lock);
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        BusCommand command = commands[i];
+        results[i] = enqueue(command, ids[i]);
+        queued |= results[i] == COALESCE_QUEUED;
+    }
+    portEXIT_CRITICAL(&_lock);
+
+    if (queued) {
+        xTaskNotifyGive(_task);
+    }
+    return true;
+}
+
+CoalesceResult BusWorker::enqueue(BusCommand& command, uint32_t& id) {
+    // Coalesce and record the command in one step so the worker always finds its
+    // slot. Ids dropped as duplicates are simply never used.
+    command.id = _nextId++;
+    if (command.id == 0) {
+        command.id = _nextId++;
+    }
+    uint32_t existingId;
+    CoalesceResult result = _coalescer.submit(command, millis(), existingId);
+    if (result == COALESCE_QUEUED || result == COALESCE_REPLACED) {
+        BusCommandStatus& slot = _history[command.id % BUS_HISTORY_LENGTH];
+        slot.command = command;
+        slot.state = BUS_STATE_QUEUED;
+        slot.result = 0;
+        slot.busUs = 0;
+    }
+    if (result == COALESCE_REPLACED) {
+        BusCommandStatus& old = _history[existingId % BUS_HISTORY_LENGTH];
+        if (old.command.id == existingId) {
+            old.state = BUS_STATE_SUPERSEDED;
+        }
+    }
+
+    switch (result) {
+        case COALESCE_QUEUED:
+        case COALESCE_REPLACED:
+            id = command.id;
+            break;
+        case COALESCE_DUPLICATE:
+            id = existingId;
+            break;
+        default:
+            id = 0;
+            break;
+    }
+    return result;
+}
+
+bool BusWorker::lookup(uint32_t id, BusCommandStatus& status) {
+    portENTER_CRITICAL(&_lock);
+    status = _history[id % BUS_HISTORY_LENGTH];
+    portEXIT_CRITICAL(&_lock);
+    return id != 0 && status.command.id == id && status.state != BUS_STATE_UNKNOWN;
+}
+
+uint32_t BusWorker::queueDepth() {
+    portENTER_CRITICAL(&_lock);
+    uint32_t depth = _coalescer.pending();
+    portEXIT_CRITICAL(&_lock);
+    return depth;
+}
+
+HunterJitter BusWorker::getJitter(HunterTxMode mode) {
+    portENTER_CRITICAL(&_lock);
+    HunterJitter jitter = _jitter[mode];
+    portEXIT_CRITICAL(&_lock);
+    return jitter;
+}
+
+HunterBusStats BusWorker::getStats() {
+    portENTER_CRITICAL(&_lock);
+    HunterBusStats stats = _stats;
+    portEXIT_CRITICAL(&_lock);
+    return stats;
+}
+
+BusUsage BusWorker::getUsage() {
+    portENTER_CRITICAL(&_lock);
+    BusUsage usage = _usage;
+    portEXIT_CRITICAL(&_lock);
+    return usage;
+}
+
+BusCoalesceStats BusWorker::getCoalesceStats() {
+    portENTER_CRITICAL(&_lock);
+    BusCoalesceStats stats = _coalescer.getStats();
+    portEXIT_CRITICAL(&_lock);
+    return stats;
+}
+
+void BusWorker::setState(uint32_t id, BusCommandState state, uint8_t result, uint32_t busUs) {
+    portENTER_CRITICAL(&_lock);
+    BusCommandStatus& slot = _history[id % BUS_HISTORY_LENGTH];
+    if (slot.command.id == id) {
+        slot.state = state;
+        slot.result = result;
+        slot.busUs = busUs;
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void BusWorker::taskEntry(void* arg) {
+    static_cast<BusWorker*>(arg)->run();
+}
+
+void BusWorker::run() {
+    BusCommand command;
+    while (true) {
+        portENTER_CRITICAL(&_lock);
+        bool ready = _coalescer.pop(command, millis());
+        if (ready) {
+            BusCommandStatus& slot = _history[command.id % BUS_HISTORY_LENGTH];
+            if (slot.command.id == command.id) {
+                slot.state = BUS_STATE_TRANSMITTING;
+            }
+        }
+        portEXIT_CRITICAL(&_lock);
+
+        if (!ready) {
+            // Woken by submit() once a new command is queued
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        uint32_t startUs = micros();
+        byte result = execute(command);
+
+        // The RMT backend returns once the frame is queued, wait for it to leave the pin
+        if (result == 0 && !_controller.waitIdle(2000)) {
+            result = BUS_ERROR_TIMEOUT;
+        }
+        uint32_t busyUs = micros() - startUs;
+        if (result != 0) {
+            portENTER_CRITICAL(&_lock);
+            _coalescer.failed(command);
+            portEXIT_CRITICAL(&_lock);
+        }
+        setState(command.id, result == 0 ? BUS_STATE_DONE : BUS_STATE_FAILED, result, busyUs);
+
+        if (_listener != NULL) {
+            BusCommandStatus finished;
+            finished.command = command;
+            finished.state = result == 0 ? BUS_STATE_DONE : BUS_STATE_FAILED;
+            finished.result = result;
+            finished.busUs = busyUs;
+            _listener(_index, finished, _listenerArg);
+        }
+
+        // Timing snapshots for the HTTP task, which must not touch the controller
+        HunterJitter rmt = _controller.getJitter(HUNTER_TX_RMT);
+        HunterJitter bitbang = _controller.getJitter(HUNTER_TX_BITBANG);
+        HunterBusStats stats = _controller.getStats();
+        portENTER_CRITICAL(&_lock);
+        _jitter[HUNTER_TX_RMT] = rmt;
+        _jitter[HUNTER_TX_BITBANG] = bitbang;
+        _stats = stats;
+        _usage.frames++;
+        _usage.busyUs += busyUs;
+        portEXIT_CRITICAL(&_lock);
+    }
+}
+
+byte BusWorker::execute(const BusCommand& command) {
+    switch (command.type) {
+        case BUS_CMD_START:
+            return _controller.startZone(command.zone, command.minutes);
+        case BUS_CMD_STOP:
+            return _controller.stopZone(command.zone);
+        case BUS_CMD_PROGRAM:
+            return _controller.startProgram(command.zone);
+        default:
+            return BUS_ERROR_TIMEOUT;
+    }
+}
+
+String BusWorker::errorHint(byte error) {
+    if (error == BUS_ERROR_TIMEOUT) {
+        return String("Bus transmit timed out.");
+    }
+    return _controller.errorHint(error);
+}
+
+const char* BusWorker::stateName(BusCommandState state) {
+    switch (state) {
+        case BUS_STATE_QUEUED:
+            return "queued";
+        case BUS_STATE_TRANSMITTING:
+            return "transmitting";
+        case BUS_STATE_DONE:
+            return "done";
+        case BUS_STATE_FAILED:
+            return "failed";
+        case BUS_STATE_SUPERSEDED:
+            return "superseded";
+        default:
+            return "unknown";
+    }
+}
+
+const char* BusWorker::coalesceName(CoalesceResult result) {
+    switch (result) {
+        case COALESCE_QUEUED:
+            return "queued";
+        case COALESCE_DUPLICATE:
+            return "duplicate";
+        case COALESCE_REPLACED:
+            return "replaced";
+        default:
+            return "rejected";
+    }
+}
+
+const char* BusWorker::typeName(BusCommandType type) {
+    switch (type) {
+        case BUS_CMD_START:
+            return "start";
+        case BUS_CMD_STOP:
+            return "stop";
+        case BUS_CMD_PROGRAM:
+            return "program";
+        default:
+            return "unknown";
+    }
+}
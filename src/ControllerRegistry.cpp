@@ -0,0 +1,180 @@
+#include "ControllerRegistry.h"
+#include <Preferences.h>
+
+ControllerRegistry::ControllerRegistry(int primaryPin, HunterTxMode mode) : _primary(primaryPin, mode) {
+    _mode = mode;
+    _listener = NULL;
+    _listenerArg = NULL;
+    _count = 1;
+    _reservedCount = 0;
+    _controllers[0] = &_primary;
+    for (uint8_t i = 0; i < CONTROLLER_MAX; i++) {
+        if (i > 0) {
+            _controllers[i] = NULL;
+        }
+        _removed[i] = false;
+    }
+}
+
+void ControllerRegistry::reserve(int pin) {
+    if (pin >= 0 && _reservedCount < CONTROLLER_RESERVED_MAX) {
+        _reserved[_reservedCount++] = pin;
+    }
+}
+
+bool ControllerRegistry::isReserved(int pin) {
+    static const int fixed[] = CONTROLLER_RESERVED_PINS;
+    for (int reserved : fixed) {
+        if (pin == reserved) {
+            return true;
+        }
+    }
+    for (uint8_t i = 0; i < _reservedCount; i++) {
+        if (pin == _reserved[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ControllerRegistry::onComplete(BusCompleteCallback callback, void* arg) {
+    _listener = callback;
+    _listenerArg = arg;
+    _primary.onComplete(callback, arg);
+}
+
+void ControllerRegistry::begin() {
+    _primary.begin();
+
+    Preferences prefs;
+    if (!prefs.begin(CONTROLLER_PREFS_NAMESPACE, true)) {
+        return;
+    }
+    uint8_t pins[CONTROLLER_MAX - 1];
+    size_t stored = prefs.getBytes(CONTROLLER_PREFS_PINS, pins, sizeof(pins));
+    prefs.end();
+
+    bool dropped = false;
+    for (size_t i = 0; i < stored; i++) {
+        uint8_t index;
+        ControllerAddResult result = attach(pins[i], index);
+        if (result != CONTROLLER_ADDED) {
+            Serial.print("ERROR: Failed to restore controller on pin ");
+            Serial.print(pins[i]);
+            Serial.print(": ");
+            Serial.println(resultName(result));
+            dropped |= result == CONTROLLER_BAD_PIN || result == CONTROLLER_PIN_RESERVED;
+        }
+    }
+
+    // A pin saved by an older firmware that is now refused is forgotten for good
+    if (dropped) {
+        save();
+    }
+}
+
+ControllerAddResult ControllerRegistry::attach(int pin, uint8_t& index) {
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(pin)) {
+        return CONTROLLER_BAD_PIN;
+    }
+    if (isReserved(pin)) {
+        return CONTROLLER_PIN_RESERVED;
+    }
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_controllers[i]->getPin() != pin) {
+            continue;
+        }
+        if (!_removed[i]) {
+            return CONTROLLER_PIN_IN_USE;
+        }
+        // Its worker is still running on the pin, take it back
+        _removed[i] = false;
+        index = i;
+        return CONTROLLER_ADDED;
+    }
+    if (_count == CONTROLLER_MAX) {
+        return CONTROLLER_FULL;
+    }
+
+    // Controllers live until reboot, so a running worker is never freed
+    BusWorker* worker = new BusWorker(pin, _mode, _count);
+    worker->onComplete(_listener, _listenerArg);
+    worker->begin();
+    if (!worker->isRunning()) {
+        delete worker;
+        return CONTROLLER_FAILED;
+    }
+    index = _count;
+    _controllers[_count++] = worker;
+    return CONTROLLER_ADDED;
+}
+
+ControllerAddResult ControllerRegistry::add(int pin, uint8_t& index) {
+    ControllerAddResult result = attach(pin, index);
+    if (result == CONTROLLER_ADDED) {
+        save();
+    }
+    return result;
+}
+
+bool ControllerRegistry::remove(uint8_t index) {
+    if (index == 0 || index >= _count || _removed[index]) {
+        return false;
+    }
+    _removed[index] = true;
+    save();
+    return true;
+}
+
+void ControllerRegistry::save() {
+    uint8_t pins[CONTROLLER_MAX - 1];
+    uint8_t saved = 0;
+    for (uint8_t i = 1; i < _count; i++) {
+        if (!_removed[i]) {
+            pins[saved++] = _controllers[i]->getPin();
+        }
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(CONTROLLER_PREFS_NAMESPACE, false)) {
+        Serial.println("ERROR: Failed to save controllers!");
+        return;
+    }
+    if (saved > 0) {
+        prefs.putBytes(CONTROLLER_PREFS_PINS, pins, saved);
+    } else {
+        prefs.remove(CONTROLLER_PREFS_PINS);
+    }
+    prefs.end();
+}
+
+BusWorker* ControllerRegistry::get(uint8_t index) {
+    return index < _count ? _controllers[index] : NULL;
+}
+
+bool ControllerRegistry::lookup(uint32_t id, BusCommandStatus& status, uint8_t& index) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_controllers[i]->lookup(id, status)) {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* ControllerRegistry::resultName(ControllerAddResult result) {
+    switch (result) {
+        case CONTROLLER_ADDED:
+            return "Controller added";
+        case CONTROLLER_BAD_PIN:
+            return "Pin is not an output GPIO";
+        case CONTROLLER_PIN_RESERVED:
+            return "Pin is reserved for flash, USB, Ethernet or boot strapping";
+        case CONTROLLER_PIN_IN_USE:
+            return "Pin already has a controller";
+        case CONTROLLER_FULL:
+            return "No free controller slots";
+        default:
+            return "Failed to start controller";
+    }
+}
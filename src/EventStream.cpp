@@ -0,0 +1,173 @@
+#include "EventStream.h"
+#include "iSprinklrNetwork.h"
+
+EventStream::EventStream() : _source("/api/events") {
+    _queue = NULL;
+    _task = NULL;
+    _mutex = NULL;
+    _nextId = 1;
+    _dropped = 0;
+    _evicted = 0;
+    for (uint8_t i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        _clients[i] = NULL;
+    }
+}
+
+void EventStream::begin(AsyncWebServer& server) {
+    if (_task != NULL) {
+        return;
+    }
+
+    _mutex = xSemaphoreCreateMutex();
+    _queue = xQueueCreate(EVENTS_QUEUE_LENGTH, sizeof(PushEvent));
+    if (_mutex == NULL || _queue == NULL) {
+        Serial.println("ERROR: Failed to create event stream queue!");
+        return;
+    }
+
+    _source.onConnect([this](AsyncEventSourceClient* client) {
+        onConnect(client);
+    });
+    _source.onDisconnect([this](AsyncEventSourceClient* client) {
+        onDisconnect(client);
+    });
+    server.addHandler(&_source);
+
+    if (xTaskCreatePinnedToCore(taskEntry, "events", EVENTS_TASK_STACK, this, EVENTS_TASK_PRIORITY, &_task, EVENTS_TASK_CORE) != pdPASS) {
+        Serial.println("ERROR: Failed to start event stream task!");
+        _task = NULL;
+    }
+}
+
+void EventStream::commandFinished(uint8_t controller, const BusCommandStatus& status) {
+    PushEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = PUSH_EVENT_COMMAND;
+    event.controller = controller;
+    event.command = status;
+    post(event);
+}
+
+void EventStream::networkChanged(const NetworkState& state) {
+    PushEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = PUSH_EVENT_NETWORK;
+    event.connected = state.isConnected();
+    event.link = state.activeLink();
+    post(event);
+}
+
+void EventStream::post(const PushEvent& event) {
+    if (_queue == NULL || xQueueSend(_queue, &event, 0) != pdTRUE) {
+        _dropped++;
+    }
+}
+
+uint8_t EventStream::clientCount() {
+    uint8_t count = 0;
+    if (_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        if (_clients[i] != NULL) {
+            count++;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return count;
+}
+
+void EventStream::onConnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        if (_clients[i] == NULL) {
+            _clients[i] = client;
+            xSemaphoreGive(_mutex);
+            return;
+        }
+    }
+    xSemaphoreGive(_mutex);
+
+    // No free slot
+    client->close();
+}
+
+void EventStream::onDisconnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        if (_clients[i] == client) {
+            _clients[i] = NULL;
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void EventStream::broadcast(const char* event, const char* message) {
+    uint32_t id = _nextId++;
+
+    AsyncEventSourceClient* evict[EVENTS_MAX_CLIENTS];
+    uint8_t evictCount = 0;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        AsyncEventSourceClient* client = _clients[i];
+        if (client == NULL) {
+            continue;
+        }
+
+        // Drop a subscriber that cannot keep up rather than queue without bound
+        if (!client->connected() || client->packetsWaiting() >= EVENTS_CLIENT_BACKLOG) {
+            _clients[i] = NULL;
+            _evicted++;
+            evict[evictCount++] = client;
+            continue;
+        }
+        client->send(message, event, id);
+    }
+    xSemaphoreGive(_mutex);
+
+    // close() runs onDisconnect on this task, which takes the mutex
+    for (uint8_t i = 0; i < evictCount; i++) {
+        evict[i]->close();
+    }
+}
+
+void EventStream::taskEntry(void* arg) {
+    static_cast<EventStream*>(arg)->run();
+}
+
+void EventStream::run() {
+    PushEvent event;
+    char message[EVENTS_MESSAGE_SIZE];
+
+    while (true) {
+        if (xQueueReceive(_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (event.type == PUSH_EVENT_NETWORK) {
+            snprintf(message, sizeof(message), "{\"connected\":%s,\"type\":\"%s\",\"ip\":\"%s\"}",
+                     event.connected ? "true" : "false",
+                     event.link == NET_LINK_ETHERNET ? "Ethernet" : event.link == NET_LINK_WIFI ? "WiFi" : "Disconnected",
+                     iSprinklrNetwork::getInstance()->getIP().toString().c_str());
+            broadcast("network", message);
+            continue;
+        }
+
+        const BusCommand& command = event.command.command;
+        snprintf(message, sizeof(message),
+                 "{\"id\":%u,\"controller\":%u,\"command\":\"%s\",\"zone\":%u,\"minutes\":%u,\"state\":\"%s\",\"result\":%u}",
+                 (unsigned)command.id, event.controller, BusWorker::typeName(command.type), command.zone,
+                 command.minutes, BusWorker::stateName(event.command.state), event.command.result);
+        broadcast("command", message);
+
+        // A zone only changes state once its frame is on the wire
+        if (event.command.state == BUS_STATE_DONE && command.type != BUS_CMD_PROGRAM) {
+            bool running = command.type == BUS_CMD_START && command.minutes > 0;
+            snprintf(message, sizeof(message), "{\"controller\":%u,\"zone\":%u,\"state\":\"%s\",\"minutes\":%u}",
+                     event.controller, command.zone, running ? "started" : "stopped", running ? command.minutes : 0);
+            broadcast("zone", message);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#include "FrameProtocol.h"
+#include <string.h>
+
+uint16_t fletcher16(const uint8_t* data, size_t len) {
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+}
+
+bool parseFrame(const uint8_t* bytes, Frame& frame) {
+    if (bytes[0] != FRAME_BEGIN || bytes[FRAME_REQUEST_SIZE - 1] != FRAME_END) {
+        return false;
+    }
+
+    uint16_t checksum = (bytes[5] << 8) | bytes[6];
+    if (fletcher16(bytes + 1, 4) != checksum) {
+        return false;
+    }
+
+    frame.conn = bytes[1];
+    frame.type = bytes[2];
+    frame.data[0] = bytes[3];
+    frame.data[1] = bytes[4];
+    frame.checksum = fletcher16(bytes, FRAME_REQUEST_SIZE);
+    return true;
+}
+
+void buildReply(uint8_t* out, const Frame& request, uint8_t type, uint8_t data) {
+    out[0] = FRAME_BEGIN;
+    out[1] = request.conn;
+    out[2] = type;
+    out[3] = data;
+    out[4] = request.checksum & 0xff;
+    out[5] = request.checksum >> 8;
+    out[6] = FRAME_END;
+}
+
+bool FrameAssembler::push(uint8_t byte, Frame& frame) {
+    if (_length == 0 && byte != FRAME_BEGIN) {
+        return false;
+    }
+    _buffer[_length++] = byte;
+    if (_length < FRAME_REQUEST_SIZE) {
+        return false;
+    }
+
+    if (parseFrame(_buffer, frame)) {
+        _length = 0;
+        return true;
+    }
+
+    // A BEGIN in the noise, start again from the next one in the buffer
+    uint8_t next = 1;
+    while (next < FRAME_REQUEST_SIZE && _buffer[next] != FRAME_BEGIN) {
+        next++;
+    }
+    _length = FRAME_REQUEST_SIZE - next;
+    memmove(_buffer, _buffer + next, _length);
+    return false;
+}
+
+FrameReplayCache::FrameReplayCache() {
+    memset(_entries, 0, sizeof(_entries));
+    _next = 0;
+}
+
+bool FrameReplayCache::lookup(uint32_t source, const Frame& request, uint32_t nowMs, uint8_t* out) {
+    for (uint8_t i = 0; i < FRAME_REPLAY_SLOTS; i++) {
+        Entry& entry = _entries[i];
+        if (entry.used && entry.source == source && entry.conn == request.conn &&
+            entry.checksum == request.checksum && nowMs - entry.storedMs < FRAME_REPLAY_MS) {
+            memcpy(out, entry.reply, FRAME_REPLY_SIZE);
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameReplayCache::store(uint32_t source, const Frame& request, const uint8_t* reply, uint32_t nowMs) {
+    Entry& entry = _entries[_next];
+    entry.used = true;
+    entry.source = source;
+    entry.conn = request.conn;
+    entry.checksum = request.checksum;
+    entry.storedMs = nowMs;
+    memcpy(entry.reply, reply, FRAME_REPLY_SIZE);
+    _next = (_next + 1) % FRAME_REPLAY_SLOTS;
+}
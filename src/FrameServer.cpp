@@ -0,0 +1,153 @@
+#include "FrameServer.h"
+#include "Watering.h"
+
+FrameServer::FrameServer(BusWorker& bus) : _bus(bus)
+#ifdef FRAME_TCP
+    , _tcp(FRAME_TCP_PORT)
+#endif
+{
+    _admit = NULL;
+    _admitArg = NULL;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+#ifdef FRAME_TCP
+    for (uint8_t i = 0; i < FRAME_TCP_CLIENTS; i++) {
+        _clients[i].client = NULL;
+    }
+#endif
+}
+
+void FrameServer::onAdmit(FrameAdmitCallback callback, void* arg) {
+    _admit = callback;
+    _admitArg = arg;
+}
+
+void FrameServer::begin() {
+    if (!_udp.listen(FRAME_UDP_PORT)) {
+        Serial.println("ERROR: Failed to open frame protocol UDP port!");
+        return;
+    }
+
+    // A datagram may carry noise and several frames, each is answered on its own
+    _udp.onPacket([this](AsyncUDPPacket& packet) {
+        uint32_t source = (uint32_t)packet.remoteIP();
+        FrameAssembler assembler;
+        Frame frame;
+        uint8_t reply[FRAME_REPLY_SIZE];
+        for (size_t i = 0; i < packet.length(); i++) {
+            if (assembler.push(packet.data()[i], frame) && handle(source, frame, reply)) {
+                packet.write(reply, FRAME_REPLY_SIZE);
+            }
+        }
+    });
+
+#ifdef FRAME_TCP
+    _tcp.onClient([](void* arg, AsyncClient* client) {
+        static_cast<FrameServer*>(arg)->onTcpClient(client);
+    }, this);
+    _tcp.begin();
+#endif
+
+    Serial.print("Frame protocol listening on UDP port ");
+    Serial.println(FRAME_UDP_PORT);
+}
+
+#ifdef FRAME_TCP
+void FrameServer::onTcpClient(AsyncClient* client) {
+    TcpClient* slot = NULL;
+    for (uint8_t i = 0; i < FRAME_TCP_CLIENTS; i++) {
+        if (_clients[i].client == NULL) {
+            slot = &_clients[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        client->close(true);
+        delete client;
+        return;
+    }
+
+    // The stream can split a frame anywhere, the assembler carries it over
+    slot->client = client;
+    slot->assembler.reset();
+    client->onData([this, slot](void* arg, AsyncClient* client, void* data, size_t len) {
+        uint32_t source = client->getRemoteAddress();
+        Frame frame;
+        uint8_t reply[FRAME_REPLY_SIZE];
+        for (size_t i = 0; i < len; i++) {
+            if (slot->assembler.push(((uint8_t*)data)[i], frame) && handle(source, frame, reply)) {
+                client->write((const char*)reply, FRAME_REPLY_SIZE);
+            }
+        }
+    });
+    client->onDisconnect([slot](void* arg, AsyncClient* client) {
+        slot->client = NULL;
+        delete client;
+    });
+}
+#endif
+
+bool FrameServer::handle(uint32_t source, const Frame& frame, uint8_t* reply) {
+    switch (frame.type) {
+        case FRAME_SYN:
+            buildReply(reply, frame, FRAME_SYN, FRAME_ACK);
+            return true;
+        case FRAME_ACK:
+            // Closes the handshake, nothing to answer
+            return false;
+        case FRAME_START:
+        case FRAME_STOP:
+            break;
+        default:
+            buildReply(reply, frame, FRAME_ERR, FRAME_BAD_CMD);
+            return true;
+    }
+
+    // A resent command gets its first answer and is not queued again
+    portENTER_CRITICAL(&_lock);
+    bool replayed = _replay.lookup(source, frame, millis(), reply);
+    portEXIT_CRITICAL(&_lock);
+    if (replayed) {
+        return true;
+    }
+
+    uint8_t data = FRAME_EMPTY;
+    uint8_t type = dispatch(source, frame, data);
+    buildReply(reply, frame, type, data);
+
+    // Busy is worth retrying, so it is not remembered
+    if (type == FRAME_ACK || data != FRAME_BUSY) {
+        portENTER_CRITICAL(&_lock);
+        _replay.store(source, frame, reply, millis());
+        portEXIT_CRITICAL(&_lock);
+    }
+    return true;
+}
+
+uint8_t FrameServer::dispatch(uint32_t source, const Frame& frame, uint8_t& data) {
+    uint8_t zone = frame.data[0];
+    uint8_t minutes = frame.data[1];
+
+    if (zone < API_MIN_ZONE || zone > API_MAX_ZONE) {
+        data = FRAME_BAD_SPRINKLER;
+        return FRAME_ERR;
+    }
+    if (frame.type == FRAME_START && minutes > API_MAX_MINUTES) {
+        data = FRAME_BAD_DURATION;
+        return FRAME_ERR;
+    }
+
+    AdmissionClass type = frame.type == FRAME_START ? ADMIT_COMMAND : ADMIT_STOP;
+    if (_admit != NULL && !_admit(source, type, _admitArg).admitted) {
+        data = FRAME_BUSY;
+        return FRAME_ERR;
+    }
+
+    uint32_t id = frame.type == FRAME_START ?
+        _bus.submit(BUS_CMD_START, zone, minutes, BUS_SOURCE_FRAME) :
+        _bus.submit(BUS_CMD_STOP, zone, 0, BUS_SOURCE_FRAME);
+    if (id == 0) {
+        data = FRAME_BUSY;
+        return FRAME_ERR;
+    }
+    return FRAME_ACK;
+}
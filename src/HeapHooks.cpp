@@ -0,0 +1,38 @@
+// Allocator hooks for the per-route heap counters in HeapStats. The firmware
+// is linked with -Wl,--wrap for malloc, calloc and realloc, so every call to
+// them, from our code, the libraries or the framework, comes through here
+// first. Only enabled with -D HEAP_TRACK_ALLOCATIONS, which has to go with
+// the --wrap flags (see platformio.ini).
+
+#ifdef HEAP_TRACK_ALLOCATIONS
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "HeapStats.h"
+
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+// Nothing in here may allocate
+void* __wrap_malloc(size_t size) {
+    heapStats.allocated(xTaskGetCurrentTaskHandle(), size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    heapStats.allocated(xTaskGetCurrentTaskHandle(), count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    heapStats.allocated(xTaskGetCurrentTaskHandle(), size);
+    return __real_realloc(ptr, size);
+}
+
+}
+
+#endif // HEAP_TRACK_ALLOCATIONS
@@ -0,0 +1,69 @@
+#include "HeapStats.h"
+#include "Hal.h"
+
+HeapStats heapStats;
+
+HeapStats::HeapStats() {
+    _task = NULL;
+    _route = ROUTE_OTHER;
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        _allocations[r] = 0;
+        _bytes[r] = 0;
+        _largest[r] = 0;
+    }
+    _failures = 0;
+    _failureSize = 0;
+    _failureCaps = 0;
+    _failureMs = 0;
+}
+
+void HeapStats::enter(const void* task, MetricsRoute route) {
+    if (route >= ROUTE_COUNT) {
+        route = ROUTE_OTHER;
+    }
+    _route = route;
+    _task = task;
+}
+
+void HeapStats::leave() {
+    _task = NULL;
+}
+
+void HeapStats::allocated(const void* task, size_t size) {
+    // Also called before the scheduler starts, when there is no task yet
+    if (task == NULL || task != _task.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint8_t route = _route;
+    _allocations[route]++;
+    _bytes[route] += size;
+    uint32_t largest = _largest[route];
+    while (size > largest && !_largest[route].compare_exchange_weak(largest, size)) {
+    }
+}
+
+void HeapStats::failed(size_t size, uint32_t caps) {
+    _failures++;
+    _failureSize = size;
+    _failureCaps = caps;
+    uint32_t now = halMillis();
+    _failureMs = now > 0 ? now : 1;
+}
+
+HeapRouteStats HeapStats::route(MetricsRoute route) const {
+    HeapRouteStats stats = { 0, 0, 0 };
+    if (route < ROUTE_COUNT) {
+        stats.allocations = _allocations[route];
+        stats.bytes = _bytes[route];
+        stats.largest = _largest[route];
+    }
+    return stats;
+}
+
+HeapFailure HeapStats::lastFailure() const {
+    HeapFailure failure;
+    failure.size = _failureSize;
+    failure.caps = _failureCaps;
+    failure.ms = _failureMs;
+    return failure;
+}
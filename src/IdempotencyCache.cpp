@@ -0,0 +1,76 @@
+#include "IdempotencyCache.h"
+#include <string.h>
+
+IdempotencyCache::IdempotencyCache() {
+    memset(_entries, 0, sizeof(_entries));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+IdempotencyCache::Entry* IdempotencyCache::find(uint32_t client, const char* key) {
+    for (uint8_t i = 0; i < IDEMPOTENCY_SLOTS; i++) {
+        Entry& entry = _entries[i];
+        if (entry.used && entry.client == client && strcmp(entry.key, key) == 0) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+IdempotencyResult IdempotencyCache::lookup(uint32_t client, const char* key, uint32_t fingerprint, uint32_t nowMs,
+                                           int& code, const char*& body, size_t& length) {
+    Entry* entry = find(client, key);
+    if (entry == NULL || nowMs - entry->storedMs >= IDEMPOTENCY_WINDOW_MS) {
+        _stats.misses++;
+        return IDEMPOTENCY_MISS;
+    }
+    if (entry->fingerprint != fingerprint) {
+        _stats.mismatches++;
+        return IDEMPOTENCY_MISMATCH;
+    }
+
+    entry->usedMs = nowMs;
+    code = entry->code;
+    body = entry->body;
+    length = entry->length;
+    _stats.hits++;
+    return IDEMPOTENCY_HIT;
+}
+
+void IdempotencyCache::store(uint32_t client, const char* key, uint32_t fingerprint, int code,
+                             const char* body, size_t length, uint32_t nowMs) {
+    if (strlen(key) > API_IDEMPOTENCY_KEY_MAX || length > sizeof(_entries[0].body)) {
+        return;
+    }
+
+    // Reuse the key's own slot if its window ran out, else a free or expired
+    // slot, else the least recently used one
+    Entry* slot = find(client, key);
+    for (uint8_t i = 0; slot == NULL && i < IDEMPOTENCY_SLOTS; i++) {
+        if (!_entries[i].used || nowMs - _entries[i].storedMs >= IDEMPOTENCY_WINDOW_MS) {
+            slot = &_entries[i];
+        }
+    }
+    if (slot == NULL) {
+        slot = &_entries[0];
+        for (uint8_t i = 1; i < IDEMPOTENCY_SLOTS; i++) {
+            if (nowMs - _entries[i].usedMs > nowMs - slot->usedMs) {
+                slot = &_entries[i];
+            }
+        }
+    }
+
+    slot->used = true;
+    slot->client = client;
+    slot->fingerprint = fingerprint;
+    slot->storedMs = nowMs;
+    slot->usedMs = nowMs;
+    slot->code = code;
+    slot->length = length;
+    strcpy(slot->key, key);
+    memcpy(slot->body, body, length);
+}
+
+uint32_t IdempotencyCache::fingerprint(BusCommandType type, int controller, int zone, int minutes) {
+    return ((uint32_t)type << 24) | ((uint32_t)(controller & 0xff) << 16) |
+           ((uint32_t)(zone & 0xff) << 8) | (uint32_t)(minutes & 0xff);
+}
@@ -0,0 +1,210 @@
+#include "Journal.h"
+#include "ApiLimits.h"
+#include "Watering.h"
+
+Journal::Journal() {
+    _count = 0;
+    _nextSeq = 1;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    _mutex = NULL;
+    _task = NULL;
+    _dropped = 0;
+    _lost = 0;
+}
+
+void Journal::begin() {
+    if (_task != NULL) {
+        return;
+    }
+
+    if (!_log.mount()) {
+        Serial.println("ERROR: No flash partition for the command journal!");
+        return;
+    }
+    _nextSeq = _log.nextSeq();
+
+    _mutex = xSemaphoreCreateMutex();
+    if (_mutex == NULL ||
+        xTaskCreatePinnedToCore(taskEntry, "journal", JOURNAL_TASK_STACK, this, JOURNAL_TASK_PRIORITY, &_task, JOURNAL_TASK_CORE) != pdPASS) {
+        Serial.println("ERROR: Failed to start journal task!");
+        _task = NULL;
+        return;
+    }
+
+    Serial.print("Command journal holds ");
+    Serial.print(_log.capacity());
+    Serial.print(" records, next is ");
+    Serial.println(_nextSeq);
+}
+
+void Journal::taskEntry(void* arg) {
+    static_cast<Journal*>(arg)->run();
+}
+
+void Journal::run() {
+    while (true) {
+        // Woken early by record() once the buffer fills up
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOURNAL_FLUSH_MS));
+        flush();
+    }
+}
+
+void Journal::record(uint8_t controller, const BusCommandStatus& status) {
+    if (_task == NULL) {
+        return;
+    }
+
+    JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    time_t now = time(NULL);
+    record.time = now >= SCHEDULE_MIN_EPOCH ? (uint32_t)now : 0;
+    record.uptimeMs = millis();
+    record.id = status.command.id;
+    record.busUs = status.busUs;
+    record.source = status.command.source;
+    record.command = status.command.type;
+    record.controller = controller;
+    record.zone = status.command.zone;
+    record.minutes = status.command.minutes;
+    record.result = status.result;
+
+    bool full = false;
+    bool wake = false;
+    portENTER_CRITICAL(&_lock);
+    if (_count < JOURNAL_BUFFER_LENGTH) {
+        record.seq = _nextSeq++;
+        _pending[_count++] = record;
+        wake = _count >= JOURNAL_FLUSH_THRESHOLD;
+    } else {
+        full = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+
+    if (full) {
+        _dropped++;
+    } else if (wake) {
+        xTaskNotifyGive(_task);
+    }
+}
+
+void Journal::flush() {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&_lock);
+    uint8_t count = _count;
+    memcpy(_flushing, _pending, count * sizeof(JournalRecord));
+    portEXIT_CRITICAL(&_lock);
+
+    if (count > 0) {
+        uint8_t written = _log.append(_flushing, count);
+        if (written < count) {
+            _lost += count - written;
+            Serial.println("ERROR: Failed to write the command journal!");
+        }
+
+        // Readers find a record in the buffer until it is in flash
+        portENTER_CRITICAL(&_lock);
+        _count -= count;
+        memmove(_pending, _pending + count, _count * sizeof(JournalRecord));
+        portEXIT_CRITICAL(&_lock);
+    }
+    xSemaphoreGive(_mutex);
+}
+
+bool Journal::read(uint32_t seq, JournalRecord& record) {
+    bool buffered = false;
+    portENTER_CRITICAL(&_lock);
+    if (_count > 0 && seq >= _pending[0].seq && seq - _pending[0].seq < _count) {
+        record = _pending[seq - _pending[0].seq];
+        buffered = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+    if (buffered) {
+        return true;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    bool found = _log.read(seq, record);
+    xSemaphoreGive(_mutex);
+    return found;
+}
+
+void Journal::beginHistory(uint32_t since, uint32_t limit, JournalCursor& cursor) {
+    cursor.stage = 0;
+    cursor.started = false;
+    cursor.oldest = 0;
+    cursor.seq = 0;
+    cursor.end = 0;
+    if (_task == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    cursor.oldest = _log.oldestSeq();
+    xSemaphoreGive(_mutex);
+    portENTER_CRITICAL(&_lock);
+    uint32_t next = _nextSeq;
+    portEXIT_CRITICAL(&_lock);
+
+    cursor.seq = since > cursor.oldest ? since : cursor.oldest;
+    if (cursor.seq > next) {
+        cursor.seq = next;
+    }
+    cursor.end = next - cursor.seq > limit ? cursor.seq + limit : next;
+}
+
+size_t Journal::write(char* out, size_t size, JournalCursor& cursor) {
+    size_t len = fill(out, size, cursor);
+    if (len == 0 && cursor.stage < 3) {
+        // Too little room this time, the response is not over
+        return RESPONSE_TRY_AGAIN;
+    }
+    return len;
+}
+
+size_t Journal::fill(char* out, size_t size, JournalCursor& cursor) {
+    size_t len = 0;
+    if (cursor.stage == 0) {
+        int header = snprintf(out, size, "{\"oldest\":%u,\"next\":%u,\"records\":[",
+                              (unsigned)cursor.oldest, (unsigned)cursor.end);
+        if (header < 0 || (size_t)header >= size) {
+            return 0;
+        }
+        len = header;
+        cursor.stage = 1;
+    }
+
+    if (cursor.stage == 1) {
+        // Records lost to a reset or a failed write are left out
+        char line[256];
+        JournalRecord record;
+        while (cursor.seq < cursor.end) {
+            if (!read(cursor.seq, record)) {
+                cursor.seq++;
+                continue;
+            }
+            size_t recordLen = journalRecordJson(record, line, sizeof(line));
+            bool comma = cursor.started;
+            if (len + comma + recordLen > size) {
+                return len;
+            }
+            if (comma) {
+                out[len++] = ',';
+            }
+            memcpy(out + len, line, recordLen);
+            len += recordLen;
+            cursor.started = true;
+            cursor.seq++;
+        }
+        cursor.stage = 2;
+    }
+
+    if (cursor.stage == 2) {
+        if (len + 2 > size) {
+            return len;
+        }
+        out[len++] = ']';
+        out[len++] = '}';
+        cursor.stage = 3;
+    }
+    return len;
+}
@@ -0,0 +1,173 @@
+#include "JournalLog.h"
+#include <stdio.h>
+#include <string.h>
+#include "FrameProtocol.h"
+
+static bool blank(const JournalRecord& record) {
+    const uint8_t* bytes = (const uint8_t*)&record;
+    for (size_t i = 0; i < JOURNAL_RECORD_SIZE; i++) {
+        if (bytes[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void JournalLog::seal(JournalRecord& record) {
+    record.version = JOURNAL_RECORD_VERSION;
+    memset(record.reserved, 0, sizeof(record.reserved));
+    record.check = fletcher16((const uint8_t*)&record, offsetof(JournalRecord, check));
+}
+
+bool JournalLog::valid(const JournalRecord& record) {
+    return record.version == JOURNAL_RECORD_VERSION && record.seq != 0 &&
+           record.check == fletcher16((const uint8_t*)&record, offsetof(JournalRecord, check));
+}
+
+bool JournalLog::readSlot(uint32_t offset, JournalRecord& record) {
+    return halFlashRead(offset, &record, JOURNAL_RECORD_SIZE);
+}
+
+bool JournalLog::mount() {
+    uint32_t sectors = halFlashSize() / HAL_FLASH_SECTOR;
+    if (sectors > JOURNAL_MAX_SECTORS) {
+        sectors = JOURNAL_MAX_SECTORS;
+    }
+    if (sectors < 2) {
+        _sectors = 0;
+        return false;
+    }
+    _sectors = sectors;
+    _next = 1;
+    _oldest = 1;
+    _open = -1;
+
+    // The newest sector starts with the highest seq. A record that is not
+    // where its seq says it should be belongs to something else.
+    JournalRecord record;
+    uint32_t newest = 0;
+    int32_t head = -1;
+    for (uint32_t s = 0; s < _sectors; s++) {
+        uint32_t offset = s * HAL_FLASH_SECTOR;
+        if (readSlot(offset, record) && valid(record) && offsetOf(record.seq) == offset && record.seq > newest) {
+            newest = record.seq;
+            head = s;
+        }
+    }
+    if (head < 0) {
+        return true;
+    }
+
+    // Carry on after the last slot written, torn or not, since only erased
+    // flash can be written again
+    uint32_t used = 0;
+    for (uint32_t i = 1; i < JOURNAL_RECORDS_PER_SECTOR; i++) {
+        if (readSlot(head * HAL_FLASH_SECTOR + i * JOURNAL_RECORD_SIZE, record) && !blank(record)) {
+            used = i;
+        }
+    }
+    _next = newest + used + 1;
+    _open = head;
+
+    // The sector after the head still holds the previous trip round the ring
+    if (newest + JOURNAL_RECORDS_PER_SECTOR > slots()) {
+        _oldest = newest + JOURNAL_RECORDS_PER_SECTOR - slots();
+    }
+    return true;
+}
+
+uint8_t JournalLog::append(JournalRecord* records, uint8_t count) {
+    if (!isMounted()) {
+        return 0;
+    }
+
+    uint8_t written = 0;
+    uint8_t i = 0;
+    while (i < count) {
+        uint32_t seq = records[i].seq;
+        if (seq < _next) {
+            i++;
+            continue;
+        }
+
+        uint32_t offset = offsetOf(seq);
+        int32_t sector = offset / HAL_FLASH_SECTOR;
+        if (sector != _open) {
+            if (!halFlashErase(sector * HAL_FLASH_SECTOR)) {
+                return written;
+            }
+            _open = sector;
+
+            // Whatever the sector held from the last trip is gone
+            uint32_t first = seq - (offset % HAL_FLASH_SECTOR) / JOURNAL_RECORD_SIZE;
+            if (first + JOURNAL_RECORDS_PER_SECTOR > slots() &&
+                first + JOURNAL_RECORDS_PER_SECTOR - slots() > _oldest) {
+                _oldest = first + JOURNAL_RECORDS_PER_SECTOR - slots();
+            }
+        }
+
+        uint8_t run = 1;
+        while (i + run < count && records[i + run].seq == seq + run &&
+               (int32_t)(offsetOf(seq + run) / HAL_FLASH_SECTOR) == sector) {
+            run++;
+        }
+        for (uint8_t k = 0; k < run; k++) {
+            seal(records[i + k]);
+        }
+        if (!halFlashWrite(offset, &records[i], run * JOURNAL_RECORD_SIZE)) {
+            return written;
+        }
+        written += run;
+        _next = seq + run;
+        i += run;
+    }
+    return written;
+}
+
+bool JournalLog::read(uint32_t seq, JournalRecord& record) {
+    if (!isMounted() || seq < _oldest || seq >= _next) {
+        return false;
+    }
+    return readSlot(offsetOf(seq), record) && valid(record) && record.seq == seq;
+}
+
+const char* journalSourceName(uint8_t source) {
+    switch (source) {
+        case BUS_SOURCE_API:
+            return "api";
+        case BUS_SOURCE_BATCH:
+            return "batch";
+        case BUS_SOURCE_SEQUENCE:
+            return "sequence";
+        case BUS_SOURCE_FRAME:
+            return "frame";
+        default:
+            return "unknown";
+    }
+}
+
+static const char* commandName(uint8_t command) {
+    switch (command) {
+        case BUS_CMD_START:
+            return "start";
+        case BUS_CMD_STOP:
+            return "stop";
+        case BUS_CMD_PROGRAM:
+            return "program";
+        default:
+            return "unknown";
+    }
+}
+
+size_t journalRecordJson(const JournalRecord& record, char* out, size_t size) {
+    int len = snprintf(out, size,
+                       "{\"seq\":%u,\"time\":%u,\"uptimeMs\":%u,\"id\":%u,\"source\":\"%s\",\"controller\":%u,"
+                       "\"command\":\"%s\",\"zone\":%u,\"minutes\":%u,\"result\":%u,\"busUs\":%u}",
+                       (unsigned)record.seq, (unsigned)record.time, (unsigned)record.uptimeMs, (unsigned)record.id,
+                       journalSourceName(record.source), record.controller, commandName(record.command),
+                       record.zone, record.minutes, record.result, (unsigned)record.busUs);
+    if (len < 0 || (size_t)len >= size) {
+        return 0;
+    }
+    return len;
+}
@@ -0,0 +1,300 @@
+#include "Metrics.h"
+#include "ApiLimits.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t latencyBucketsMs[METRICS_LATENCY_BUCKETS] = METRICS_LATENCY_BUCKETS_MS;
+static const int statusCodes[METRICS_STATUS_CODE_COUNT] = METRICS_STATUS_CODES;
+
+// Route label and URL prefix, in MetricsRoute order
+static const char* const routeNames[ROUTE_COUNT] = {
+    "/api/ping",
+    "/api/status",
+    "/api/start",
+    "/api/stop",
+    "/api/batch",
+    "/api/commands",
+    "/api/zones",
+    "/api/bus/stats",
+    "/api/controllers",
+    "/api/sequence",
+    "/api/schedules",
+    "/api/time",
+    "/api/history",
+    "/api/tasks",
+    "/api/debug",
+    "/api/events",
+    "/metrics",
+    "other"
+};
+
+// Formats the exposition one line at a time. Lines before the resume point
+// are counted but not formatted, and output stops at the first line that
+// does not fit.
+class MetricsWriter {
+private:
+    char* _out;
+    size_t _size;
+    size_t _pos;
+    uint32_t _line;
+    uint32_t _from;
+    bool _full;
+
+public:
+    MetricsWriter(char* out, size_t size, uint32_t from) {
+        _out = out;
+        _size = size;
+        _pos = 0;
+        _line = 0;
+        _from = from;
+        _full = false;
+    }
+
+    void line(const char* format, ...) {
+        if (_full || _line++ < _from) {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(_out + _pos, _size - _pos, format, args);
+        va_end(args);
+        if (written < 0 || (size_t)written + 1 >= _size - _pos) {
+            _full = true;
+            _line--;
+            return;
+        }
+        _pos += written;
+        _out[_pos++] = '\n';
+    }
+
+    size_t length() { return _pos; }
+    bool full() { return _full; }
+    uint32_t next() { return _line; }
+};
+
+Metrics::Metrics() : _inFlight(0) {
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        for (int c = 0; c <= METRICS_STATUS_CODE_COUNT; c++) {
+            _requests[r][c] = 0;
+        }
+        for (int b = 0; b <= METRICS_LATENCY_BUCKETS; b++) {
+            _latency[r][b] = 0;
+        }
+        _latencySumUs[r] = 0;
+    }
+    memset(_arrivals, 0, sizeof(_arrivals));
+    _nextArrival = 0;
+}
+
+void Metrics::arrived(const void* request, uint32_t nowUs) {
+    for (uint8_t i = 0; i < METRICS_ARRIVALS; i++) {
+        if (_arrivals[i].owner == request) {
+            return;
+        }
+    }
+
+    // The oldest entry belongs to a request that was dropped mid-body
+    Arrival& arrival = _arrivals[_nextArrival];
+    if (arrival.owner != NULL) {
+        _inFlight--;
+    }
+    arrival.owner = request;
+    arrival.us = nowUs;
+    _nextArrival = (_nextArrival + 1) % METRICS_ARRIVALS;
+    _inFlight++;
+}
+
+uint32_t Metrics::handling(const void* request, uint32_t nowUs) {
+    for (uint8_t i = 0; i < METRICS_ARRIVALS; i++) {
+        if (_arrivals[i].owner == request) {
+            _arrivals[i].owner = NULL;
+            return _arrivals[i].us;
+        }
+    }
+    _inFlight++;
+    return nowUs;
+}
+
+void Metrics::finished(MetricsRoute route, int code, uint32_t latencyUs) {
+    if (route >= ROUTE_COUNT) {
+        route = ROUTE_OTHER;
+    }
+
+    int c = 0;
+    while (c < METRICS_STATUS_CODE_COUNT && statusCodes[c] != code) {
+        c++;
+    }
+    _requests[route][c]++;
+
+    int b = 0;
+    while (b < METRICS_LATENCY_BUCKETS && latencyUs > latencyBucketsMs[b] * 1000) {
+        b++;
+    }
+    _latency[route][b]++;
+    _latencySumUs[route] += latencyUs;
+    _inFlight--;
+}
+
+uint32_t Metrics::requests(MetricsRoute route) {
+    if (route >= ROUTE_COUNT) {
+        return 0;
+    }
+    uint32_t count = 0;
+    for (int c = 0; c <= METRICS_STATUS_CODE_COUNT; c++) {
+        count += _requests[route][c];
+    }
+    return count;
+}
+
+void Metrics::beginScrape(MetricsScrape& scrape) {
+    scrape.line = 0;
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        scrape.codes[r] = 0;
+        for (int c = 0; c <= METRICS_STATUS_CODE_COUNT; c++) {
+            if (_requests[r][c] != 0) {
+                scrape.codes[r] |= 1 << c;
+            }
+        }
+    }
+}
+
+size_t Metrics::write(char* out, size_t size, MetricsScrape& scrape, const MetricsGauges& gauges) {
+    MetricsWriter w(out, size, scrape.line);
+
+    w.line("# HELP isprinklr_http_requests_total HTTP requests by route and status code.");
+    w.line("# TYPE isprinklr_http_requests_total counter");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        for (int c = 0; c <= METRICS_STATUS_CODE_COUNT; c++) {
+            if (!(scrape.codes[r] & (1 << c))) {
+                continue;
+            }
+            uint32_t count = _requests[r][c];
+            if (c < METRICS_STATUS_CODE_COUNT) {
+                w.line("isprinklr_http_requests_total{route=\"%s\",code=\"%d\"} %u", routeNames[r], statusCodes[c], (unsigned)count);
+            } else {
+                w.line("isprinklr_http_requests_total{route=\"%s\",code=\"other\"} %u", routeNames[r], (unsigned)count);
+            }
+        }
+    }
+
+    w.line("# HELP isprinklr_http_request_duration_seconds Time from request arrival to response.");
+    w.line("# TYPE isprinklr_http_request_duration_seconds histogram");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        if (scrape.codes[r] == 0) {
+            continue;
+        }
+        uint32_t buckets[METRICS_LATENCY_BUCKETS + 1];
+        uint32_t count = 0;
+        for (int b = 0; b <= METRICS_LATENCY_BUCKETS; b++) {
+            buckets[b] = _latency[r][b];
+            count += buckets[b];
+        }
+
+        uint32_t cumulative = 0;
+        for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+            cumulative += buckets[b];
+            w.line("isprinklr_http_request_duration_seconds_bucket{route=\"%s\",le=\"%u.%03u\"} %u", routeNames[r],
+                   (unsigned)(latencyBucketsMs[b] / 1000), (unsigned)(latencyBucketsMs[b] % 1000), (unsigned)cumulative);
+        }
+        w.line("isprinklr_http_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %u", routeNames[r], (unsigned)count);
+        uint64_t sumUs = _latencySumUs[r];
+        w.line("isprinklr_http_request_duration_seconds_sum{route=\"%s\"} %lu.%06u", routeNames[r],
+               (unsigned long)(sumUs / 1000000), (unsigned)(sumUs % 1000000));
+        w.line("isprinklr_http_request_duration_seconds_count{route=\"%s\"} %u", routeNames[r], (unsigned)count);
+    }
+
+    w.line("# HELP isprinklr_http_requests_in_flight Requests received and not yet answered.");
+    w.line("# TYPE isprinklr_http_requests_in_flight gauge");
+    w.line("isprinklr_http_requests_in_flight %d", (int)_inFlight);
+
+    w.line("# HELP isprinklr_bus_frames_total SmartPort frames sent, including failed ones.");
+    w.line("# TYPE isprinklr_bus_frames_total counter");
+    for (uint8_t i = 0; i < gauges.controllers; i++) {
+        w.line("isprinklr_bus_frames_total{controller=\"%u\"} %u", i, (unsigned)gauges.bus[i].frames);
+    }
+    w.line("# HELP isprinklr_bus_busy_seconds_total Time the SmartPort bus spent transmitting.");
+    w.line("# TYPE isprinklr_bus_busy_seconds_total counter");
+    for (uint8_t i = 0; i < gauges.controllers; i++) {
+        uint64_t busyUs = gauges.bus[i].busyUs;
+        w.line("isprinklr_bus_busy_seconds_total{controller=\"%u\"} %lu.%06u", i,
+               (unsigned long)(busyUs / 1000000), (unsigned)(busyUs % 1000000));
+    }
+    w.line("# HELP isprinklr_bus_queue_depth Commands waiting for the SmartPort bus.");
+    w.line("# TYPE isprinklr_bus_queue_depth gauge");
+    for (uint8_t i = 0; i < gauges.controllers; i++) {
+        w.line("isprinklr_bus_queue_depth{controller=\"%u\"} %u", i, (unsigned)gauges.bus[i].queueDepth);
+    }
+
+    w.line("# HELP isprinklr_heap_free_bytes Free heap.");
+    w.line("# TYPE isprinklr_heap_free_bytes gauge");
+    w.line("isprinklr_heap_free_bytes %u", (unsigned)gauges.freeHeap);
+    w.line("# HELP isprinklr_heap_min_free_bytes Lowest free heap since boot.");
+    w.line("# TYPE isprinklr_heap_min_free_bytes gauge");
+    w.line("isprinklr_heap_min_free_bytes %u", (unsigned)gauges.minFreeHeap);
+    w.line("# HELP isprinklr_heap_largest_free_block_bytes Largest block the heap can allocate.");
+    w.line("# TYPE isprinklr_heap_largest_free_block_bytes gauge");
+    w.line("isprinklr_heap_largest_free_block_bytes %u", (unsigned)gauges.largestFreeBlock);
+    w.line("# HELP isprinklr_heap_alloc_failures_total Heap allocations that found no block big enough.");
+    w.line("# TYPE isprinklr_heap_alloc_failures_total counter");
+    w.line("isprinklr_heap_alloc_failures_total %u", (unsigned)gauges.allocFailures);
+    w.line("# HELP isprinklr_http_allocations_total Heap allocations made by the handlers of each route.");
+    w.line("# TYPE isprinklr_http_allocations_total counter");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        if (scrape.codes[r] != 0) {
+            w.line("isprinklr_http_allocations_total{route=\"%s\"} %u", routeNames[r], (unsigned)gauges.allocations[r]);
+        }
+    }
+    w.line("# HELP isprinklr_http_allocated_bytes_total Bytes allocated by the handlers of each route.");
+    w.line("# TYPE isprinklr_http_allocated_bytes_total counter");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        if (scrape.codes[r] != 0) {
+            w.line("isprinklr_http_allocated_bytes_total{route=\"%s\"} %u", routeNames[r], (unsigned)gauges.allocatedBytes[r]);
+        }
+    }
+
+    w.line("# HELP isprinklr_network_reconnects_total Times an interface got an IP back after losing it.");
+    w.line("# TYPE isprinklr_network_reconnects_total counter");
+    w.line("isprinklr_network_reconnects_total{interface=\"ethernet\"} %u", (unsigned)gauges.ethernetReconnects);
+    w.line("isprinklr_network_reconnects_total{interface=\"wifi\"} %u", (unsigned)gauges.wifiReconnects);
+
+    w.line("# HELP isprinklr_idempotency_lookups_total Start and stop requests that carried an Idempotency-Key.");
+    w.line("# TYPE isprinklr_idempotency_lookups_total counter");
+    w.line("isprinklr_idempotency_lookups_total{result=\"hit\"} %u", (unsigned)gauges.idempotencyHits);
+    w.line("isprinklr_idempotency_lookups_total{result=\"miss\"} %u", (unsigned)gauges.idempotencyMisses);
+    w.line("isprinklr_idempotency_lookups_total{result=\"mismatch\"} %u", (unsigned)gauges.idempotencyMismatches);
+
+    w.line("# HELP isprinklr_journal_dropped_total Finished commands missing from the command journal.");
+    w.line("# TYPE isprinklr_journal_dropped_total counter");
+    w.line("isprinklr_journal_dropped_total %u", (unsigned)gauges.journalDropped);
+
+    w.line("# HELP isprinklr_boot_milestone_seconds Uptime at which each boot milestone was reached.");
+    w.line("# TYPE isprinklr_boot_milestone_seconds gauge");
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+        if (gauges.bootMs[i] != 0) {
+            w.line("isprinklr_boot_milestone_seconds{milestone=\"%s\"} %u.%03u", bootMilestoneName((BootMilestone)i),
+                   (unsigned)(gauges.bootMs[i] / 1000), (unsigned)(gauges.bootMs[i] % 1000));
+        }
+    }
+
+    scrape.line = w.next();
+    if (w.length() == 0 && w.full()) {
+        // Too little room this time, the scrape is not over
+        return RESPONSE_TRY_AGAIN;
+    }
+    return w.length();
+}
+
+MetricsRoute Metrics::route(const char* url) {
+    for (int r = 0; r < ROUTE_OTHER; r++) {
+        size_t len = strlen(routeNames[r]);
+        if (strncmp(url, routeNames[r], len) == 0 && (url[len] == '\0' || url[len] == '/')) {
+            return (MetricsRoute)r;
+        }
+    }
+    return ROUTE_OTHER;
+}
+
+const char* Metrics::routeName(MetricsRoute route) {
+    return route < ROUTE_COUNT ? routeNames[route] : routeNames[ROUTE_OTHER];
+}
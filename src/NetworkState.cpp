@@ -0,0 +1,189 @@
+#include "NetworkState.h"
+#include "Hal.h"
+
+NetworkState::NetworkState() {
+    Link* links[] = { &_eth, &_wifi };
+    for (Link* link : links) {
+        link->phase = LINK_DOWN;
+        link->upMs = 0;
+        link->downMs = 0;
+        link->reconnects = 0;
+        link->attempts = 0;
+        link->seen = false;
+    }
+    _lastChangeMs = 0;
+    _lastActive = NET_LINK_NONE;
+    _failovers = 0;
+    _failbacks = 0;
+}
+
+NetworkState::Link* NetworkState::find(NetworkLink link) {
+    switch (link) {
+    case NET_LINK_ETHERNET:
+        return &_eth;
+    case NET_LINK_WIFI:
+        return &_wifi;
+    default:
+        return NULL;
+    }
+}
+
+const NetworkState::Link* NetworkState::find(NetworkLink link) const {
+    return const_cast<NetworkState*>(this)->find(link);
+}
+
+void NetworkState::setPhase(Link& link, LinkPhase phase) {
+    uint32_t now = halMillis();
+    LinkPhase was = (LinkPhase)link.phase.exchange(phase);
+    if (was == phase) {
+        return;
+    }
+    if (phase == LINK_UP) {
+        if (link.seen) {
+            link.reconnects++;
+        }
+        link.seen = true;
+        link.attempts = 0;
+        link.upMs = now;
+    } else if (was == LINK_UP) {
+        link.downMs = now;
+    }
+    if (was == LINK_UP || phase == LINK_UP) {
+        updateActive();
+    }
+    _lastChangeMs = now;
+}
+
+void NetworkState::updateActive() {
+    // A gap with neither link up still counts, traffic moves once one is back
+    NetworkLink active = activeLink();
+    if (active == NET_LINK_NONE) {
+        return;
+    }
+    uint8_t was = _lastActive.exchange(active);
+    if (was == NET_LINK_ETHERNET && active == NET_LINK_WIFI) {
+        _failovers++;
+    } else if (was == NET_LINK_WIFI && active == NET_LINK_ETHERNET && _failbacks < _failovers) {
+        // Ethernet coming up after WiFi at boot is not a failback
+        _failbacks++;
+    }
+}
+
+void NetworkState::linkDown(Link& link) {
+    // A failed attempt takes the link down too, the retry is already planned
+    if (link.phase != LINK_BACKOFF) {
+        setPhase(link, LINK_DOWN);
+    }
+}
+
+void NetworkState::onEvent(NetworkEvent event) {
+    switch (event) {
+    case NET_EVENT_ETH_LINK_UP:
+    case NET_EVENT_ETH_LOST_IP:
+        setPhase(_eth, LINK_CONNECTING);
+        break;
+    case NET_EVENT_ETH_GOT_IP:
+        setPhase(_eth, LINK_UP);
+        break;
+    case NET_EVENT_ETH_LINK_DOWN:
+        linkDown(_eth);
+        break;
+    case NET_EVENT_WIFI_LINK_UP:
+    case NET_EVENT_WIFI_LOST_IP:
+        setPhase(_wifi, LINK_CONNECTING);
+        break;
+    case NET_EVENT_WIFI_GOT_IP:
+        setPhase(_wifi, LINK_UP);
+        break;
+    case NET_EVENT_WIFI_LINK_DOWN:
+        linkDown(_wifi);
+        break;
+    default:
+        break;
+    }
+}
+
+uint32_t NetworkState::failed(NetworkLink link) {
+    Link* l = find(link);
+    if (l == NULL) {
+        return NETWORK_RETRY_MIN_MS;
+    }
+
+    // An address that arrived in the meantime wins
+    uint8_t attempts = l->attempts;
+    if (attempts < 255) {
+        attempts++;
+    }
+    l->attempts = attempts;
+    uint8_t phase = l->phase;
+    if (phase != LINK_UP && l->phase.compare_exchange_strong(phase, LINK_BACKOFF)) {
+        _lastChangeMs = halMillis();
+    }
+    return backoffMs(attempts);
+}
+
+void NetworkState::retrying(NetworkLink link) {
+    Link* l = find(link);
+    if (l == NULL) {
+        return;
+    }
+    uint8_t phase = l->phase;
+    if (phase != LINK_UP && phase != LINK_CONNECTING && l->phase.compare_exchange_strong(phase, LINK_CONNECTING)) {
+        _lastChangeMs = halMillis();
+    }
+}
+
+LinkStatus NetworkState::status(NetworkLink link) const {
+    LinkStatus status = { LINK_DOWN, 0, 0, 0, 0 };
+    const Link* l = find(link);
+    if (l != NULL) {
+        status.phase = (LinkPhase)l->phase.load();
+        status.upMs = l->upMs;
+        status.downMs = l->downMs;
+        status.reconnects = l->reconnects;
+        status.attempts = l->attempts;
+    }
+    return status;
+}
+
+NetworkLink NetworkState::activeLink() const {
+    if (ethernetUp()) {
+        return NET_LINK_ETHERNET;
+    } else if (wifiUp()) {
+        return NET_LINK_WIFI;
+    } else {
+        return NET_LINK_NONE;
+    }
+}
+
+const char* NetworkState::typeName() const {
+    switch (activeLink()) {
+    case NET_LINK_ETHERNET:
+        return "Ethernet";
+    case NET_LINK_WIFI:
+        return "WiFi";
+    default:
+        return "Disconnected";
+    }
+}
+
+uint32_t NetworkState::backoffMs(uint8_t attempts) {
+    uint32_t delay = NETWORK_RETRY_MIN_MS;
+    for (uint8_t i = 1; i < attempts && delay < NETWORK_RETRY_MAX_MS; i++) {
+        delay *= 2;
+    }
+    return delay < NETWORK_RETRY_MAX_MS ? delay : NETWORK_RETRY_MAX_MS;
+}
+
+const char* NetworkState::phaseName(LinkPhase phase) {
+    switch (phase) {
+    case LINK_CONNECTING:
+        return "connecting";
+    case LINK_UP:
+        return "up";
+    case LINK_BACKOFF:
+        return "backoff";
+    default:
+        return "down";
+    }
+}
@@ -0,0 +1,38 @@
+#include "ResponsePool.h"
+
+ResponsePool::ResponsePool() : _exhausted(0) {
+    for (size_t i = 0; i < RESPONSE_POOL_SLOTS; i++) {
+        _used[i] = false;
+    }
+}
+
+char* ResponsePool::acquire() {
+    for (size_t i = 0; i < RESPONSE_POOL_SLOTS; i++) {
+        bool expected = false;
+        if (_used[i].compare_exchange_strong(expected, true)) {
+            return _slots[i];
+        }
+    }
+    _exhausted++;
+    return NULL;
+}
+
+void ResponsePool::release(char* slot) {
+    if (slot == NULL) {
+        return;
+    }
+    size_t index = (slot - _slots[0]) / RESPONSE_SLOT_SIZE;
+    if (index < RESPONSE_POOL_SLOTS && slot == _slots[index]) {
+        _used[index] = false;
+    }
+}
+
+size_t ResponsePool::inUse() {
+    size_t count = 0;
+    for (size_t i = 0; i < RESPONSE_POOL_SLOTS; i++) {
+        if (_used[i]) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,83 @@
+#include "ScheduleQueue.h"
+
+time_t scheduleNextRun(const Schedule& schedule, time_t after) {
+    if ((schedule.days & 0x7f) == 0) {
+        return 0;
+    }
+
+    struct tm today;
+    localtime_r(&after, &today);
+
+    // Today and the next seven days cover every day of the week once more.
+    // mktime normalises the day of month and works out the UTC offset of the
+    // candidate itself, so a start across a DST change keeps its wall time.
+    for (int offset = 0; offset <= 7; offset++) {
+        struct tm candidate = today;
+        candidate.tm_mday += offset;
+        candidate.tm_hour = schedule.startMinute / 60;
+        candidate.tm_min = schedule.startMinute % 60;
+        candidate.tm_sec = 0;
+        candidate.tm_isdst = -1;
+        time_t at = mktime(&candidate);
+        if (at > after && (schedule.days & (1 << candidate.tm_wday))) {
+            return at;
+        }
+    }
+    return 0;
+}
+
+void ScheduleQueue::swap(uint8_t a, uint8_t b) {
+    ScheduleEntry entry = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = entry;
+}
+
+bool ScheduleQueue::push(time_t at, uint8_t slot) {
+    if (_count == SCHEDULE_MAX) {
+        return false;
+    }
+
+    uint8_t i = _count++;
+    _heap[i].at = at;
+    _heap[i].slot = slot;
+    while (i > 0 && _heap[(i - 1) / 2].at > _heap[i].at) {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    return true;
+}
+
+bool ScheduleQueue::peek(ScheduleEntry& entry) {
+    if (_count == 0) {
+        return false;
+    }
+    entry = _heap[0];
+    return true;
+}
+
+bool ScheduleQueue::popDue(time_t now, ScheduleEntry& entry) {
+    if (_count == 0 || _heap[0].at > now) {
+        return false;
+    }
+
+    entry = _heap[0];
+    _heap[0] = _heap[--_count];
+    uint8_t i = 0;
+    while (true) {
+        uint8_t smallest = i;
+        uint8_t left = 2 * i + 1;
+        uint8_t right = left + 1;
+        if (left < _count && _heap[left].at < _heap[smallest].at) {
+            smallest = left;
+        }
+        if (right < _count && _heap[right].at < _heap[smallest].at) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        swap(i, smallest);
+        i = smallest;
+    }
+    return true;
+}
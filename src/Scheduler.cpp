@@ -0,0 +1,272 @@
+#include "Scheduler.h"
+#include <Preferences.h>
+#include <sys/time.h>
+#include "esp_sntp.h"
+
+volatile TimeSource Scheduler::_source = TIME_NONE;
+
+Scheduler::Scheduler(SequenceRunner& sequence) : _sequence(sequence) {
+    memset(_schedules, 0, sizeof(_schedules));
+    _mutex = NULL;
+    _timer = NULL;
+    _lastTick = 0;
+    _retrySlot = SCHEDULE_MAX;
+    strcpy(_tz, SCHEDULE_TZ);
+}
+
+void Scheduler::begin() {
+    _mutex = xSemaphoreCreateMutex();
+    _timer = xTimerCreate("schedule", pdMS_TO_TICKS(SCHEDULE_TICK_MS), pdTRUE, this, timerCallback);
+    if (_mutex == NULL || _timer == NULL) {
+        Serial.println("ERROR: Failed to create scheduler timer!");
+        return;
+    }
+
+    Preferences prefs;
+    if (prefs.begin(SCHEDULE_PREFS_NAMESPACE, true)) {
+        // Tables saved before the version was stored have the first layout
+        uint8_t version = prefs.getUChar(SCHEDULE_PREFS_VERSION, 1);
+        if (version == SCHEDULE_TABLE_VERSION && prefs.getBytesLength(SCHEDULE_PREFS_TABLE) == sizeof(_schedules)) {
+            prefs.getBytes(SCHEDULE_PREFS_TABLE, _schedules, sizeof(_schedules));
+            for (uint8_t i = 0; i < SCHEDULE_MAX; i++) {
+                if (_schedules[i].count > SCHEDULE_MAX_STEPS) {
+                    _schedules[i].used = false;
+                }
+            }
+        } else if (prefs.isKey(SCHEDULE_PREFS_TABLE)) {
+            Serial.println("ERROR: Stored schedules do not match this firmware, ignoring them");
+        }
+        if (prefs.isKey(SCHEDULE_PREFS_TZ)) {
+            prefs.getString(SCHEDULE_PREFS_TZ, _tz, sizeof(_tz));
+        }
+        prefs.end();
+    }
+
+    // SNTP keeps retrying in the background until the network is up
+    sntp_set_time_sync_notification_cb(onTimeSync);
+    configTzTime(_tz, SCHEDULE_NTP_SERVER);
+    xTimerStart(_timer, 0);
+}
+
+void Scheduler::timerCallback(TimerHandle_t timer) {
+    static_cast<Scheduler*>(pvTimerGetTimerID(timer))->onTick();
+}
+
+void Scheduler::onTimeSync(struct timeval* tv) {
+    _source = TIME_SNTP;
+}
+
+void Scheduler::onTick() {
+    time_t now = time(NULL);
+    if (now < SCHEDULE_MIN_EPOCH) {
+        return;
+    }
+    if (xSemaphoreTake(_mutex, 0) != pdTRUE) {
+        return;
+    }
+
+    if (_lastTick == 0 || now < _lastTick || now - _lastTick > SCHEDULE_CLOCK_STEP_S) {
+        rebuild(now);
+    }
+    _lastTick = now;
+
+    // One start per tick, a second schedule due at the same time follows a tick later
+    ScheduleEntry entry;
+    Schedule run;
+    bool retry = false;
+    bool due = _queue.popDue(now, entry);
+    if (due) {
+        run = _schedules[entry.slot];
+        _queue.push(scheduleNextRun(run, now), entry.slot);
+    } else if (_retrySlot < SCHEDULE_MAX) {
+        entry.slot = _retrySlot;
+        run = _schedules[entry.slot];
+        due = run.used && run.enabled;
+        retry = true;
+    }
+    _retrySlot = SCHEDULE_MAX;
+    xSemaphoreGive(_mutex);
+
+    if (due) {
+        Serial.print("Running schedule ");
+        Serial.println(entry.slot + 1);
+        // On the timer task, so the run list lock is not waited for
+        if (_sequence.start(run.steps, run.count, 0) != 0) {
+            return;
+        }
+        if (!retry) {
+            // The run list was locked by a request, try once more on the next tick
+            Serial.println("Sequence runner busy, retrying the schedule");
+            _retrySlot = entry.slot;
+        } else {
+            Serial.println("ERROR: Sequence runner refused the schedule");
+        }
+    }
+}
+
+void Scheduler::rebuild(time_t now) {
+    _queue.clear();
+    for (uint8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (_schedules[i].used && _schedules[i].enabled) {
+            time_t next = scheduleNextRun(_schedules[i], now);
+            if (next != 0) {
+                _queue.push(next, i);
+            }
+        }
+    }
+}
+
+void Scheduler::save() {
+    // Write a copy, so the tick is not held up by the flash write
+    Schedule table[SCHEDULE_MAX];
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    memcpy(table, _schedules, sizeof(table));
+    xSemaphoreGive(_mutex);
+
+    Preferences prefs;
+    if (!prefs.begin(SCHEDULE_PREFS_NAMESPACE, false)) {
+        Serial.println("ERROR: Failed to save schedules!");
+        return;
+    }
+    prefs.putUChar(SCHEDULE_PREFS_VERSION, SCHEDULE_TABLE_VERSION);
+    prefs.putBytes(SCHEDULE_PREFS_TABLE, table, sizeof(table));
+    prefs.end();
+}
+
+bool Scheduler::get(uint8_t id, Schedule& schedule, time_t& next) {
+    if (_mutex == NULL || id < 1 || id > SCHEDULE_MAX) {
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    schedule = _schedules[id - 1];
+    time_t now = time(NULL);
+    next = 0;
+    if (schedule.used && schedule.enabled && now >= SCHEDULE_MIN_EPOCH) {
+        next = scheduleNextRun(schedule, now);
+    }
+    xSemaphoreGive(_mutex);
+    return schedule.used;
+}
+
+ScheduleResult Scheduler::add(const Schedule& schedule, uint8_t& id) {
+    if (_mutex == NULL) {
+        return SCHEDULE_FULL;
+    }
+
+    ScheduleResult result = SCHEDULE_FULL;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (!_schedules[i].used) {
+            _schedules[i] = schedule;
+            _schedules[i].used = true;
+            _lastTick = 0;
+            id = i + 1;
+            result = SCHEDULE_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+
+    if (result == SCHEDULE_OK) {
+        save();
+    }
+    return result;
+}
+
+ScheduleResult Scheduler::replace(uint8_t id, const Schedule& schedule) {
+    if (_mutex == NULL || id < 1 || id > SCHEDULE_MAX) {
+        return SCHEDULE_NOT_FOUND;
+    }
+
+    ScheduleResult result = SCHEDULE_NOT_FOUND;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_schedules[id - 1].used) {
+        _schedules[id - 1] = schedule;
+        _schedules[id - 1].used = true;
+        _lastTick = 0;
+        result = SCHEDULE_OK;
+    }
+    xSemaphoreGive(_mutex);
+
+    if (result == SCHEDULE_OK) {
+        save();
+    }
+    return result;
+}
+
+ScheduleResult Scheduler::remove(uint8_t id) {
+    if (_mutex == NULL || id < 1 || id > SCHEDULE_MAX) {
+        return SCHEDULE_NOT_FOUND;
+    }
+
+    ScheduleResult result = SCHEDULE_NOT_FOUND;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_schedules[id - 1].used) {
+        memset(&_schedules[id - 1], 0, sizeof(Schedule));
+        _lastTick = 0;
+        result = SCHEDULE_OK;
+    }
+    xSemaphoreGive(_mutex);
+
+    if (result == SCHEDULE_OK) {
+        save();
+    }
+    return result;
+}
+
+void Scheduler::setTime(time_t epoch) {
+    struct timeval tv = { epoch, 0 };
+    settimeofday(&tv, NULL);
+    _source = TIME_MANUAL;
+    Serial.print("Clock set manually to ");
+    Serial.println((uint32_t)epoch);
+}
+
+void Scheduler::setTimeZone(const char* tz) {
+    if (_mutex == NULL) {
+        return;
+    }
+
+    // Start times are local, so every one of them moves
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    strlcpy(_tz, tz, sizeof(_tz));
+    setenv("TZ", _tz, 1);
+    tzset();
+    _lastTick = 0;
+    xSemaphoreGive(_mutex);
+
+    Preferences prefs;
+    if (!prefs.begin(SCHEDULE_PREFS_NAMESPACE, false)) {
+        Serial.println("ERROR: Failed to save time zone!");
+        return;
+    }
+    prefs.putString(SCHEDULE_PREFS_TZ, tz);
+    prefs.end();
+}
+
+SchedulerClock Scheduler::clock() {
+    SchedulerClock clock;
+    clock.now = time(NULL);
+    clock.valid = clock.now >= SCHEDULE_MIN_EPOCH;
+    clock.source = _source;
+    if (_mutex != NULL) {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+    }
+    strcpy(clock.tz, _tz);
+    if (_mutex != NULL) {
+        xSemaphoreGive(_mutex);
+    }
+    return clock;
+}
+
+const char* Scheduler::sourceName(TimeSource source) {
+    switch (source) {
+        case TIME_SNTP:
+            return "sntp";
+        case TIME_MANUAL:
+            return "manual";
+        default:
+            return "none";
+    }
+}
@@ -0,0 +1,251 @@
+#include "SequenceRunner.h"
+
+SequenceRunner::SequenceRunner(BusWorker& bus) : _bus(bus) {
+    _timer = NULL;
+    _mutex = NULL;
+    _count = 0;
+    _current = 0;
+    _state = SEQ_IDLE;
+    _id = 0;
+    _stepEndMs = 0;
+    _pausedRemainingMs = 0;
+    _pendingStart = false;
+    _pendingMs = 0;
+    _stopAtEnd = false;
+}
+
+void SequenceRunner::begin() {
+    _mutex = xSemaphoreCreateMutex();
+    _timer = xTimerCreate("sequence", pdMS_TO_TICKS(SEQUENCE_RETRY_MS), pdFALSE, this, timerCallback);
+    if (_mutex == NULL || _timer == NULL) {
+        Serial.println("ERROR: Failed to create sequence timer!");
+    }
+}
+
+uint32_t SequenceRunner::start(const SequenceStep* steps, uint8_t count, uint32_t waitMs) {
+    if (_mutex == NULL || _timer == NULL || count == 0 || count > SEQUENCE_MAX_STEPS) {
+        return 0;
+    }
+
+    if (xSemaphoreTake(_mutex, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+        Serial.println("ERROR: Sequence runner busy");
+        return 0;
+    }
+    xTimerStop(_timer, 0);
+    memcpy(_steps, steps, count * sizeof(SequenceStep));
+    _count = count;
+    _id++;
+    if (_id == 0) {
+        _id = 1;
+    }
+    _state = SEQ_RUNNING;
+
+    // Starting the first zone replaces whatever the controller is running
+    startStep(0, _steps[0].minutes * 60000UL);
+    uint32_t id = _id;
+    xSemaphoreGive(_mutex);
+
+    Serial.print("Sequence started with ");
+    Serial.print(count);
+    Serial.println(" steps");
+    return id;
+}
+
+SequenceResult SequenceRunner::cancel() {
+    if (_mutex == NULL) {
+        return SEQ_NOT_ACTIVE;
+    }
+
+    SequenceResult result = SEQ_OK;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state != SEQ_RUNNING && _state != SEQ_PAUSED) {
+        result = SEQ_NOT_ACTIVE;
+    } else if (_state == SEQ_RUNNING && !stopCurrent()) {
+        result = SEQ_BUS_BUSY;
+    } else {
+        xTimerStop(_timer, 0);
+        _state = SEQ_CANCELLED;
+    }
+    xSemaphoreGive(_mutex);
+    return result;
+}
+
+SequenceResult SequenceRunner::pause() {
+    if (_mutex == NULL) {
+        return SEQ_NOT_ACTIVE;
+    }
+
+    SequenceResult result = SEQ_OK;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state != SEQ_RUNNING) {
+        result = SEQ_NOT_ACTIVE;
+    } else {
+        uint32_t remaining = remainingMs();
+        if (!stopCurrent()) {
+            result = SEQ_BUS_BUSY;
+        } else {
+            xTimerStop(_timer, 0);
+            _pausedRemainingMs = remaining;
+            _pendingStart = false;
+            _state = SEQ_PAUSED;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return result;
+}
+
+SequenceResult SequenceRunner::resume() {
+    if (_mutex == NULL) {
+        return SEQ_NOT_ACTIVE;
+    }
+
+    SequenceResult result = SEQ_OK;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state != SEQ_PAUSED) {
+        result = SEQ_NOT_ACTIVE;
+    } else {
+        _state = SEQ_RUNNING;
+        startStep(_current, _pausedRemainingMs);
+    }
+    xSemaphoreGive(_mutex);
+    return result;
+}
+
+SequenceResult SequenceRunner::skip() {
+    if (_mutex == NULL) {
+        return SEQ_NOT_ACTIVE;
+    }
+
+    SequenceResult result = SEQ_OK;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_state != SEQ_RUNNING && _state != SEQ_PAUSED) {
+        result = SEQ_NOT_ACTIVE;
+    } else if (_current + 1 < _count) {
+        // Starting the next zone replaces the current one
+        _state = SEQ_RUNNING;
+        startStep(_current + 1, _steps[_current + 1].minutes * 60000UL);
+    } else if (_state == SEQ_RUNNING && !stopCurrent()) {
+        result = SEQ_BUS_BUSY;
+    } else {
+        xTimerStop(_timer, 0);
+        _state = SEQ_DONE;
+    }
+    xSemaphoreGive(_mutex);
+    return result;
+}
+
+SequenceProgress SequenceRunner::progress() {
+    SequenceProgress progress;
+    memset(&progress, 0, sizeof(progress));
+    if (_mutex == NULL) {
+        return progress;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    progress.id = _id;
+    progress.state = _state;
+    progress.step = _current;
+    progress.steps = _count;
+    if (_count > 0) {
+        progress.zone = _steps[_current].zone;
+    }
+    if (_state == SEQ_RUNNING || _state == SEQ_PAUSED) {
+        progress.remainingMs = remainingMs();
+        progress.totalRemainingMs = progress.remainingMs;
+        for (uint8_t i = _current + 1; i < _count; i++) {
+            progress.totalRemainingMs += _steps[i].minutes * 60000UL;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return progress;
+}
+
+const char* SequenceRunner::stateName(SequenceState state) {
+    switch (state) {
+        case SEQ_RUNNING:
+            return "running";
+        case SEQ_PAUSED:
+            return "paused";
+        case SEQ_DONE:
+            return "done";
+        case SEQ_CANCELLED:
+            return "cancelled";
+        default:
+            return "idle";
+    }
+}
+
+void SequenceRunner::timerCallback(TimerHandle_t timer) {
+    static_cast<SequenceRunner*>(pvTimerGetTimerID(timer))->onTimer();
+}
+
+// Runs on the FreeRTOS timer task, must not block
+void SequenceRunner::onTimer() {
+    if (xSemaphoreTake(_mutex, 0) != pdTRUE) {
+        // A request holds the run list, try again shortly
+        armTimer(SEQUENCE_LOCK_RETRY_MS);
+        return;
+    }
+    if (_state == SEQ_RUNNING) {
+        uint32_t remaining = remainingMs();
+        if (_pendingStart) {
+            startStep(_current, _pendingMs);
+        } else if (remaining > 0) {
+            // A lock retry fired after a request had already re-armed the step
+            armTimer(remaining);
+        } else if (_current + 1 < _count) {
+            startStep(_current + 1, _steps[_current + 1].minutes * 60000UL);
+        } else if (_stopAtEnd && !stopCurrent()) {
+            // The controller would run on to the end of the minute, keep trying
+            armTimer(SEQUENCE_RETRY_MS);
+        } else {
+            // Otherwise the controller stops the last zone on its own
+            _state = SEQ_DONE;
+            Serial.println("Sequence complete");
+        }
+    }
+    xSemaphoreGive(_mutex);
+}
+
+// Called with the mutex held
+void SequenceRunner::startStep(uint8_t index, uint32_t durationMs) {
+    _current = index;
+    uint8_t minutes = (durationMs + 59999) / 60000;
+    if (_bus.submit(BUS_CMD_START, _steps[index].zone, minutes, BUS_SOURCE_SEQUENCE) == 0) {
+        // Bus queue full, keep the time left and try again shortly
+        _pendingStart = true;
+        _pendingMs = durationMs;
+        armTimer(SEQUENCE_RETRY_MS);
+        return;
+    }
+    _pendingStart = false;
+    _stopAtEnd = durationMs % 60000 != 0;
+    _stepEndMs = millis() + durationMs;
+    armTimer(durationMs);
+}
+
+// Called with the mutex held
+bool SequenceRunner::stopCurrent() {
+    if (_pendingStart) {
+        return true;
+    }
+    return _bus.submit(BUS_CMD_STOP, _steps[_current].zone, 0, BUS_SOURCE_SEQUENCE) != 0;
+}
+
+// Called with the mutex held
+uint32_t SequenceRunner::remainingMs() {
+    if (_state == SEQ_PAUSED) {
+        return _pausedRemainingMs;
+    }
+    if (_pendingStart) {
+        return _pendingMs;
+    }
+    int32_t remaining = (int32_t)(_stepEndMs - millis());
+    return remaining > 0 ? remaining : 0;
+}
+
+void SequenceRunner::armTimer(uint32_t ms) {
+    if (xTimerChangePeriod(_timer, pdMS_TO_TICKS(ms > 0 ? ms : 1), 0) != pdPASS) {
+        Serial.println("ERROR: Failed to arm sequence timer!");
+    }
+}
@@ -0,0 +1,187 @@
+#include "StatusCache.h"
+#include <WiFi.h>
+#include <ETH.h>
+#include "esp_system.h"
+#include "esp_chip_info.h"
+#include "esp_heap_caps.h"
+#ifdef ESP_IDF_VERSION_MAJOR
+#include "esp_idf_version.h"
+#endif
+#include "iSprinklrNetwork.h"
+#include "HeapStats.h"
+
+StatusCache::StatusCache(ControllerRegistry& controllers) : _controllers(controllers) {
+    memset(&_status, 0, sizeof(_status));
+    _body[0] = '\0';
+    _length = 0;
+    _etag[0] = '\0';
+    _refreshedMs = 0;
+    _networkChangeMs = 0;
+    _networkValid = false;
+}
+
+void StatusCache::begin() {
+    collectStatic();
+}
+
+bool StatusCache::refresh() {
+    uint32_t now = millis();
+    if (_length > 0 && now - _refreshedMs < STATUS_REFRESH_MS) {
+        return true;
+    }
+
+    collectNetwork();
+    collectDynamic();
+
+    _length = writeStatusResponse(_body, sizeof(_body), _status);
+    if (_length == 0) {
+        return false;
+    }
+    writeEtag(_etag, sizeof(_etag), _body, _length);
+    _refreshedMs = now;
+    return true;
+}
+
+void StatusCache::collectStatic() {
+    // ESP Chip Information
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+    
+    // Set chip model
+    switch(chip_info.model) {
+        case CHIP_ESP32:
+            _status.chipModel = "ESP32";
+            break;
+        case CHIP_ESP32S2:
+            _status.chipModel = "ESP32-S2";
+            break;
+        case CHIP_ESP32S3:
+            _status.chipModel = "ESP32-S3";
+            break;
+        case CHIP_ESP32C3:
+            _status.chipModel = "ESP32-C3";
+            break;
+        default:
+            _status.chipModel = "Unknown";
+    }
+    
+    _status.chipRevision = chip_info.revision;
+    _status.chipCores = chip_info.cores;
+    
+    // ESP-IDF Version
+    #ifdef ESP_IDF_VERSION_MAJOR
+        snprintf(_status.idfVersion, sizeof(_status.idfVersion), "%d.%d.%d", 
+                 ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH);
+    #else
+        strlcpy(_status.idfVersion, esp_get_idf_version(), sizeof(_status.idfVersion));
+    #endif
+    
+    // Reset Reason
+    esp_reset_reason_t reason = esp_reset_reason();
+    static const char* reset_reasons[] = {
+        "Unknown", "Power on", "External pin", "Software reset", 
+        "Software panic", "Interrupt watchdog", "Task watchdog", 
+        "Other watchdog", "Exiting deep sleep", "Brownout", "SDIO"
+    };
+    _status.resetReason = (reason < ESP_RST_SDIO + 1) ? reset_reasons[reason] : "Other";
+}
+
+void StatusCache::collectNetwork() {
+    iSprinklrNetwork* net = iSprinklrNetwork::getInstance();
+    const NetworkState& link = net->getLinkState();
+    StatusNetwork& network = _status.network;
+
+    // Signal strength moves all the time, the rest only on a link event
+    if (link.wifiUp()) {
+        network.wifi.rssi = WiFi.RSSI();
+        if (link.activeLink() == NET_LINK_WIFI) {
+            network.rssi = network.wifi.rssi;
+        }
+    }
+    if (_networkValid && link.lastChangeMs() == _networkChangeMs) {
+        return;
+    }
+    _networkChangeMs = link.lastChangeMs();
+    _networkValid = true;
+
+    memset(&network, 0, sizeof(network));
+    network.connected = net->isConnected();
+    network.type = link.typeName();
+    LinkStatus state = link.status(link.activeLink() == NET_LINK_WIFI || net->getMode() == MODE_WIFI ? NET_LINK_WIFI : NET_LINK_ETHERNET);
+    network.state = NetworkState::phaseName(state.phase);
+    network.upMs = state.upMs;
+    network.downMs = state.downMs;
+    network.attempts = state.attempts;
+    strlcpy(network.ip, net->getIP().toString().c_str(), sizeof(network.ip));
+    
+    // Additional information based on network type
+    switch (link.activeLink()) {
+        case NET_LINK_WIFI:
+            strlcpy(network.ssid, WiFi.SSID().c_str(), sizeof(network.ssid));
+            network.rssi = WiFi.RSSI();
+            strlcpy(network.gateway, WiFi.gatewayIP().toString().c_str(), sizeof(network.gateway));
+            strlcpy(network.subnet, WiFi.subnetMask().toString().c_str(), sizeof(network.subnet));
+            strlcpy(network.dns, WiFi.dnsIP().toString().c_str(), sizeof(network.dns));
+            break;
+        case NET_LINK_ETHERNET:
+            strlcpy(network.mac, ETH.macAddress().c_str(), sizeof(network.mac));
+            strlcpy(network.gateway, ETH.gatewayIP().toString().c_str(), sizeof(network.gateway));
+            strlcpy(network.subnet, ETH.subnetMask().toString().c_str(), sizeof(network.subnet));
+            network.linkSpeed = ETH.linkSpeed();
+            network.fullDuplex = ETH.fullDuplex();
+            break;
+        default:
+            break;
+    }
+
+    // Each interface the mode brings up, the standby one included
+    NetworkMode mode = net->getMode();
+    collectInterface(network.ethernet, link, NET_LINK_ETHERNET, mode != MODE_WIFI);
+    collectInterface(network.wifi, link, NET_LINK_WIFI, mode != MODE_ETHERNET);
+    if (network.ethernet.enabled && link.ethernetUp()) {
+        strlcpy(network.ethernet.ip, ETH.localIP().toString().c_str(), sizeof(network.ethernet.ip));
+        network.ethernet.linkSpeed = ETH.linkSpeed();
+        network.ethernet.fullDuplex = ETH.fullDuplex();
+    }
+    if (network.wifi.enabled && link.wifiUp()) {
+        strlcpy(network.wifi.ip, WiFi.localIP().toString().c_str(), sizeof(network.wifi.ip));
+        network.wifi.rssi = WiFi.RSSI();
+    }
+    network.failovers = link.failovers();
+    network.failbacks = link.failbacks();
+}
+
+void StatusCache::collectInterface(StatusInterface& out, const NetworkState& link, NetworkLink which, bool enabled) {
+    LinkStatus state = link.status(which);
+    out.enabled = enabled;
+    out.state = NetworkState::phaseName(state.phase);
+    out.upMs = state.upMs;
+    out.downMs = state.downMs;
+    out.reconnects = state.reconnects;
+    out.attempts = state.attempts;
+}
+
+void StatusCache::collectDynamic() {
+    // System uptime at the time of the snapshot
+    _status.uptimeMs = millis();
+    
+    // Memory Information
+    _status.freeHeap = esp_get_free_heap_size();
+    _status.minFreeHeap = esp_get_minimum_free_heap_size();
+    _status.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    _status.allocFailures = heapStats.failures();
+    
+    // SmartPort bus, controller 0
+    BusWorker& bus = _controllers.primary();
+    _status.busControllers = _controllers.count();
+    _status.busQueueDepth = bus.queueDepth();
+    _status.busTxMode = bus.getTxMode();
+    _status.rmtJitter = bus.getJitter(HUNTER_TX_RMT);
+    _status.bitbangJitter = bus.getJitter(HUNTER_TX_BITBANG);
+    
+    // Task Information
+    _status.stackHwm = uxTaskGetStackHighWaterMark(NULL);
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+        _status.bootMs[i] = bootMilestoneMs((BootMilestone)i);
+    }
+}
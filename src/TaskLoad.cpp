@@ -0,0 +1,42 @@
+#include "TaskLoad.h"
+#include "Hal.h"
+
+TaskLoad::TaskLoad() {
+    _count = 0;
+    _totalRunTime = 0;
+    _sampledMs = 0;
+    _windowMs = 0;
+}
+
+uint32_t TaskLoad::previous(uint32_t number) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_numbers[i] == number) {
+            return _runTime[i];
+        }
+    }
+
+    // Started since the last sample, its counter began at 0
+    return 0;
+}
+
+void TaskLoad::update(const TaskLoadSample* samples, uint16_t count, uint32_t totalRunTime, uint16_t* permille) {
+    // Unsigned differences stay right across one wrap of the counters
+    uint32_t window = totalRunTime - _totalRunTime;
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t used = samples[i].runTime - previous(samples[i].number);
+        uint64_t share = window > 0 ? (uint64_t)used * 1000 / window : 0;
+        permille[i] = share < 1000 ? share : 1000;
+    }
+
+    _count = 0;
+    for (uint16_t i = 0; i < count && _count < TASK_LOAD_MAX_TASKS; i++) {
+        _numbers[_count] = samples[i].number;
+        _runTime[_count] = samples[i].runTime;
+        _count++;
+    }
+    _totalRunTime = totalRunTime;
+
+    uint32_t now = halMillis();
+    _windowMs = now - _sampledMs;
+    _sampledMs = now;
+}
@@ -1,269 +1,1079 @@
 #include "WebServer.h"
+#include "esp_heap_caps.h"
 
-WebServer::WebServer() : server(80), hunter_controller(SMARTPORT_PIN) {
+// Id from /api/schedules/{id}, 0 if it is not a schedule id
+static uint8_t scheduleId(AsyncWebServerRequest *request) {
+    String url = request->url();
+    unsigned long id = strtoul(url.substring(url.lastIndexOf('/') + 1).c_str(), NULL, 10);
+    return id <= SCHEDULE_MAX ? id : 0;
+}
+
+WebServer::WebServer() : server(80), controllers(SMARTPORT_PIN, SMARTPORT_TX_MODE), bus(controllers.primary()), sequence(bus), schedules(sequence), status(controllers), frames(bus) {
+    admissionLock = portMUX_INITIALIZER_UNLOCKED;
+    routed = false;
+    listening = false;
 }
 
 void WebServer::begin() {
+    // Track zone state and push bus and network changes to /api/events subscribers
+    controllers.onComplete(onCommandFinished, this);
+    
+    // The W5500 sits on fixed pins, a controller taking one would cut the device off
+    int ethPins[6];
+    uint8_t ethCount = iSprinklrNetwork::getInstance()->ethernetPins(ethPins);
+    for (uint8_t i = 0; i < ethCount; i++) {
+        controllers.reserve(ethPins[i]);
+    }
+    iSprinklrNetwork::getInstance()->onChange(onNetworkChange, this);
+    heap_caps_register_failed_alloc_callback(onAllocFailed);
+    frames.onAdmit(admitFrame, this);
+    events.begin(server);
+    
+    journal.begin();
+    controllers.begin();
+    sequence.begin();
+    bootMark(BOOT_BUS_READY);
+    schedules.begin();
+    bootMark(BOOT_SCHEDULER_READY);
+    status.begin();
+    zones.begin();
     setupRoutes();
+    
+    // An address that arrived before this point is picked up here, any
+    // later one starts the listeners from onNetworkChange
+    routed = true;
+    if (iSprinklrNetwork::getInstance()->isConnected()) {
+        listen();
+    }
+}
+
+void WebServer::listen() {
+    if (!routed || listening.exchange(true)) {
+        return;
+    }
     server.begin();
     Serial.println("HTTP server started");
+    frames.begin();
+    bootMark(BOOT_READY);
+    Serial.print("Ready ");
+    Serial.print(bootMilestoneMs(BOOT_READY));
+    Serial.println(" ms after boot");
 }
 
 void WebServer::setupRoutes() {
-    // Enhanced status endpoint with detailed system information
-    server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request) {
-        Serial.println("Status check requested");
+    // Count every request by route and status, time it from arrival to
+    // response, and count the heap allocations its handler makes
+    server.addMiddleware([this](AsyncWebServerRequest *request, ArMiddlewareNext next) {
+        uint32_t arrivedUs = metrics.handling(request, micros());
+        MetricsRoute route = Metrics::route(request->url().c_str());
+        heapStats.enter(xTaskGetCurrentTaskHandle(), route);
+        next();
+        heapStats.leave();
+        AsyncWebServerResponse *response = request->getResponse();
+        metrics.finished(route, response ? response->code() : 0, micros() - arrivedUs);
+    });
+
+    // Prometheus exposition, written into the response a chunk at a time
+    server.on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        MetricsGauges gauges;
+        collectMetrics(gauges);
+        MetricsScrape scrape;
+        metrics.beginScrape(scrape);
+        request->send(request->beginChunkedResponse("text/plain; version=0.0.4",
+            [this, gauges, scrape](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+                return metrics.write((char*)buffer, maxLen, scrape, gauges);
+            }));
+    });
+
+    // Liveness probe, no JSON and no system queries
+    server.on("/api/ping", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", (const uint8_t*)"pong", 4);
+    });
+
+    // Enhanced status endpoint with detailed system information, served from a periodic snapshot
+    server.on("/api/status", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!status.refresh()) {
+            sendStatic(request, 500, "{\"error\":\"Status response too large\"}");
+            return;
+        }
+        
+        // Unchanged since the client last asked
+        if (request->hasHeader("If-None-Match") &&
+            etagMatches(request->header("If-None-Match").c_str(), status.etag())) {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            response->addHeader("ETag", status.etag());
+            request->send(response);
+            return;
+        }
+        
+        // Copy the snapshot so a refresh cannot change it under a slow client
+        char* response = responses.acquire();
+        if (response == NULL) {
+            sendStatic(request, 503, "{\"error\":\"Server busy\"}");
+            return;
+        }
+        memcpy(response, status.body(), status.length());
+        sendPooled(request, 200, response, status.length(), status.etag());
+    });
+    // Setup JSON handler with simplified error handling
+    onJsonBody("/api/start", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        Serial.println("Start command received");
+        
+        StartRequest start;
+        ApiResult result = parseStartRequest(body, len, start);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        Serial.print("Zone: ");
+        Serial.println(start.zone);
+        Serial.print("Minutes: ");
+        Serial.println(start.minutes);
+        
+        // A retry of a request already answered gets the same reply, and nothing is queued
+        uint32_t fingerprint = IdempotencyCache::fingerprint(BUS_CMD_START, start.controller, start.zone, start.minutes);
+        if (replayIdempotent(request, start.idempotencyKey, fingerprint)) {
+            return;
+        }
+        
+        BusWorker* target = findController(request, start.controller);
+        if (target == NULL) {
+            return;
+        }
+        
+        // Hand the command to the controller's bus worker and reply straight away
+        uint32_t id = target->submit(BUS_CMD_START, start.zone, start.minutes);
+        
+        if (id == 0) {
+            Serial.println("Bus queue full, start command rejected");
+            sendStatic(request, 503, "{\"status\":\"error\",\"error\":\"Bus queue full\"}");
+            return;
+        }
+        
+        sendAccepted(request, id, start.controller, start.zone, start.minutes, start.idempotencyKey, fingerprint);
+    }, ADMIT_COMMAND);
+
+    onJsonBody("/api/stop", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        Serial.println("Stop command received");
+        
+        StopRequest stop;
+        ApiResult result = parseStopRequest(body, len, stop);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        Serial.print("Stopping zone: ");
+        Serial.println(stop.zone);
+        
+        uint32_t fingerprint = IdempotencyCache::fingerprint(BUS_CMD_STOP, stop.controller, stop.zone);
+        if (replayIdempotent(request, stop.idempotencyKey, fingerprint)) {
+            return;
+        }
+        
+        BusWorker* target = findController(request, stop.controller);
+        if (target == NULL) {
+            return;
+        }
+        
+        // Hand the command to the controller's bus worker and reply straight away
+        uint32_t id = target->submit(BUS_CMD_STOP, stop.zone);
+        
+        if (id == 0) {
+            Serial.println("Bus queue full, stop command rejected");
+            sendStatic(request, 503, "{\"status\":\"error\",\"error\":\"Bus queue full\"}");
+            return;
+        }
+        
+        sendAccepted(request, id, stop.controller, stop.zone, -1, stop.idempotencyKey, fingerprint);
+    }, ADMIT_STOP);
+
+    // Several start, stop and program commands in one request, queued as one unit
+    onJsonBody("/api/batch", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        Serial.println("Batch command received");
+        
+        // Only the AsyncTCP task handles requests, so one batch buffer is enough
+        static BatchRequest batch;
+        ApiResult result = parseBatchRequest(body, len, batch);
+        if (result.error) {
+            sendBatchError(request, result, batch.failed);
+            return;
+        }
+        
+        BusWorker* target = findController(request, batch.controller);
+        if (target == NULL) {
+            return;
+        }
+        
+        // Admitted as a stop, anything else in it must pass as a command
+        uint8_t commands = 0;
+        for (uint8_t i = 0; i < batch.count; i++) {
+            if (batch.commands[i].type != BUS_CMD_STOP) {
+                commands++;
+            }
+        }
+        uint32_t ip = request->client()->getRemoteAddress();
+        if (commands > 0) {
+            portENTER_CRITICAL(&admissionLock);
+            AdmissionDecision decision = admission.promote(ip, millis());
+            portEXIT_CRITICAL(&admissionLock);
+            if (!decision.admitted) {
+                sendTooManyRequests(request, decision.retryAfterS);
+                return;
+            }
+        }
+        
+        uint32_t ids[BATCH_MAX_COMMANDS];
+        CoalesceResult results[BATCH_MAX_COMMANDS];
+        if (!target->submitBatch(batch.commands, batch.count, ids, results)) {
+            Serial.println("Bus queue full, batch rejected");
+            sendStatic(request, 503, "{\"status\":\"error\",\"error\":\"Bus queue full\"}");
+            return;
+        }
+        
+        // Admission took one token, the other commands are paid for once
+        // queued. Stops are free.
+        if (commands > 1) {
+            portENTER_CRITICAL(&admissionLock);
+            admission.charge(ip, commands - 1, millis());
+            portEXIT_CRITICAL(&admissionLock);
+        }
+        
+        const char* states[BATCH_MAX_COMMANDS];
+        for (uint8_t i = 0; i < batch.count; i++) {
+            states[i] = BusWorker::coalesceName(results[i]);
+        }
+        
+        // Every command is queued, so reply even if the pool is empty
+        char* response = responses.acquire();
+        if (response == NULL) {
+            sendStatic(request, 202, "{\"status\":\"accepted\"}");
+            return;
+        }
+        size_t length = writeBatchResponse(response, RESPONSE_SLOT_SIZE, batch, ids, states);
+        sendPooled(request, 202, response, length);
+    }, ADMIT_STOP);
+
+    // Command status lookup, /api/commands/{id}
+    server.on("/api/commands", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        String url = request->url();
+        String idText = url.substring(url.lastIndexOf('/') + 1);
+        uint32_t id = strtoul(idText.c_str(), NULL, 10);
+        
+        BusCommandStatus status;
+        uint8_t controller;
+        if (!controllers.lookup(id, status, controller)) {
+            request->send(404, "application/json", "{\"error\":\"Unknown command id\"}");
+            return;
+        }
         
-        // Create JSON response with detailed system information
-        DynamicJsonDocument doc(1024);
+        DynamicJsonDocument responseDoc(256);
+        responseDoc["id"] = status.command.id;
+        responseDoc["controller"] = controller;
+        responseDoc["command"] = BusWorker::typeName(status.command.type);
+        responseDoc["zone"] = status.command.zone;
+        if (status.command.type == BUS_CMD_START) {
+            responseDoc["minutes"] = status.command.minutes;
+        }
+        responseDoc["state"] = BusWorker::stateName(status.state);
+        if (status.state == BUS_STATE_FAILED) {
+            responseDoc["error"] = controllers.get(controller)->errorHint(status.result);
+        }
         
-        // Basic status
-        doc["status"] = "ok";
+        String response;
+        serializeJson(responseDoc, response);
+        request->send(200, "application/json", response);
+    });
+
+    // Device-side zone state, /api/zones and /api/zones/{n}
+    server.on("/api/zones", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendZones(request);
+    });
+
+    // SmartPort pulse timing, to correlate timing error with network load
+    server.on("/api/bus/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        int index = request->hasParam("controller") ? request->getParam("controller")->value().toInt() : 0;
+        BusWorker* target = findController(request, index);
+        if (target == NULL) {
+            return;
+        }
+        HunterBusStats stats = target->getStats();
         
-        // System uptime
+        DynamicJsonDocument doc(1536);
         doc["uptime_ms"] = millis();
+        doc["controller"] = index;
+        doc["tx_mode"] = target->getTxMode() == HUNTER_TX_RMT ? "rmt" : "bitbang";
+        doc["frames"] = stats.frames;
+        
+        JsonArray edges = doc.createNestedArray("histogram_edges_us");
+        const int32_t histogramEdges[] = HUNTER_HISTOGRAM_EDGES;
+        for (int32_t edge : histogramEdges) {
+            edges.add(edge);
+        }
+        
+        JsonObject pulses = doc.createNestedObject("pulses");
+        const char* names[HUNTER_PULSE_CLASSES] = { "start", "short", "long" };
+        for (int i = 0; i < HUNTER_PULSE_CLASSES; i++) {
+            HunterPulseStats &pulse = stats.pulses[i];
+            JsonObject p = pulses.createNestedObject(names[i]);
+            p["nominal_us"] = HunterRoam::nominalWidth((HunterPulseClass)i);
+            p["count"] = pulse.count;
+            p["min_us"] = pulse.minUs;
+            p["max_us"] = pulse.maxUs;
+            p["mean_us"] = pulse.count ? (float)pulse.sumUs / pulse.count : 0;
+            JsonArray histogram = p.createNestedArray("histogram");
+            for (int b = 0; b < HUNTER_HISTOGRAM_BUCKETS; b++) {
+                histogram.add(pulse.histogram[b]);
+            }
+        }
+        
+        // Frames kept off the bus by the command coalescer
+        BusCoalesceStats coalesce = target->getCoalesceStats();
+        JsonObject c = doc.createNestedObject("coalesce");
+        c["window_ms"] = target->coalesceWindowMs();
+        c["duplicates"] = coalesce.duplicates;
+        c["collapsed"] = coalesce.collapsed;
+        c["replaced"] = coalesce.replaced;
+        c["frames_saved"] = coalesce.framesSaved;
         
-        // ESP Chip Information
-        JsonObject chip = doc.createNestedObject("chip");
-        esp_chip_info_t chip_info;
-        esp_chip_info(&chip_info);
-        
-        // Set chip model
-        switch(chip_info.model) {
-            case CHIP_ESP32:
-                chip["model"] = "ESP32";
-                break;
-            case CHIP_ESP32S2:
-                chip["model"] = "ESP32-S2";
-                break;
-            case CHIP_ESP32S3:
-                chip["model"] = "ESP32-S3";
-                break;
-            case CHIP_ESP32C3:
-                chip["model"] = "ESP32-C3";
-                break;
-            default:
-                chip["model"] = "Unknown";
-        }
-        
-        chip["revision"] = chip_info.revision;
-        chip["cores"] = chip_info.cores;
-        
-        // ESP-IDF Version
-        #ifdef ESP_IDF_VERSION_MAJOR
-            char idf_version[16];
-            snprintf(idf_version, sizeof(idf_version), "%d.%d.%d", 
-                     ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH);
-            doc["idf_version"] = idf_version;
-        #else
-            doc["idf_version"] = esp_get_idf_version();
-        #endif
-        
-        // Reset Reason
-        esp_reset_reason_t reason = esp_reset_reason();
-        const char* reset_reasons[] = {
-            "Unknown", "Power on", "External pin", "Software reset", 
-            "Software panic", "Interrupt watchdog", "Task watchdog", 
-            "Other watchdog", "Exiting deep sleep", "Brownout", "SDIO"
-        };
-        doc["reset_reason"] = (reason < ESP_RST_SDIO + 1) ? reset_reasons[reason] : "Other";
-        
-        // Memory Information
-        JsonObject memory = doc.createNestedObject("memory");
-        memory["free_heap"] = esp_get_free_heap_size();
-        memory["min_free_heap"] = esp_get_minimum_free_heap_size();
-        
-        // Network Status
-        JsonObject network = doc.createNestedObject("network");
-        iSprinklrNetwork* net = iSprinklrNetwork::getInstance();
-        
-        // Get connection status
-        network["connected"] = net->isConnected();
-        network["type"] = net->getNetworkType();
-        
-        // IP address information
-        IPAddress ip = net->getIP();
-        network["ip"] = ip.toString();
-        
-        // Additional information based on network type
-        if (net->getNetworkType() == "WiFi") {
-            network["ssid"] = WiFi.SSID();
-            network["rssi"] = WiFi.RSSI();
-            network["gateway"] = WiFi.gatewayIP().toString();
-            network["subnet"] = WiFi.subnetMask().toString();
-            network["dns"] = WiFi.dnsIP().toString();
-        } else if (net->getNetworkType() == "Ethernet") {
-            network["mac"] = ETH.macAddress();
-            network["gateway"] = ETH.gatewayIP().toString();
-            network["subnet"] = ETH.subnetMask().toString();
-            network["speed"] = String(ETH.linkSpeed()) + " Mbps";
-            network["duplex"] = ETH.fullDuplex() ? "Full" : "Half";
-        }
-        
-        // Task Information
-        JsonObject task = doc.createNestedObject("task");
-        task["stack_hwm"] = uxTaskGetStackHighWaterMark(NULL);
-        
-        // Convert to string
         String response;
         serializeJson(doc, response);
+        request->send(200, "application/json", response);
+    });
+
+    // Controller registry, one Hunter controller per REM pin
+    server.on("/api/controllers", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        DynamicJsonDocument doc(512);
+        JsonArray list = doc.createNestedArray("controllers");
+        for (uint8_t i = 0; i < controllers.count(); i++) {
+            BusWorker* controller = controllers.get(i);
+            JsonObject c = list.createNestedObject();
+            c["id"] = i;
+            c["pin"] = controller->getPin();
+            c["tx_mode"] = controller->getTxMode() == HUNTER_TX_RMT ? "rmt" : "bitbang";
+            c["queue_depth"] = controller->queueDepth();
+            if (controllers.isRemoved(i)) {
+                c["removed"] = true;
+            }
+        }
+        doc["max"] = CONTROLLER_MAX;
         
+        String response;
+        serializeJson(doc, response);
         request->send(200, "application/json", response);
     });
-    // Setup JSON handler with simplified error handling
-    server.on("/api/start", HTTP_POST, 
-        // Regular request handler is empty as we'll handle everything in the body handler
-        [](AsyncWebServerRequest *request) {},
-        // No upload handler needed
-        NULL,
-        // Body handler for both valid and invalid JSON
-        [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-            if (index == 0 && total > 0) { // Ensure we process the body only once
-                Serial.println("Start command received");
-                
-                // Parse the JSON directly from the received data
-                DynamicJsonDocument doc(1024);
-                DeserializationError error = deserializeJson(doc, (const char*)data, len);
-                
-                if (error) {
-                    Serial.print("JSON Error: ");
-                    Serial.println(error.c_str());
-                    request->send(400, "application/json", "{\"error\":\"Invalid JSON: " + String(error.c_str()) + "\"}");
-                    return;
-                }
-                
-                // Validate required parameters
-                if (!doc.containsKey("zone") || !doc.containsKey("minutes")) {
-                    request->send(400, "application/json", "{\"error\":\"Missing required parameters\"}");
-                    return;
-                }
-                
-                int zone = doc["zone"].as<int>();
-                int minutes = doc["minutes"].as<int>();
-                
-                // Validate zone is within valid range (1-20)
-                if (zone < 1 || zone > 20) {
-                    request->send(400, "application/json", "{\"error\":\"Zone must be between 1 and 20\"}");
-                    return;
-                }
-                
-                // Validate minutes is within valid range (0-120)
-                // Allow 0 minutes for testing stop functionality (HunterRoam::stopZone uses 0 minutes)
-                if (minutes < 0 || minutes > 120) {
-                    request->send(400, "application/json", "{\"error\":\"Minutes must be between 0 and 120\"}");
-                    return;
-                }
-                
-                Serial.print("Zone: ");
-                Serial.println(zone);
-                Serial.print("Minutes: ");
-                Serial.println(minutes);
-                
-                // Use the hunter_controller to start the zone
-                byte result = hunter_controller.startZone(zone, minutes);
-                
-                String status = "started";
-                String errorMessage = "";
-                
-                // Check if there was an error
-                if (result != 0) {
-                    status = "error";
-                    errorMessage = hunter_controller.errorHint(result);
-                    Serial.print("Error starting zone: ");
-                    Serial.println(errorMessage);
-                    
-                    DynamicJsonDocument responseDoc(256);
-                    responseDoc["status"] = status;
-                    responseDoc["zone"] = zone;
-                    responseDoc["minutes"] = minutes;
-                    responseDoc["error"] = errorMessage;
-                    
-                    String response;
-                    serializeJson(responseDoc, response);
-                    request->send(500, "application/json", response);
-                } else {
-                    DynamicJsonDocument responseDoc(256);
-                    responseDoc["status"] = status;
-                    responseDoc["zone"] = zone;
-                    responseDoc["minutes"] = minutes;
-                    
-                    String response;
-                    serializeJson(responseDoc, response);
-                    request->send(200, "application/json", response);
-                }
+
+    onJsonBody("/api/controllers", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        ControllerRequest add;
+        ApiResult result = parseControllerRequest(body, len, add);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        uint8_t id = 0;
+        ControllerAddResult added = controllers.add(add.pin, id);
+        if (added != CONTROLLER_ADDED) {
+            ApiResult failed = { added == CONTROLLER_FULL ? 409 : 400, ControllerRegistry::resultName(added), NULL };
+            sendError(request, failed);
+            return;
+        }
+        
+        Serial.print("Controller added on pin ");
+        Serial.println(add.pin);
+        
+        char response[API_SMALL_RESPONSE_SIZE];
+        snprintf(response, sizeof(response), "{\"id\":%u,\"pin\":%d}", id, add.pin);
+        request->send(201, "application/json", response);
+    });
+
+    // Forget an added controller, /api/controllers/{id}. It takes no more commands and frees its pin at the next restart.
+    server.on("/api/controllers", HTTP_DELETE, [this](AsyncWebServerRequest *request) {
+        String url = request->url();
+        int slash = url.lastIndexOf('/');
+        String idText = url.substring(slash + 1);
+        long id = idText.length() > 0 && isDigit(idText[0]) ? idText.toInt() : -1;
+        if (id == 0) {
+            request->send(400, "application/json", "{\"error\":\"Controller 0 is built in\"}");
+            return;
+        }
+        if (id < 0 || id >= CONTROLLER_MAX || !controllers.remove(id)) {
+            request->send(404, "application/json", "{\"error\":\"Unknown controller\"}");
+            return;
+        }
+        Serial.print("Controller ");
+        Serial.print(id);
+        Serial.println(" removed, it stops at the next restart");
+        request->send(204);
+    });
+
+    // Sequence controls. Registered before /api/sequence, which would also match these paths.
+    server.on("/api/sequence/cancel", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendSequenceResult(request, sequence.cancel());
+    });
+    server.on("/api/sequence/pause", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendSequenceResult(request, sequence.pause());
+    });
+    server.on("/api/sequence/resume", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendSequenceResult(request, sequence.resume());
+    });
+    server.on("/api/sequence/skip", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendSequenceResult(request, sequence.skip());
+    });
+
+    // Sequence progress
+    server.on("/api/sequence", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendSequenceProgress(request, 200);
+    });
+
+    // Start a run list of zones
+    onJsonBody("/api/sequence", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        Serial.println("Sequence command received");
+        
+        SequenceStep list[SEQUENCE_MAX_STEPS];
+        uint8_t count = 0;
+        ApiResult result = parseSequenceRequest(body, len, list, count);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        if (sequence.start(list, count) == 0) {
+            request->send(500, "application/json", "{\"error\":\"Sequence runner unavailable\"}");
+            return;
+        }
+        
+        sendSequenceProgress(request, 202);
+    }, ADMIT_COMMAND);
+
+    // Stored schedules, /api/schedules and /api/schedules/{id}
+    server.on("/api/schedules", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (request->url() == "/api/schedules") {
+            sendSchedules(request);
+            return;
+        }
+        uint8_t id = scheduleId(request);
+        sendSchedule(request, 200, id);
+    });
+
+    // POST /api/schedules adds a schedule, PUT /api/schedules/{id} replaces one
+    onJsonBody("/api/schedules", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        bool create = request->url() == "/api/schedules";
+        if (create != (request->method() == HTTP_POST)) {
+            request->send(405, "application/json", "{\"error\":\"Use POST /api/schedules or PUT /api/schedules/{id}\"}");
+            return;
+        }
+        
+        Schedule schedule;
+        ApiResult result = parseScheduleRequest(body, len, schedule);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        if (create) {
+            uint8_t id;
+            if (schedules.add(schedule, id) != SCHEDULE_OK) {
+                request->send(409, "application/json", "{\"status\":\"error\",\"error\":\"No free schedule slots\"}");
+                return;
             }
+            sendSchedule(request, 201, id);
+            return;
         }
-    );
+        
+        uint8_t id = scheduleId(request);
+        if (schedules.replace(id, schedule) != SCHEDULE_OK) {
+            request->send(404, "application/json", "{\"error\":\"Unknown schedule id\"}");
+            return;
+        }
+        sendSchedule(request, 200, id);
+    }, ADMIT_ANY, HTTP_POST | HTTP_PUT);
+
+    server.on("/api/schedules", HTTP_DELETE, [this](AsyncWebServerRequest *request) {
+        uint8_t id = scheduleId(request);
+        if (schedules.remove(id) != SCHEDULE_OK) {
+            request->send(404, "application/json", "{\"error\":\"Unknown schedule id\"}");
+            return;
+        }
+        request->send(204);
+    });
+
+    // Wall clock and time zone used by the scheduler
+    server.on("/api/time", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendTime(request);
+    });
+
+    onJsonBody("/api/time", [this](AsyncWebServerRequest *request, const char *body, size_t len) {
+        TimeRequest time;
+        ApiResult result = parseTimeRequest(body, len, time);
+        if (result.error) {
+            sendError(request, result);
+            return;
+        }
+        
+        if (time.tz[0] != '\0') {
+            schedules.setTimeZone(time.tz);
+        }
+        if (time.epoch != 0) {
+            schedules.setTime(time.epoch);
+        }
+        sendTime(request);
+    });
+
+    // Finished bus commands from the journal, oldest first, streamed a chunk at a time
+    server.on("/api/history", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!journal.isMounted()) {
+            sendStatic(request, 503, "{\"error\":\"Command journal unavailable\"}");
+            return;
+        }
+        uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), NULL, 10) : 0;
+        uint32_t limit = request->hasParam("limit") ? strtoul(request->getParam("limit")->value().c_str(), NULL, 10) : 0;
+        if (limit == 0 || limit > JOURNAL_HISTORY_LIMIT) {
+            limit = JOURNAL_HISTORY_LIMIT;
+        }
+
+        JournalCursor cursor;
+        journal.beginHistory(since, limit, cursor);
+        request->send(request->beginChunkedResponse("application/json",
+            [this, cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+                return journal.write((char*)buffer, maxLen, cursor);
+            }));
+    });
 
-    server.on("/api/stop", HTTP_POST, 
+    // Every FreeRTOS task with its CPU share, stack headroom, core and priority
+    server.on("/api/tasks", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendTasks(request);
+    });
+
+    // Heap layout per capability and the allocations made by each route
+    server.on("/api/debug/heap", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendHeap(request);
+    });
+}
+
+void WebServer::onJsonBody(const char* uri, JsonBodyHandler handler, AdmissionClass admit,
+                           WebRequestMethodComposite method) {
+    server.on(uri, method, 
         // Regular request handler is empty as we'll handle everything in the body handler
         [](AsyncWebServerRequest *request) {},
         // No upload handler needed
         NULL,
-        // Body handler for both valid and invalid JSON
-        [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-            if (index == 0 && total > 0) { // Ensure we process the body only once
-                Serial.println("Stop command received");
-                
-                // Parse the JSON directly from the received data
-                DynamicJsonDocument doc(1024);
-                DeserializationError error = deserializeJson(doc, (const char*)data, len);
-                
-                if (error) {
-                    Serial.print("JSON Error: ");
-                    Serial.println(error.c_str());
-                    request->send(400, "application/json", "{\"error\":\"Invalid JSON: " + String(error.c_str()) + "\"}");
-                    return;
-                }
-                
-                // Validate required parameters
-                if (!doc.containsKey("zone")) {
-                    request->send(400, "application/json", "{\"error\":\"Missing required parameter: zone\"}");
-                    return;
-                }
-                
-                int zone = doc["zone"].as<int>();
+        // Collect the body, which may arrive in several chunks, and hand it over once whole
+        [this, handler, admit](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            if (index == 0) {
+                metrics.arrived(request, micros());
                 
-                // Validate zone is within valid range (1-20)
-                if (zone < 1 || zone > 20) {
-                    request->send(400, "application/json", "{\"error\":\"Zone must be between 1 and 20\"}");
+                // Refuse clients over their limit before reading anything
+                AdmissionDecision decision = this->admit(request->client()->getRemoteAddress(), admit);
+                if (!decision.admitted) {
+                    sendTooManyRequests(request, decision.retryAfterS);
                     return;
                 }
-                
-                Serial.print("Stopping zone: ");
-                Serial.println(zone);
-                
-                // Use the hunter_controller to stop the zone
-                byte result = hunter_controller.stopZone(zone);
-                
-                String status = "stopped";
-                String errorMessage = "";
-                
-                // Check if there was an error
-                if (result != 0) {
-                    status = "error";
-                    errorMessage = hunter_controller.errorHint(result);
-                    Serial.print("Error stopping zone: ");
-                    Serial.println(errorMessage);
-                    
-                    DynamicJsonDocument responseDoc(256);
-                    responseDoc["status"] = status;
-                    responseDoc["zone"] = zone;
-                    responseDoc["error"] = errorMessage;
-                    
-                    String response;
-                    serializeJson(responseDoc, response);
-                    request->send(500, "application/json", response);
-                } else {
-                    DynamicJsonDocument responseDoc(256);
-                    responseDoc["status"] = status;
-                    responseDoc["zone"] = zone;
-                    
-                    String response;
-                    serializeJson(responseDoc, response);
-                    request->send(200, "application/json", response);
+            }
+            switch (bodies.append(request, data, len, index, total, millis())) {
+                case BODY_COMPLETE: {
+                    size_t length;
+                    const char* body = bodies.body(request, length);
+                    heapStats.enter(xTaskGetCurrentTaskHandle(), Metrics::route(request->url().c_str()));
+                    handler(request, body, length);
+                    heapStats.leave();
+                    bodies.release(request);
+                    break;
                 }
+                case BODY_TOO_LARGE:
+                    sendStatic(request, 413, "{\"error\":\"Request body too large\"}");
+                    break;
+                case BODY_BUSY:
+                    sendStatic(request, 503, "{\"error\":\"Server busy\"}");
+                    break;
+                default:
+                    break;
             }
         }
     );
 }
+
+AdmissionDecision WebServer::admit(uint32_t ip, AdmissionClass type) {
+    portENTER_CRITICAL(&admissionLock);
+    AdmissionDecision decision = admission.admit(ip, type, millis());
+    portEXIT_CRITICAL(&admissionLock);
+    return decision;
+}
+
+AdmissionDecision WebServer::admitFrame(uint32_t ip, AdmissionClass type, void* arg) {
+    return static_cast<WebServer*>(arg)->admit(ip, type);
+}
+
+void WebServer::sendTooManyRequests(AsyncWebServerRequest *request, uint32_t retryAfterS) {
+    static const char json[] = "{\"status\":\"error\",\"error\":\"Too many requests\"}";
+    AsyncWebServerResponse *response = request->beginResponse(429, "application/json", (const uint8_t*)json, sizeof(json) - 1);
+    char retryAfter[12];
+    snprintf(retryAfter, sizeof(retryAfter), "%u", (unsigned)retryAfterS);
+    response->addHeader("Retry-After", retryAfter);
+    request->send(response);
+}
+
+void WebServer::sendError(AsyncWebServerRequest *request, const ApiResult& result) {
+    if (result.detail) {
+        Serial.print("JSON Error: ");
+        Serial.println(result.detail);
+    }
+    
+    char* response = responses.acquire();
+    if (response == NULL) {
+        sendStatic(request, result.code, "{\"error\":\"Server busy\"}");
+        return;
+    }
+    size_t len = writeErrorResponse(response, RESPONSE_SLOT_SIZE, result);
+    sendPooled(request, result.code, response, len);
+}
+
+void WebServer::sendBatchError(AsyncWebServerRequest *request, const ApiResult& result, int index) {
+    if (result.detail) {
+        Serial.print("JSON Error: ");
+        Serial.println(result.detail);
+    }
+    
+    char* response = responses.acquire();
+    if (response == NULL) {
+        sendStatic(request, result.code, "{\"error\":\"Server busy\"}");
+        return;
+    }
+    size_t len = writeBatchErrorResponse(response, RESPONSE_SLOT_SIZE, result, index);
+    sendPooled(request, result.code, response, len);
+}
+
+void WebServer::sendAccepted(AsyncWebServerRequest *request, uint32_t id, int controller, int zone, int minutes,
+                             const char* key, uint32_t fingerprint) {
+    char* response = responses.acquire();
+    if (response == NULL) {
+        // The command is already queued, so reply with its id even if that costs a copy
+        char fallback[API_SMALL_RESPONSE_SIZE];
+        size_t len = writeAcceptedResponse(fallback, sizeof(fallback), id, controller, zone, minutes);
+        if (key != NULL && key[0] != '\0') {
+            idempotency.store(request->client()->getRemoteAddress(), key, fingerprint, 202, fallback, len, millis());
+        }
+        request->send(202, "application/json", fallback);
+        return;
+    }
+    size_t len = writeAcceptedResponse(response, RESPONSE_SLOT_SIZE, id, controller, zone, minutes);
+    if (key != NULL && key[0] != '\0') {
+        idempotency.store(request->client()->getRemoteAddress(), key, fingerprint, 202, response, len, millis());
+    }
+    sendPooled(request, 202, response, len);
+}
+
+bool WebServer::replayIdempotent(AsyncWebServerRequest *request, char* key, uint32_t fingerprint) {
+    // The header wins over the body field
+    if (request->hasHeader("Idempotency-Key")) {
+        const String& header = request->header("Idempotency-Key");
+        if (!copyIdempotencyKey(header.c_str(), header.length(), key)) {
+            sendStatic(request, 400, "{\"status\":\"error\",\"error\":\"Idempotency key must be 1 to 64 printable characters\"}");
+            return true;
+        }
+    }
+    if (key[0] == '\0') {
+        return false;
+    }
+    
+    int code;
+    const char* body;
+    size_t len;
+    switch (idempotency.lookup(request->client()->getRemoteAddress(), key, fingerprint, millis(), code, body, len)) {
+        case IDEMPOTENCY_HIT: {
+            Serial.println("Idempotent retry, replaying the original response");
+            char* response = responses.acquire();
+            if (response == NULL) {
+                request->send(code, "application/json", (const uint8_t*)body, len);
+                return true;
+            }
+            memcpy(response, body, len);
+            sendPooled(request, code, response, len);
+            return true;
+        }
+        case IDEMPOTENCY_MISMATCH:
+            sendStatic(request, 422, "{\"status\":\"error\",\"error\":\"Idempotency key was used for a different request\"}");
+            return true;
+        default:
+            return false;
+    }
+}
+
+void WebServer::sendPooled(AsyncWebServerRequest *request, int code, char* slot, size_t len, const char* etag) {
+    // The body is streamed straight from the slot, which must outlive the response
+    request->onDisconnect([this, slot]() {
+        responses.release(slot);
+    });
+    AsyncWebServerResponse *response = request->beginResponse(code, "application/json", (const uint8_t*)slot, len);
+    if (etag != NULL) {
+        response->addHeader("ETag", etag);
+    }
+    request->send(response);
+}
+
+void WebServer::sendStatic(AsyncWebServerRequest *request, int code, const char* json) {
+    // Sent in place from flash, no copy
+    request->send(code, "application/json", (const uint8_t*)json, strlen(json));
+}
+
+void WebServer::onCommandFinished(uint8_t controller, const BusCommandStatus& status, void* arg) {
+    WebServer* self = static_cast<WebServer*>(arg);
+    self->zones.commandFinished(controller, status);
+    self->events.commandFinished(controller, status);
+    self->journal.record(controller, status);
+}
+
+void WebServer::onNetworkChange(const NetworkState& state, void* arg) {
+    WebServer* self = static_cast<WebServer*>(arg);
+    if (state.isConnected()) {
+        self->listen();
+    }
+    self->events.networkChanged(state);
+}
+
+BusWorker* WebServer::findController(AsyncWebServerRequest *request, int index) {
+    BusWorker* controller = index >= 0 && index < CONTROLLER_MAX ? controllers.get(index) : NULL;
+    if (controller == NULL || controllers.isRemoved(index)) {
+        sendStatic(request, 404, "{\"error\":\"Unknown controller\"}");
+    }
+    return controller;
+}
+
+void WebServer::sendZones(AsyncWebServerRequest *request) {
+    int index = request->hasParam("controller") ? request->getParam("controller")->value().toInt() : 0;
+    if (findController(request, index) == NULL) {
+        return;
+    }
+    
+    // Anything after /api/zones/ names a single zone
+    String url = request->url();
+    int slash = url.indexOf('/', strlen("/api/zones"));
+    String zoneText = slash >= 0 ? url.substring(slash + 1) : String();
+    
+    char* response = responses.acquire();
+    if (response == NULL) {
+        sendStatic(request, 503, "{\"error\":\"Server busy\"}");
+        return;
+    }
+    
+    size_t len;
+    if (zoneText.length() > 0) {
+        int zone = zoneText.toInt();
+        ZoneState state;
+        if (zone < API_MIN_ZONE || zone > API_MAX_ZONE || !zones.get(index, zone, state)) {
+            responses.release(response);
+            sendStatic(request, 404, "{\"error\":\"Unknown zone\"}");
+            return;
+        }
+        len = writeZoneResponse(response, RESPONSE_SLOT_SIZE, index, zone, state, millis());
+    } else {
+        ZoneState list[API_MAX_ZONE];
+        zones.snapshot(index, list);
+        len = writeZonesResponse(response, RESPONSE_SLOT_SIZE, index, list, millis());
+    }
+    
+    if (len == 0) {
+        responses.release(response);
+        sendStatic(request, 500, "{\"error\":\"Zone response too large\"}");
+        return;
+    }
+    sendPooled(request, 200, response, len);
+}
+
+void WebServer::collectMetrics(MetricsGauges& gauges) {
+    memset(&gauges, 0, sizeof(gauges));
+    gauges.freeHeap = ESP.getFreeHeap();
+    gauges.minFreeHeap = ESP.getMinFreeHeap();
+    gauges.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    gauges.allocFailures = heapStats.failures();
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        HeapRouteStats usage = heapStats.route((MetricsRoute)r);
+        gauges.allocations[r] = usage.allocations;
+        gauges.allocatedBytes[r] = usage.bytes;
+    }
+    
+    gauges.controllers = controllers.count();
+    for (uint8_t i = 0; i < gauges.controllers; i++) {
+        BusWorker* controller = controllers.get(i);
+        BusUsage usage = controller->getUsage();
+        gauges.bus[i].frames = usage.frames;
+        gauges.bus[i].busyUs = usage.busyUs;
+        gauges.bus[i].queueDepth = controller->queueDepth();
+    }
+    
+    const NetworkState& link = iSprinklrNetwork::getInstance()->getLinkState();
+    gauges.ethernetReconnects = link.ethernetReconnects();
+    gauges.wifiReconnects = link.wifiReconnects();
+    
+    IdempotencyStats idempotent = idempotency.getStats();
+    gauges.idempotencyHits = idempotent.hits;
+    gauges.idempotencyMisses = idempotent.misses;
+    gauges.idempotencyMismatches = idempotent.mismatches;
+    gauges.journalDropped = journal.dropped() + journal.lost();
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+        gauges.bootMs[i] = bootMilestoneMs((BootMilestone)i);
+    }
+}
+
+void WebServer::sendSequenceProgress(AsyncWebServerRequest *request, int code) {
+    SequenceProgress progress = sequence.progress();
+    
+    DynamicJsonDocument responseDoc(256);
+    responseDoc["id"] = progress.id;
+    responseDoc["state"] = SequenceRunner::stateName(progress.state);
+    responseDoc["step"] = progress.step;
+    responseDoc["steps"] = progress.steps;
+    responseDoc["zone"] = progress.zone;
+    responseDoc["remaining_s"] = progress.remainingMs / 1000;
+    responseDoc["total_remaining_s"] = progress.totalRemainingMs / 1000;
+    
+    String response;
+    serializeJson(responseDoc, response);
+    request->send(code, "application/json", response);
+}
+
+// One schedule as JSON, next_run is null when it will not run
+static void scheduleJson(JsonObject out, uint8_t id, const Schedule& schedule, time_t next) {
+    char start[6];
+    snprintf(start, sizeof(start), "%02u:%02u", schedule.startMinute / 60, schedule.startMinute % 60);
+    
+    out["id"] = id;
+    out["name"] = (char*)schedule.name;     // Copied, the schedule is a temporary
+    out["enabled"] = schedule.enabled;
+    JsonArray days = out.createNestedArray("days");
+    for (uint8_t d = 0; d < 7; d++) {
+        if (schedule.days & (1 << d)) {
+            days.add(scheduleDayName(d));
+        }
+    }
+    out["start"] = start;
+    JsonArray steps = out.createNestedArray("steps");
+    for (uint8_t i = 0; i < schedule.count; i++) {
+        JsonObject step = steps.createNestedObject();
+        step["zone"] = schedule.steps[i].zone;
+        step["minutes"] = schedule.steps[i].minutes;
+    }
+    if (next != 0) {
+        out["next_run"] = (uint32_t)next;
+    } else {
+        out["next_run"] = nullptr;
+    }
+}
+
+void WebServer::sendSchedules(AsyncWebServerRequest *request) {
+    // A full table is too big for one document, so it is written a schedule at a time
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print("{\"schedules\":[");
+    DynamicJsonDocument doc(API_SCHEDULE_JSON_CAPACITY);
+    bool first = true;
+    for (uint8_t id = 1; id <= SCHEDULE_MAX; id++) {
+        Schedule schedule;
+        time_t next;
+        if (!schedules.get(id, schedule, next)) {
+            continue;
+        }
+        if (!first) {
+            response->print(",");
+        }
+        first = false;
+        doc.clear();
+        scheduleJson(doc.to<JsonObject>(), id, schedule, next);
+        serializeJson(doc, *response);
+    }
+    response->printf("],\"max\":%d}", SCHEDULE_MAX);
+    request->send(response);
+}
+
+void WebServer::sendSchedule(AsyncWebServerRequest *request, int code, uint8_t id) {
+    Schedule schedule;
+    time_t next;
+    if (!schedules.get(id, schedule, next)) {
+        request->send(404, "application/json", "{\"error\":\"Unknown schedule id\"}");
+        return;
+    }
+    
+    DynamicJsonDocument doc(API_SCHEDULE_JSON_CAPACITY);
+    scheduleJson(doc.to<JsonObject>(), id, schedule, next);
+    String response;
+    serializeJson(doc, response);
+    request->send(code, "application/json", response);
+}
+
+void WebServer::sendTime(AsyncWebServerRequest *request) {
+    SchedulerClock clock = schedules.clock();
+    
+    DynamicJsonDocument doc(256);
+    doc["epoch"] = (uint32_t)clock.now;
+    doc["valid"] = clock.valid;
+    doc["source"] = Scheduler::sourceName(clock.source);
+    doc["tz"] = clock.tz;
+    if (clock.valid) {
+        struct tm local;
+        localtime_r(&clock.now, &local);
+        char text[20];
+        strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local);
+        doc["local"] = text;
+    }
+    
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
+
+void WebServer::sendSequenceResult(AsyncWebServerRequest *request, SequenceResult result) {
+    switch (result) {
+        case SEQ_OK:
+            sendSequenceProgress(request, 200);
+            break;
+        case SEQ_BUS_BUSY:
+            request->send(503, "application/json", "{\"status\":\"error\",\"error\":\"Bus queue full\"}");
+            break;
+        default:
+            request->send(409, "application/json", "{\"status\":\"error\",\"error\":\"No sequence in a state to do that\"}");
+            break;
+    }
+}
+
+static const char* taskStateName(eTaskState state) {
+    switch (state) {
+    case eRunning:
+        return "running";
+    case eReady:
+        return "ready";
+    case eBlocked:
+        return "blocked";
+    case eSuspended:
+        return "suspended";
+    default:
+        return "deleted";
+    }
+}
+
+void WebServer::sendTasks(AsyncWebServerRequest *request) {
+#if configUSE_TRACE_FACILITY
+    // Room for a few tasks started between counting and listing them
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t* list = (TaskStatus_t*)malloc(capacity * sizeof(TaskStatus_t));
+    TaskLoadSample* samples = (TaskLoadSample*)malloc(capacity * sizeof(TaskLoadSample));
+    uint16_t* permille = (uint16_t*)malloc(capacity * sizeof(uint16_t));
+    if (list == NULL || samples == NULL || permille == NULL) {
+        free(list);
+        free(samples);
+        free(permille);
+        sendStatic(request, 503, "{\"error\":\"Server busy\"}");
+        return;
+    }
+
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(list, capacity, &total);
+    for (UBaseType_t i = 0; i < count; i++) {
+        samples[i].number = list[i].xTaskNumber;
+        samples[i].runTime = list[i].ulRunTimeCounter;
+    }
+    taskLoad.update(samples, count, total, permille);
+
+    DynamicJsonDocument doc(JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(count) +
+                            count * (JSON_OBJECT_SIZE(9) + configMAX_TASK_NAME_LEN));
+    doc["uptime_ms"] = millis();
+    doc["window_ms"] = taskLoad.windowMs();
+    doc["cores"] = portNUM_PROCESSORS;
+    JsonArray tasks = doc.createNestedArray("tasks");
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& task = list[i];
+        JsonObject t = tasks.createNestedObject();
+        t["name"] = (char*)task.pcTaskName;     // Copied, the task may go away
+        t["number"] = task.xTaskNumber;
+        t["state"] = taskStateName(task.eCurrentState);
+        t["priority"] = task.uxCurrentPriority;
+        t["base_priority"] = task.uxBasePriority;
+        BaseType_t core = xTaskGetCoreID(task.xHandle);
+        t["core"] = core == tskNO_AFFINITY ? -1 : (int)core;
+#if configGENERATE_RUN_TIME_STATS
+        t["cpu_percent"] = permille[i] / 10.0f;
+        t["run_time"] = (uint32_t)task.ulRunTimeCounter;
+#endif
+        t["stack_hwm"] = task.usStackHighWaterMark;
+    }
+    free(list);
+    free(samples);
+    free(permille);
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+#else
+    sendStatic(request, 501, "{\"error\":\"Task list not available in this build\"}");
+#endif
+}
+
+void WebServer::onAllocFailed(size_t size, uint32_t caps, const char* function) {
+    // Called from whichever task failed, it must not allocate
+    heapStats.failed(size, caps);
+}
+
+static void addHeapInfo(JsonObject caps, const char* name, uint32_t flags) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, flags);
+    size_t total = heap_caps_get_total_size(flags);
+    JsonObject h = caps.createNestedObject(name);
+    h["total"] = total;
+    h["free"] = info.total_free_bytes;
+    h["min_free"] = info.minimum_free_bytes;
+    h["largest_free_block"] = info.largest_free_block;
+    h["allocated_blocks"] = info.allocated_blocks;
+    h["free_blocks"] = info.free_blocks;
+    
+    // Share of the free space that cannot be had in one piece
+    h["fragmentation_percent"] = info.total_free_bytes ?
+        100 - (uint32_t)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes) : 0;
+}
+
+void WebServer::sendHeap(AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(3072);
+    doc["uptime_ms"] = millis();
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["min_free_heap"] = ESP.getMinFreeHeap();
+    doc["largest_free_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    
+    JsonObject caps = doc.createNestedObject("capabilities");
+    addHeapInfo(caps, "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0) {
+        addHeapInfo(caps, "psram", MALLOC_CAP_SPIRAM);
+    }
+    addHeapInfo(caps, "dma", MALLOC_CAP_DMA);
+    
+    JsonObject failures = doc.createNestedObject("alloc_failures");
+    failures["count"] = heapStats.failures();
+    HeapFailure last = heapStats.lastFailure();
+    if (last.ms != 0) {
+        failures["last_size"] = last.size;
+        failures["last_caps"] = last.caps;
+        failures["last_ms"] = last.ms;
+    }
+    
+#ifdef HEAP_TRACK_ALLOCATIONS
+    doc["tracking"] = true;
+#else
+    doc["tracking"] = false;
+#endif
+    JsonArray routes = doc.createNestedArray("routes");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        uint32_t requests = metrics.requests((MetricsRoute)r);
+        if (requests == 0) {
+            continue;
+        }
+        HeapRouteStats usage = heapStats.route((MetricsRoute)r);
+        JsonObject route = routes.createNestedObject();
+        route["route"] = Metrics::routeName((MetricsRoute)r);
+        route["requests"] = requests;
+        route["allocations"] = usage.allocations;
+        route["bytes"] = usage.bytes;
+        route["largest"] = usage.largest;
+        route["allocations_per_request"] = (float)usage.allocations / requests;
+    }
+    
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
@@ -0,0 +1,85 @@
+#include "ZoneTable.h"
+
+ZoneTable::ZoneTable() {
+    memset(_zones, 0, sizeof(_zones));
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    _timer = NULL;
+}
+
+void ZoneTable::begin() {
+    _timer = xTimerCreate("zones", pdMS_TO_TICKS(ZONE_EXPIRE_MS), pdTRUE, this, timerCallback);
+    if (_timer == NULL || xTimerStart(_timer, 0) != pdPASS) {
+        Serial.println("ERROR: Failed to start zone expiry timer!");
+    }
+}
+
+void ZoneTable::timerCallback(TimerHandle_t timer) {
+    static_cast<ZoneTable*>(pvTimerGetTimerID(timer))->expire();
+}
+
+void ZoneTable::commandFinished(uint8_t controller, const BusCommandStatus& status) {
+    const BusCommand& command = status.command;
+    if (command.type == BUS_CMD_PROGRAM || controller >= CONTROLLER_MAX ||
+        command.zone < API_MIN_ZONE || command.zone > API_MAX_ZONE) {
+        return;
+    }
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&_lock);
+    ZoneState& zone = _zones[controller][command.zone - API_MIN_ZONE];
+    zone.lastId = command.id;
+    zone.lastCommand = BusWorker::typeName(command.type);
+    zone.lastResult = status.result;
+
+    // A failed frame leaves the zone as it was
+    if (status.state == BUS_STATE_DONE) {
+        if (command.type == BUS_CMD_START && command.minutes > 0) {
+            // The controller runs one zone at a time, starting one stops the others
+            for (uint8_t z = 0; z < API_MAX_ZONE; z++) {
+                _zones[controller][z].active = false;
+            }
+            zone.active = true;
+            zone.startMs = now;
+            zone.endMs = now + (uint32_t)command.minutes * 60000;
+        } else {
+            // Stop, or start with 0 minutes which the controller treats as stop
+            zone.active = false;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void ZoneTable::expire() {
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t c = 0; c < CONTROLLER_MAX; c++) {
+        for (uint8_t z = 0; z < API_MAX_ZONE; z++) {
+            ZoneState& zone = _zones[c][z];
+            if (zone.active && (int32_t)(now - zone.endMs) >= 0) {
+                zone.active = false;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+bool ZoneTable::get(uint8_t controller, uint8_t zone, ZoneState& state) {
+    if (controller >= CONTROLLER_MAX || zone < API_MIN_ZONE || zone > API_MAX_ZONE) {
+        return false;
+    }
+    portENTER_CRITICAL(&_lock);
+    state = _zones[controller][zone - API_MIN_ZONE];
+    portEXIT_CRITICAL(&_lock);
+    return true;
+}
+
+bool ZoneTable::snapshot(uint8_t controller, ZoneState* zones) {
+    if (controller >= CONTROLLER_MAX) {
+        return false;
+    }
+    portENTER_CRITICAL(&_lock);
+    memcpy(zones, _zones[controller], sizeof(_zones[controller]));
+    portEXIT_CRITICAL(&_lock);
+    return true;
+}
@@ -1,15 +1,33 @@
 #include "iSprinklrNetwork.h"
+#include "BootTimeline.h"
 
 // Initialize static instance
 iSprinklrNetwork* iSprinklrNetwork::_instance = nullptr;
 
-// Static event tracking for Ethernet
-static bool ethConnected = false;
-static bool wifiConnected = false;
+// Link state, updated from the network event task
+static NetworkState linkState;
+static NetworkChangeCallback changeCallback = NULL;
+static void* changeArg = NULL;
+
+static void linkEvent(NetworkEvent event) {
+    if (event == NET_EVENT_ETH_LINK_UP || event == NET_EVENT_WIFI_LINK_UP) {
+        bootMark(BOOT_LINK_UP);
+    } else if (event == NET_EVENT_ETH_GOT_IP || event == NET_EVENT_WIFI_GOT_IP) {
+        bootMark(BOOT_ADDRESS);
+    }
+    linkState.onEvent(event);
+    iSprinklrNetwork::getInstance()->updateDefaultRoute();
+    if (changeCallback != NULL) {
+        changeCallback(linkState, changeArg);
+    }
+}
 
 iSprinklrNetwork::iSprinklrNetwork() {
-    _connected = false;
     _mode = MODE_ETHERNET;
+    _ethTimer = NULL;
+    _wifiTimer = NULL;
+    _ethStarted = false;
+    _wifiStarted = false;
     
     // Default Ethernet settings for ESP32-S3-Ethernet
     _ethCsPin = 14;
@@ -75,6 +93,16 @@ void iSprinklrNetwork::configureEthernet(int csPin, int intPin, int rstPin, int
     _ethAddr = addr;
 }
 
+uint8_t iSprinklrNetwork::ethernetPins(int* pins) {
+    pins[0] = _ethCsPin;
+    pins[1] = _ethIntPin;
+    pins[2] = _ethRstPin;
+    pins[3] = _ethMisoPin;
+    pins[4] = _ethMosiPin;
+    pins[5] = _ethSclkPin;
+    return 6;
+}
+
 void iSprinklrNetwork::configureFixedIP(const IPAddress& ip, const IPAddress& gateway, const IPAddress& subnet, 
                                         const IPAddress& dns1, const IPAddress& dns2) {
     _fixedIP.enabled = true;
@@ -108,95 +136,161 @@ void iSprinklrNetwork::disableFixedIP() {
 
 bool iSprinklrNetwork::begin(NetworkMode mode) {
     _mode = mode;
-    _connected = false;
     
-    // Register for WiFi/ETH events
-    WiFi.onEvent(WiFiEventCallback);
+    // Events and the retry timers are set up once, however often begin() is called
+    if (_ethTimer == NULL) {
+        WiFi.onEvent(WiFiEventCallback);
+        _ethTimer = xTimerCreate("net_eth", pdMS_TO_TICKS(NETWORK_RETRY_MIN_MS), pdFALSE, this, retryCallback);
+        _wifiTimer = xTimerCreate("net_wifi", pdMS_TO_TICKS(NETWORK_RETRY_MIN_MS), pdFALSE, this, retryCallback);
+        if (_ethTimer == NULL || _wifiTimer == NULL) {
+            Serial.println("ERROR: Failed to create network retry timers!");
+        }
+    }
     
     // If fixed IP is enabled, configure it before connecting
     if (_fixedIP.enabled) {
         Serial.println("Using fixed IP configuration");
     }
     
-    // Start network based on mode
-    if (_mode == MODE_ETHERNET) {
-        // Try Ethernet
-        Serial.println("Initializing Ethernet...");
-        
-        // Configure fixed IP if enabled (must be done before ETH.begin)
-        if (_fixedIP.enabled) {
-            ETH.config(_fixedIP.ip, _fixedIP.gateway, _fixedIP.subnet, _fixedIP.dns1, _fixedIP.dns2);
-        }
-        
-        if (!ETH.begin(ETH_PHY_W5500, _ethAddr, _ethCsPin, _ethIntPin, _ethRstPin,
-                     SPI3_HOST, _ethSclkPin, _ethMisoPin, _ethMosiPin)) {
-            Serial.println("ETH start Failed!");
-            return false;
-        } else {
-            // Wait for Ethernet to connect
-            unsigned long startTime = millis();
-            while (!ethConnected && (millis() - startTime < 10000)) {
-                Serial.println("Waiting for Ethernet connection...");
-                delay(500);
-            }
-            
-            if (ethConnected) {
-                _connected = true;
-                Serial.println("Connected via Ethernet");
-                if (_fixedIP.enabled) {
-                    Serial.print("Using fixed IP: ");
-                    Serial.println(ETH.localIP());
-                }
-                return true;
-            } else {
-                // Ethernet connection failed
-                return false;
-            }
-        }
+    // Nothing waits for an address, the events report it. In MODE_BOTH the two
+    // interfaces come up side by side.
+    bool started = false;
+    if (uses(NET_LINK_ETHERNET)) {
+        started |= startEthernet();
+    }
+    if (uses(NET_LINK_WIFI)) {
+        started |= startWiFi();
     }
+    return started;
+}
+
+bool iSprinklrNetwork::uses(NetworkLink link) {
+    switch (link) {
+    case NET_LINK_ETHERNET:
+        return _mode != MODE_WIFI;
+    case NET_LINK_WIFI:
+        return _mode != MODE_ETHERNET;
+    default:
+        return false;
+    }
+}
+
+bool iSprinklrNetwork::startEthernet() {
+    Serial.println("Initializing Ethernet...");
     
-    // If we're here, we're in WiFi mode
-    if (_mode == MODE_WIFI) {
-        // Try WiFi
-        if (_ssid.length() == 0) {
-            Serial.println("WiFi SSID not configured!");
-            return false;
-        }
-        
-        Serial.println("Connecting to WiFi...");
-        Serial.print("SSID: ");
-        Serial.println(_ssid);
-        
-        // Configure fixed IP if enabled (must be done before WiFi.begin)
-        if (_fixedIP.enabled) {
-            WiFi.config(_fixedIP.ip, _fixedIP.gateway, _fixedIP.subnet, _fixedIP.dns1, _fixedIP.dns2);
-        }
-        
-        WiFi.begin(_ssid.c_str(), _password.c_str());
-        
-        // Wait for WiFi to connect
-        unsigned long startTime = millis();
-        while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 20000)) {
-            Serial.print(".");
-            delay(500);
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-            wifiConnected = true;
-            _connected = true;
-            Serial.println("");
-            Serial.println("Connected to WiFi");
-            Serial.print("IP address: ");
-            Serial.println(WiFi.localIP());
-            return true;
-        } else {
-            Serial.println("");
-            Serial.println("WiFi connection failed!");
-            return false;
+    // Configure fixed IP if enabled (must be done before ETH.begin)
+    if (_fixedIP.enabled) {
+        ETH.config(_fixedIP.ip, _fixedIP.gateway, _fixedIP.subnet, _fixedIP.dns1, _fixedIP.dns2);
+    }
+    
+    if (!ETH.begin(ETH_PHY_W5500, _ethAddr, _ethCsPin, _ethIntPin, _ethRstPin,
+                 SPI3_HOST, _ethSclkPin, _ethMisoPin, _ethMosiPin)) {
+        Serial.println("ERROR: ETH start failed!");
+        retryLater(NET_LINK_ETHERNET);
+        return false;
+    }
+    
+    // From here the driver follows the cable and DHCP restarts on every link up
+    _ethStarted = true;
+    bootMark(BOOT_NETWORK_STARTED);
+    return true;
+}
+
+bool iSprinklrNetwork::startWiFi() {
+    if (_ssid.length() == 0) {
+        Serial.println("WiFi SSID not configured!");
+        return false;
+    }
+    
+    Serial.println("Connecting to WiFi...");
+    Serial.print("SSID: ");
+    Serial.println(_ssid);
+    
+    // Configure fixed IP if enabled (must be done before WiFi.begin). With
+    // both interfaces up the address belongs to Ethernet and WiFi uses DHCP.
+    if (_fixedIP.enabled && _mode == MODE_WIFI) {
+        WiFi.config(_fixedIP.ip, _fixedIP.gateway, _fixedIP.subnet, _fixedIP.dns1, _fixedIP.dns2);
+    }
+    
+    // Reconnection is left to the retry timer, which backs off
+    WiFi.setAutoReconnect(false);
+    if (WiFi.begin(_ssid.c_str(), _password.c_str()) == WL_CONNECT_FAILED) {
+        Serial.println("ERROR: WiFi start failed!");
+        retryLater(NET_LINK_WIFI);
+        return false;
+    }
+    _wifiStarted = true;
+    bootMark(BOOT_NETWORK_STARTED);
+    linkState.retrying(NET_LINK_WIFI);
+    armRetry(NET_LINK_WIFI, NETWORK_CONNECT_TIMEOUT_MS);
+    return true;
+}
+
+void iSprinklrNetwork::armRetry(NetworkLink link, uint32_t delayMs) {
+    TimerHandle_t timer = link == NET_LINK_ETHERNET ? _ethTimer : _wifiTimer;
+    if (timer != NULL) {
+        xTimerChangePeriod(timer, pdMS_TO_TICKS(delayMs), 0);
+    }
+}
+
+void iSprinklrNetwork::retryLater(NetworkLink link) {
+    uint32_t delayMs = linkState.failed(link);
+    Serial.print(link == NET_LINK_ETHERNET ? "Ethernet" : "WiFi");
+    Serial.print(" retry in ");
+    Serial.print(delayMs);
+    Serial.println(" ms");
+    armRetry(link, delayMs);
+}
+
+void iSprinklrNetwork::retryCallback(TimerHandle_t timer) {
+    iSprinklrNetwork* self = static_cast<iSprinklrNetwork*>(pvTimerGetTimerID(timer));
+    self->retry(timer == self->_ethTimer ? NET_LINK_ETHERNET : NET_LINK_WIFI);
+}
+
+void iSprinklrNetwork::retry(NetworkLink link) {
+    if (link == NET_LINK_ETHERNET) {
+        if (!_ethStarted) {
+            startEthernet();
         }
+        return;
     }
     
-    return false;
+    if (!_wifiStarted) {
+        startWiFi();
+        return;
+    }
+    LinkPhase phase = linkState.status(NET_LINK_WIFI).phase;
+    if (phase == LINK_UP) {
+        return;
+    }
+    if (phase == LINK_CONNECTING) {
+        // No address within the timeout, drop the attempt and back off
+        retryLater(NET_LINK_WIFI);
+        WiFi.disconnect();
+        return;
+    }
+    
+    linkState.retrying(NET_LINK_WIFI);
+    WiFi.reconnect();
+    armRetry(NET_LINK_WIFI, NETWORK_CONNECT_TIMEOUT_MS);
+}
+
+void iSprinklrNetwork::updateDefaultRoute() {
+    // Outgoing traffic (SNTP, replies to new connections) follows the
+    // interface in use. The listeners are bound to every address and stay up.
+    if (_mode != MODE_BOTH) {
+        return;
+    }
+    switch (linkState.activeLink()) {
+    case NET_LINK_ETHERNET:
+        ETH.setDefault();
+        break;
+    case NET_LINK_WIFI:
+        WiFi.STA.setDefault();
+        break;
+    default:
+        break;
+    }
 }
 
 void iSprinklrNetwork::WiFiEventCallback(arduino_event_id_t event) {
@@ -207,6 +301,7 @@ void iSprinklrNetwork::WiFiEventCallback(arduino_event_id_t event) {
         break;
     case ARDUINO_EVENT_ETH_CONNECTED:
         Serial.println("ETH Connected");
+        linkEvent(NET_EVENT_ETH_LINK_UP);
         break;
     case ARDUINO_EVENT_ETH_GOT_IP:
         Serial.print("ETH MAC: ");
@@ -221,24 +316,40 @@ void iSprinklrNetwork::WiFiEventCallback(arduino_event_id_t event) {
         Serial.print("Mbps");
         Serial.print(", GatewayIP: ");
         Serial.println(ETH.gatewayIP());
-        ethConnected = true;
+        linkEvent(NET_EVENT_ETH_GOT_IP);
+        break;
+    case ARDUINO_EVENT_ETH_LOST_IP:
+        Serial.println("ETH Lost IP");
+        linkEvent(NET_EVENT_ETH_LOST_IP);
         break;
     case ARDUINO_EVENT_ETH_DISCONNECTED:
         Serial.println("ETH Disconnected");
-        ethConnected = false;
+        linkEvent(NET_EVENT_ETH_LINK_DOWN);
         break;
     case ARDUINO_EVENT_ETH_STOP:
         Serial.println("ETH Stopped");
-        ethConnected = false;
+        linkEvent(NET_EVENT_ETH_LINK_DOWN);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+        Serial.println("WiFi Associated");
+        linkEvent(NET_EVENT_WIFI_LINK_UP);
         break;
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
         Serial.print("WiFi Connected. IP address: ");
         Serial.println(WiFi.localIP());
-        wifiConnected = true;
+        linkEvent(NET_EVENT_WIFI_GOT_IP);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        Serial.println("WiFi Lost IP");
+        linkEvent(NET_EVENT_WIFI_LOST_IP);
         break;
     case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
         Serial.println("WiFi Disconnected");
-        wifiConnected = false;
+        linkEvent(NET_EVENT_WIFI_LINK_DOWN);
+        // Disconnects that end a failed attempt are already waiting out their backoff
+        if (linkState.status(NET_LINK_WIFI).phase != LINK_BACKOFF) {
+            getInstance()->retryLater(NET_LINK_WIFI);
+        }
         break;
     default:
         break;
@@ -246,21 +357,29 @@ void iSprinklrNetwork::WiFiEventCallback(arduino_event_id_t event) {
 }
 
 IPAddress iSprinklrNetwork::getIP() {
-    if (ethConnected) {
+    switch (linkState.activeLink()) {
+    case NET_LINK_ETHERNET:
         return ETH.localIP();
-    } else if (wifiConnected) {
+    case NET_LINK_WIFI:
         return WiFi.localIP();
-    } else {
+    default:
         return IPAddress(0, 0, 0, 0);
     }
 }
 
 String iSprinklrNetwork::getNetworkType() {
-    if (ethConnected) {
-        return "Ethernet";
-    } else if (wifiConnected) {
-        return "WiFi";
-    } else {
-        return "Disconnected";
-    }
+    return String(linkState.typeName());
+}
+
+bool iSprinklrNetwork::isConnected() {
+    return linkState.isConnected();
+}
+
+const NetworkState& iSprinklrNetwork::getLinkState() {
+    return linkState;
+}
+
+void iSprinklrNetwork::onChange(NetworkChangeCallback callback, void* arg) {
+    changeArg = arg;
+    changeCallback = callback;
 }
@@ -2,6 +2,7 @@
 #include "HunterRoam.h"
 #include "WebServer.h"
 #include "iSprinklrNetwork.h"
+#include "BootTimeline.h"
 
 #define LED 2
 
@@ -10,13 +11,14 @@ WebServer webServer;
 iSprinklrNetwork* network;
 
 // Network mode from build flags 
-// 1 = Ethernet Only, 2 = WiFi Only
+// 1 = Ethernet Only, 2 = WiFi Only, 3 = Ethernet with WiFi failover
 #ifndef NETWORK_MODE
   #define NETWORK_MODE 1  // Default to Ethernet only mode if not specified
 #endif
 
 void setup()
 {
+    bootMark(BOOT_SETUP);
     Serial.begin(115200);
     Serial.setDebugOutput(true);
     Serial.println();
@@ -44,54 +46,30 @@ void setup()
             mode = MODE_WIFI;
             Serial.println("Network Mode: WiFi Only");
             break;
+        case 3:
+            mode = MODE_BOTH;
+            Serial.println("Network Mode: Ethernet with WiFi failover");
+            break;
         default:
             mode = MODE_ETHERNET;
             Serial.println("Network Mode: Ethernet Only");
             break;
     }
     
-    // Initialize network
+    // Start the network, it connects and reconnects in the background
     if (!network->begin(mode)) {
-        Serial.println("ERROR: Failed to connect to network!");
-        // Continue anyway - maybe the connection will be established later
-    }
-    
-    // Wait up to 30 seconds for network connection
-    unsigned long startTime = millis();
-    while (!network->isConnected() && (millis() - startTime < 30000)) {
-        Serial.println("Waiting for network connection...");
-        delay(1000);
+        Serial.println("ERROR: Failed to start network!");
     }
     
-    if (network->isConnected()) {
-        Serial.print("Connected to network via ");
-        Serial.println(network->getNetworkType());
-        Serial.print("IP Address: ");
-        Serial.println(network->getIP());
-    } else {
-        Serial.println("WARNING: No network connection established!");
-    }
-    
-    // Start the web server
+    // The bus and scheduler start while the link comes up, HTTP listens once
+    // there is an address
     webServer.begin();
     Serial.println("System initialization complete");
 }
 
 void loop()
 {
-    // Check network status periodically
-    static unsigned long lastCheck = 0;
-    if (millis() - lastCheck > 10000) {  // Every 10 seconds
-        lastCheck = millis();
-        
-        if (network->isConnected()) {
-            // All good, nothing to do
-        } else {
-            Serial.println("Network connection lost! Trying to reconnect...");
-            network->begin();  // Try to reconnect with same settings
-        }
-    }
-    
-    // Do nothing else. Everything is done in another task by the web server
+    // Nothing to do. The web server runs in its own tasks and the network
+    // reconnects from its events.
     delay(1000);
 }
@@ -32,8 +32,8 @@ function make_request() {
   
   echo -e "Response: $response\n"
   
-  # Optional: Add a small delay between requests
-  sleep 0.5
+  # Stay under the per-client rate limit of one command a second
+  sleep 1
 }
 
 # Test 0: Status check - Enhanced system information
@@ -87,6 +87,155 @@ make_request "Invalid zone value in stop request" "/api/stop" "POST" '{"zone":0}
 # Test 16: Zone out of range in stop request
 make_request "Zone out of range in stop request" "/api/stop" "POST" '{"zone":21}'
 
+# Test 17: Command status lookup
+make_request "Command status lookup" "/api/commands/1" "GET" ""
+
+# Test 18: Unknown command id
+make_request "Unknown command id" "/api/commands/0" "GET" ""
+
+# Test 19: Start a zone sequence
+make_request "Start zone sequence" "/api/sequence" "POST" '{"steps":[{"zone":1,"minutes":1},{"zone":2,"minutes":1}]}'
+
+# Test 20: Sequence progress
+make_request "Sequence progress" "/api/sequence" "GET" ""
+
+# Test 21: Pause, resume and skip the sequence
+make_request "Pause sequence" "/api/sequence/pause" "POST" ""
+make_request "Resume sequence" "/api/sequence/resume" "POST" ""
+make_request "Skip sequence step" "/api/sequence/skip" "POST" ""
+
+# Test 22: Cancel the sequence
+make_request "Cancel sequence" "/api/sequence/cancel" "POST" ""
+
+# Test 23: Sequence with an invalid step
+make_request "Sequence with invalid step" "/api/sequence" "POST" '{"steps":[{"zone":1,"minutes":0}]}'
+
+# Test 24: Bus timing statistics
+make_request "Bus timing statistics" "/api/bus/stats" "GET" ""
+
+# Test 25: Duplicate start is coalesced, both responses carry the same id
+make_request "Start zone for coalescing" "/api/start" "POST" '{"zone":3,"minutes":5}'
+make_request "Duplicate start (coalesced)" "/api/start" "POST" '{"zone":3,"minutes":5}'
+make_request "Stop coalesced zone" "/api/stop" "POST" '{"zone":3}'
+
+# Test 26: Controller registry
+make_request "List controllers" "/api/controllers" "GET" ""
+make_request "Add controller without pin" "/api/controllers" "POST" '{}'
+make_request "Start zone on controller 0" "/api/start" "POST" '{"zone":4,"minutes":1,"controller":0}'
+make_request "Controller out of range" "/api/start" "POST" '{"zone":4,"minutes":1,"controller":4}'
+make_request "Stop zone on controller 0" "/api/stop" "POST" '{"zone":4,"controller":0}'
+
+# Test 27: Liveness probe
+make_request "Liveness probe" "/api/ping" "GET" ""
+
+# Test 28: Conditional status request, expect HTTP 304
+echo -e "\n== Test: Conditional status request =="
+etag=$(curl -s -D - -o /dev/null "$BASE_URL/api/status" | grep -i '^etag:' | cut -d' ' -f2 | tr -d '\r')
+echo "ETag: $etag"
+echo "HTTP status: $(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: $etag" "$BASE_URL/api/status")"
+
+# Test 29: Event stream, listen for a few seconds while a zone is stopped
+echo -e "\n== Test: Event stream =="
+curl -s -N --max-time 5 "$BASE_URL/api/events" &
+sleep 1
+curl -s -o /dev/null -X POST -H "Content-Type: application/json" -d '{"zone":6}' "$BASE_URL/api/stop"
+wait
+
+# Test 30: Device-side zone state
+make_request "Start zone for zone state" "/api/start" "POST" '{"zone":7,"minutes":1}'
+sleep 1
+make_request "Zone state table" "/api/zones" "GET" ""
+make_request "Single zone state" "/api/zones/7" "GET" ""
+make_request "Zone state out of range" "/api/zones/21" "GET" ""
+make_request "Stop zone for zone state" "/api/stop" "POST" '{"zone":7}'
+
+# Test 31: Batch commands
+make_request "Batch start and stop" "/api/batch" "POST" '{"commands":[{"command":"start","zone":8,"minutes":1},{"command":"stop","zone":8}]}'
+make_request "Batch with invalid command" "/api/batch" "POST" '{"commands":[{"command":"stop","zone":8},{"command":"stop","zone":21}]}'
+make_request "Batch without commands" "/api/batch" "POST" '{"commands":[]}'
+
+# Test 32: Oversize body, expect HTTP 413
+echo -e "\n== Test: Oversize request body =="
+big=$(printf '{"zone":1,"minutes":1,"note":"%03000d"}' 0)
+echo "HTTP status: $(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d "$big" "$BASE_URL/api/start")"
+
+# Test 33: Prometheus metrics
+echo -e "\n== Test: Prometheus metrics =="
+curl -s "$BASE_URL/metrics" | head -n 20
+
+# Test 34: Rate limiting, a burst of starts ends in HTTP 429 while a stop still passes
+echo -e "\n== Test: Rate limiting =="
+for i in $(seq 1 12); do
+  echo -n "$(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d '{"zone":9,"minutes":0}' "$BASE_URL/api/start") "
+done
+echo
+curl -s -D - -o /dev/null -X POST -H "Content-Type: application/json" -d '{"zone":9,"minutes":0}' "$BASE_URL/api/start" | grep -i '^retry-after:'
+echo "Stop: $(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d '{"zone":9}' "$BASE_URL/api/stop")"
+
+# Test 35: Binary command protocol, a stop frame for zone 9 over UDP, expect an ACK reply
+echo -e "\n== Test: Binary command protocol =="
+python3 - "$SERVER_ADDRESS" <<'PYEOF'
+import socket, sys
+def fletcher16(data):
+    a = b = 0
+    for byte in data:
+        a = (a + byte) % 255
+        b = (b + a) % 255
+    return (b << 8) | a
+cmd = bytes([0x42, 0x72, 9, 0])
+frame = b'\xff' + cmd + fletcher16(cmd).to_bytes(2, 'big') + b'\xaf'
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.settimeout(2)
+sock.sendto(frame, (sys.argv[1], 5640))
+try:
+    reply = sock.recv(7)
+    ok = reply[2] == 0xae and reply[4:6] == fletcher16(frame).to_bytes(2, 'little')
+    print("Reply: %s (%s)" % (reply.hex(), "ACK" if ok else "unexpected"))
+except socket.timeout:
+    print("No reply")
+PYEOF
+
+# Test 36: Idempotency keys, the retry gets the same id and a reused key for another zone gets HTTP 422
+echo -e "\n== Test: Idempotency keys =="
+key="api-test-$(date +%s)"
+for i in 1 2; do
+  curl -s -X POST -H "Content-Type: application/json" -H "Idempotency-Key: $key" -d '{"zone":10}' "$BASE_URL/api/stop"
+  echo
+done
+echo "Reused key: $(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -H "Idempotency-Key: $key" -d '{"zone":11}' "$BASE_URL/api/stop")"
+
+# Test 37: On-device schedules and clock. The test schedule is disabled, and deleted again.
+make_request "Get time" "/api/time" "GET" ""
+echo -e "\n== Test: Add schedule =="
+schedule=$(curl -s -X POST -H "Content-Type: application/json" -d '{"name":"API test","enabled":false,"days":["mon","thu"],"start":"05:45","steps":[{"zone":1,"minutes":5}]}' "$BASE_URL/api/schedules")
+echo "Response: $schedule"
+schedule_id=$(echo "$schedule" | python3 -c 'import json, sys; print(json.load(sys.stdin).get("id", ""))' 2>/dev/null)
+make_request "List schedules" "/api/schedules" "GET" ""
+make_request "Schedule with bad start time" "/api/schedules" "POST" '{"days":["mon"],"start":"25:00","steps":[{"zone":1,"minutes":5}]}'
+make_request "Schedule with bad day" "/api/schedules" "POST" '{"days":["someday"],"start":"05:45","steps":[{"zone":1,"minutes":5}]}'
+if [ -n "$schedule_id" ]; then
+  echo -e "\n== Test: Delete schedule $schedule_id =="
+  echo "HTTP status: $(curl -s -o /dev/null -w "%{http_code}" -X DELETE "$BASE_URL/api/schedules/$schedule_id")"
+fi
+
+# Test 38: Command history, the first page and an empty page past the end
+make_request "Command history" "/api/history?limit=5" "GET" ""
+make_request "Command history past the end" "/api/history?since=4294967295" "GET" ""
+
+# Test 39: Task list, twice so the second covers a short CPU window
+make_request "Task list" "/api/tasks" "GET" ""
+sleep 2
+make_request "Task list again" "/api/tasks" "GET" ""
+
+# Test 40: Heap summary with the allocations of the routes tested so far
+make_request "Heap summary" "/api/debug/heap" "GET" ""
+
+# Test 41: Reserved controller pins and removing controllers, all refused
+make_request "Add controller on an Ethernet pin" "/api/controllers" "POST" '{"pin":11}'
+make_request "Add controller on a flash pin" "/api/controllers" "POST" '{"pin":30}'
+make_request "Remove the built-in controller" "/api/controllers/0" "DELETE" ""
+make_request "Remove an unknown controller" "/api/controllers/3" "DELETE" ""
+
 echo -e "\n==============================================="
 echo "  API Testing Complete"
 echo "==============================================="
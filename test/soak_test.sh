@@ -0,0 +1,86 @@
+#!/bin/bash
+
+# Heap Soak Test for iSprinklr ESP WebServer
+# Sends a long run of status, stop and rejected start requests and samples the
+# heap from /api/status along the way. The largest free block should stay flat;
+# a steady decline means the request path is fragmenting the heap.
+#
+# The requests come far faster than the rate limit allows, so most would get
+# HTTP 429 without reaching the JSON parser. Build the firmware for a soak run
+# with -D ADMISSION_CLIENT_REFILL_MS=1 -D ADMISSION_BUS_REFILL_MS=1.
+#
+# Usage: ./soak_test.sh [server] [requests] [sample_every]
+# Samples are written to soak_results.csv in the current directory.
+
+# Set default server address or use provided argument
+SERVER_ADDRESS=${1:-"192.168.88.25"}
+REQUESTS=${2:-100000}
+SAMPLE_EVERY=${3:-1000}
+BASE_URL="http://${SERVER_ADDRESS}"
+RESULTS="soak_results.csv"
+
+# Allowed drop of the largest free block between the first and last sample
+MAX_BLOCK_DROP=1024
+
+echo "==============================================="
+echo "  iSprinklr ESP Heap Soak Test"
+echo "  Server: $BASE_URL"
+echo "  Requests: $REQUESTS"
+echo "==============================================="
+
+# Read one heap sample from /api/status as "free_heap,min_free_heap,largest_free_block"
+function sample_heap() {
+  curl -s "$BASE_URL/api/status" | python3 -c '
+import json, sys
+m = json.load(sys.stdin)["memory"]
+print("%d,%d,%d" % (m["free_heap"], m["min_free_heap"], m["largest_free_block"]))
+'
+}
+
+echo "request,free_heap,min_free_heap,largest_free_block" > "$RESULTS"
+first=$(sample_heap)
+if [ -z "$first" ]; then
+  echo "ERROR: No status from $BASE_URL"
+  exit 1
+fi
+echo "0,$first" >> "$RESULTS"
+echo "Start: $first"
+
+failures=0
+for ((i = 1; i <= REQUESTS; i++)); do
+  # Rotate through the JSON paths without watering anything: stop is harmless
+  # and coalesced, the start requests fail validation
+  case $((i % 4)) in
+    0) code=$(curl -s -o /dev/null -w "%{http_code}" "$BASE_URL/api/status") ;;
+    1) code=$(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d '{"zone":1}' "$BASE_URL/api/stop") ;;
+    2) code=$(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d '{"zone":21,"minutes":10}' "$BASE_URL/api/start") ;;
+    3) code=$(curl -s -o /dev/null -w "%{http_code}" -X POST -H "Content-Type: application/json" -d '{"zone":5' "$BASE_URL/api/start") ;;
+  esac
+
+  if [ "$code" = "000" ] || [ "$code" -ge 500 ]; then
+    failures=$((failures + 1))
+  fi
+
+  if ((i % SAMPLE_EVERY == 0)); then
+    heap=$(sample_heap)
+    echo "$i,$heap" >> "$RESULTS"
+    echo "$i requests: $heap ($failures failures)"
+  fi
+done
+
+last=$(tail -n 1 "$RESULTS" | cut -d, -f2-)
+first_block=$(echo "$first" | cut -d, -f3)
+last_block=$(echo "$last" | cut -d, -f3)
+drop=$((first_block - last_block))
+
+echo -e "\n==============================================="
+echo "  Largest free block: $first_block -> $last_block bytes"
+echo "  Failed requests: $failures"
+echo "  Samples: $RESULTS"
+echo "==============================================="
+
+if [ "$drop" -gt "$MAX_BLOCK_DROP" ]; then
+  echo "FAIL: largest free block dropped by $drop bytes"
+  exit 1
+fi
+echo "PASS"
@@ -0,0 +1,138 @@
+/**
+ * Tests for the token-bucket admission control. Run on the host with:
+ *
+ * 		pio test -e native -f test_admission_control
+ */
+
+#include <unity.h>
+#include <new>
+#include "AdmissionControl.h"
+
+static AdmissionControl admission;
+
+#define CLIENT_A 0x0a00000a
+#define CLIENT_B 0x0b00000a
+
+void setUp(void) {
+	new (&admission) AdmissionControl();
+}
+
+void tearDown(void) {}
+
+void test_unlimited_routes_always_pass(void) {
+	for (int i = 0; i < 100; i++) {
+		TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_ANY, 0).admitted);
+	}
+}
+
+void test_client_is_refused_after_its_burst(void) {
+	int admitted = 0;
+	for (int i = 0; i < 20; i++) {
+		admitted += admission.admit(CLIENT_A, ADMIT_COMMAND, 0).admitted;
+	}
+	TEST_ASSERT_EQUAL(ADMISSION_CLIENT_BURST - ADMISSION_CLIENT_STOP_RESERVE, admitted);
+
+	AdmissionDecision refused = admission.admit(CLIENT_A, ADMIT_COMMAND, 0);
+	TEST_ASSERT_FALSE(refused.admitted);
+	TEST_ASSERT_EQUAL_UINT32(ADMISSION_CLIENT_REFILL_MS / 1000, refused.retryAfterS);
+
+	// One token comes back each refill period
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_COMMAND, ADMISSION_CLIENT_REFILL_MS).admitted);
+	TEST_ASSERT_FALSE(admission.admit(CLIENT_A, ADMIT_COMMAND, ADMISSION_CLIENT_REFILL_MS).admitted);
+}
+
+void test_stop_gets_through_when_starts_are_refused(void) {
+	while (admission.admit(CLIENT_A, ADMIT_COMMAND, 0).admitted) {
+	}
+	for (int i = 0; i < ADMISSION_CLIENT_STOP_RESERVE; i++) {
+		TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+	}
+	TEST_ASSERT_FALSE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+}
+
+void test_clients_have_their_own_buckets(void) {
+	// Paced at the bus refill rate, so only the client's own bucket runs dry
+	uint32_t now = 0;
+	while (admission.admit(CLIENT_A, ADMIT_COMMAND, now).admitted) {
+		now += ADMISSION_BUS_REFILL_MS;
+	}
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_B, ADMIT_COMMAND, now).admitted);
+}
+
+void test_bus_budget_is_shared(void) {
+	// Many clients together drain the bus budget down to the stop reserve
+	int admitted = 0;
+	for (uint32_t ip = 1; ip <= ADMISSION_CLIENTS; ip++) {
+		admitted += admission.admit(ip, ADMIT_COMMAND, 0).admitted;
+	}
+	TEST_ASSERT_EQUAL(ADMISSION_BUS_BURST - ADMISSION_BUS_STOP_RESERVE, admitted);
+
+	// A fresh client still gets a stop through
+	TEST_ASSERT_TRUE(admission.admit(ADMISSION_CLIENTS + 1, ADMIT_STOP, 0).admitted);
+}
+
+void test_charge_keeps_the_stop_reserve(void) {
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_COMMAND, 0).admitted);
+	admission.charge(CLIENT_A, 20, 0);
+
+	// Commands wait for the refill, stops from the same client still pass
+	AdmissionDecision refused = admission.admit(CLIENT_A, ADMIT_COMMAND, 0);
+	TEST_ASSERT_FALSE(refused.admitted);
+	TEST_ASSERT_EQUAL_UINT32(ADMISSION_CLIENT_REFILL_MS / 1000, refused.retryAfterS);
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_B, ADMIT_STOP, 0).admitted);
+}
+
+void test_charge_never_refills_a_spent_reserve(void) {
+	while (admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted) {
+	}
+	admission.charge(CLIENT_A, 5, 0);
+	TEST_ASSERT_FALSE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+}
+
+void test_promote_needs_a_command_token(void) {
+	// Admitted as a stop, then found to hold starts
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+	TEST_ASSERT_TRUE(admission.promote(CLIENT_A, 0).admitted);
+
+	// Down to the reserve, a stop still passes but a promoted one is refused
+	while (admission.admit(CLIENT_A, ADMIT_COMMAND, 0).admitted) {
+	}
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+	AdmissionDecision refused = admission.promote(CLIENT_A, 0);
+	TEST_ASSERT_FALSE(refused.admitted);
+	TEST_ASSERT_EQUAL_UINT32(ADMISSION_CLIENT_REFILL_MS / 1000, refused.retryAfterS);
+
+	// The refused request's token came back, so the reserve is whole again
+	for (int i = 0; i < ADMISSION_CLIENT_STOP_RESERVE; i++) {
+		TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+	}
+	TEST_ASSERT_FALSE(admission.admit(CLIENT_A, ADMIT_STOP, 0).admitted);
+}
+
+void test_frequent_refills_are_exact(void) {
+	// Down to the bus reserve, commands need one more token
+	for (int i = 0; i < ADMISSION_BUS_BURST - ADMISSION_BUS_STOP_RESERVE; i++) {
+		TEST_ASSERT_TRUE(admission.admit(CLIENT_A, ADMIT_COMMAND, 0).admitted);
+	}
+
+	// A request every millisecond must not lose the fractions of a thousandth
+	for (uint32_t t = 1; t < ADMISSION_BUS_REFILL_MS; t++) {
+		TEST_ASSERT_FALSE(admission.admit(CLIENT_B, ADMIT_COMMAND, t).admitted);
+	}
+	TEST_ASSERT_TRUE(admission.admit(CLIENT_B, ADMIT_COMMAND, ADMISSION_BUS_REFILL_MS).admitted);
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_unlimited_routes_always_pass);
+	RUN_TEST(test_client_is_refused_after_its_burst);
+	RUN_TEST(test_stop_gets_through_when_starts_are_refused);
+	RUN_TEST(test_clients_have_their_own_buckets);
+	RUN_TEST(test_bus_budget_is_shared);
+	RUN_TEST(test_charge_keeps_the_stop_reserve);
+	RUN_TEST(test_charge_never_refills_a_spent_reserve);
+	RUN_TEST(test_promote_needs_a_command_token);
+	RUN_TEST(test_frequent_refills_are_exact);
+	return UNITY_END();
+}
@@ -0,0 +1,335 @@
+/**
+ * Host microbenchmarks for the hot paths.
+ *
+ * Each benchmark reports nanoseconds and heap allocations per operation for
+ * the frame encoder, the bit-bang transmitter on the simulated HAL, request
+ * parsing and validation, and response serialisation. Every one of these
+ * paths must stay off the heap, so each also asserts zero allocations. Run on the host with:
+ *
+ * 		pio test -e native -f test_benchmarks -v
+ */
+
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Hal.h"
+#include "HunterRoam.h"
+#include "ApiRequests.h"
+#include "ResponsePool.h"
+
+#define BENCH_ITERATIONS 20000
+
+// Heap allocations made by the benchmarked code
+static volatile size_t allocations = 0;
+
+#ifdef __GLIBC__
+// Count at the malloc level so both operator new and ArduinoJson's allocator are seen
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+extern "C" void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+	allocations++;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+	__libc_free(ptr);
+}
+#else
+// Elsewhere only operator new can be counted portably
+void *operator new(size_t size) {
+	allocations++;
+	void *ptr = malloc(size);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+#endif
+
+struct BenchResult {
+	double nsPerOp;
+	double allocsPerOp;
+};
+
+// Keep the optimiser from dropping results
+static volatile size_t sink = 0;
+
+template <typename F>
+static BenchResult bench(const char *name, F op) {
+	// Warm up caches and any lazy initialisation
+	for (int i = 0; i < 100; i++) {
+		op(i);
+	}
+
+	size_t before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		op(i);
+	}
+	auto end = std::chrono::steady_clock::now();
+	size_t allocs = allocations - before;
+
+	BenchResult result;
+	result.nsPerOp = std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ITERATIONS;
+	result.allocsPerOp = (double)allocs / BENCH_ITERATIONS;
+
+	char line[128];
+	snprintf(line, sizeof(line), "%-28s %10.1f ns/op %8.2f allocs/op", name, result.nsPerOp, result.allocsPerOp);
+	TEST_MESSAGE(line);
+	return result;
+}
+
+void setUp(void) {
+	halNativeReset();
+}
+
+void tearDown(void) {}
+
+void test_bench_zone_frame(void) {
+	BenchResult result = bench("hunterZoneFrame", [](int i) {
+		HunterZoneFrame frame = hunterZoneFrame(1 + i % HUNTER_MAX_ZONE, i % (HUNTER_MAX_TIME + 1));
+		sink += frame[4];
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+}
+
+void test_bench_start_zone(void) {
+	HunterRoam roam(HUNTER_PIN, HUNTER_TX_BITBANG);
+	BenchResult result = bench("HunterRoam::startZone", [&roam](int i) {
+		halNativeReset();
+		sink += roam.startZone(1 + i % 20, 10);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+
+	// Every pulse of the frame reached the pin
+	TEST_ASSERT_GREATER_THAN(200, halNativePinWriteCount());
+}
+
+void test_bench_parse_start(void) {
+	static const char body[] = "{\"zone\":5,\"minutes\":10}";
+	BenchResult bench_result = bench("parseStartRequest", [](int i) {
+		StartRequest start;
+		ApiResult result = parseStartRequest(body, sizeof(body) - 1, start);
+		sink += result.code + start.zone;
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, bench_result.allocsPerOp);
+
+	StartRequest start;
+	ApiResult result = parseStartRequest(body, sizeof(body) - 1, start);
+	TEST_ASSERT_NULL(result.error);
+	TEST_ASSERT_EQUAL(5, start.zone);
+	TEST_ASSERT_EQUAL(10, start.minutes);
+}
+
+void test_bench_parse_stop(void) {
+	static const char body[] = "{\"zone\":5}";
+	BenchResult bench_result = bench("parseStopRequest", [](int i) {
+		StopRequest stop;
+		ApiResult result = parseStopRequest(body, sizeof(body) - 1, stop);
+		sink += result.code + stop.zone;
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, bench_result.allocsPerOp);
+}
+
+void test_bench_validation(void) {
+	static const char body[] = "{\"zone\":21,\"minutes\":10}";
+	BenchResult bench_result = bench("parseStartRequest (invalid)", [](int i) {
+		StartRequest start;
+		ApiResult result = parseStartRequest(body, sizeof(body) - 1, start);
+		char out[API_SMALL_RESPONSE_SIZE];
+		sink += writeErrorResponse(out, sizeof(out), result);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, bench_result.allocsPerOp);
+
+	StartRequest start;
+	ApiResult result = parseStartRequest(body, sizeof(body) - 1, start);
+	TEST_ASSERT_EQUAL(400, result.code);
+	TEST_ASSERT_EQUAL_STRING("Zone must be between 1 and 20", result.error);
+}
+
+void test_bench_accepted_response(void) {
+	BenchResult result = bench("writeAcceptedResponse", [](int i) {
+		char out[API_SMALL_RESPONSE_SIZE];
+		sink += writeAcceptedResponse(out, sizeof(out), i, 0, 5, 10);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+
+	char out[API_SMALL_RESPONSE_SIZE];
+	TEST_ASSERT_GREATER_THAN(0, writeAcceptedResponse(out, sizeof(out), 7, 0, 5, 10));
+	TEST_ASSERT_EQUAL_STRING("{\"status\":\"accepted\",\"id\":7,\"controller\":0,\"zone\":5,\"minutes\":10}", out);
+}
+
+void test_bench_status_response(void) {
+	StatusInfo status;
+	memset(&status, 0, sizeof(status));
+	status.chipModel = "ESP32-S3";
+	status.resetReason = "Power on";
+	strcpy(status.idfVersion, "5.1.4");
+	status.network.connected = true;
+	status.network.type = "Ethernet";
+	status.network.state = "up";
+	status.network.upMs = 4210;
+	strcpy(status.network.ip, "192.168.88.7");
+	strcpy(status.network.gateway, "192.168.88.1");
+	strcpy(status.network.subnet, "255.255.255.0");
+	strcpy(status.network.mac, "AA:BB:CC:DD:EE:FF");
+	status.network.linkSpeed = 100;
+	status.network.fullDuplex = true;
+	// Failover mode, both interfaces up
+	status.network.ethernet.enabled = true;
+	status.network.ethernet.state = "up";
+	status.network.ethernet.upMs = 4210;
+	strcpy(status.network.ethernet.ip, "192.168.88.7");
+	status.network.ethernet.linkSpeed = 100;
+	status.network.ethernet.fullDuplex = true;
+	status.network.wifi.enabled = true;
+	status.network.wifi.state = "up";
+	status.network.wifi.upMs = 3980;
+	strcpy(status.network.wifi.ip, "192.168.88.23");
+	status.network.wifi.rssi = -61;
+
+	BenchResult result = bench("writeStatusResponse", [&status](int i) {
+		char out[API_STATUS_RESPONSE_SIZE];
+		status.uptimeMs = i;
+		sink += writeStatusResponse(out, sizeof(out), status);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+
+	char out[API_STATUS_RESPONSE_SIZE];
+	TEST_ASSERT_GREATER_THAN(0, writeStatusResponse(out, sizeof(out), status));
+}
+
+void test_bench_batch(void) {
+	// Emergency stop: every zone in one request
+	static char body[BATCH_MAX_COMMANDS * 32];
+	size_t len = snprintf(body, sizeof(body), "{\"commands\":[");
+	for (int zone = API_MIN_ZONE; zone <= API_MAX_ZONE; zone++) {
+		len += snprintf(body + len, sizeof(body) - len, "%s{\"command\":\"stop\",\"zone\":%d}", zone > API_MIN_ZONE ? "," : "", zone);
+	}
+	len += snprintf(body + len, sizeof(body) - len, "]}");
+
+	static BatchRequest batch;
+	static uint32_t ids[BATCH_MAX_COMMANDS];
+	static const char *states[BATCH_MAX_COMMANDS];
+	for (int i = 0; i < BATCH_MAX_COMMANDS; i++) {
+		ids[i] = 1000 + i;
+		states[i] = "queued";
+	}
+
+	BenchResult result = bench("batch parse and response", [len](int i) {
+		static char out[RESPONSE_SLOT_SIZE];
+		ApiResult parsed = parseBatchRequest(body, len, batch);
+		sink += parsed.code + writeBatchResponse(out, sizeof(out), batch, ids, states);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+
+	ApiResult parsed = parseBatchRequest(body, len, batch);
+	TEST_ASSERT_NULL(parsed.error);
+	TEST_ASSERT_EQUAL(API_MAX_ZONE, batch.count);
+	TEST_ASSERT_EQUAL(BUS_CMD_STOP, batch.commands[API_MAX_ZONE - 1].type);
+
+	// The failing command is reported by index and nothing is accepted
+	static const char invalid[] = "{\"commands\":[{\"command\":\"stop\",\"zone\":1},{\"command\":\"start\",\"zone\":2}]}";
+	parsed = parseBatchRequest(invalid, sizeof(invalid) - 1, batch);
+	TEST_ASSERT_EQUAL(400, parsed.code);
+	TEST_ASSERT_EQUAL(1, batch.failed);
+	char out[API_SMALL_RESPONSE_SIZE];
+	TEST_ASSERT_GREATER_THAN(0, writeBatchErrorResponse(out, sizeof(out), parsed, batch.failed));
+	TEST_ASSERT_EQUAL_STRING("{\"error\":\"Missing required parameter: minutes\",\"index\":1}", out);
+}
+
+void test_bench_zones_response(void) {
+	// Worst case: every zone running, all numbers at their widest
+	static ZoneState zones[API_MAX_ZONE];
+	for (int i = 0; i < API_MAX_ZONE; i++) {
+		zones[i].active = true;
+		zones[i].startMs = UINT32_MAX;
+		zones[i].endMs = UINT32_MAX - 1;
+		zones[i].lastId = UINT32_MAX;
+		zones[i].lastCommand = "start";
+		zones[i].lastResult = UINT8_MAX;
+	}
+
+	BenchResult result = bench("writeZonesResponse", [](int i) {
+		static char out[API_ZONES_RESPONSE_SIZE];
+		sink += writeZonesResponse(out, sizeof(out), CONTROLLER_MAX - 1, zones, UINT32_MAX - i);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+
+	static char out[API_ZONES_RESPONSE_SIZE];
+	TEST_ASSERT_GREATER_THAN(0, writeZonesResponse(out, sizeof(out), CONTROLLER_MAX - 1, zones, UINT32_MAX));
+
+	ZoneState idle;
+	memset(&idle, 0, sizeof(idle));
+	TEST_ASSERT_GREATER_THAN(0, writeZoneResponse(out, sizeof(out), 0, 3, idle, 1000));
+	TEST_ASSERT_EQUAL_STRING("{\"uptime_ms\":1000,\"controller\":0,\"zone\":3,\"active\":false}", out);
+}
+
+void test_bench_start_request_path(void) {
+	// A whole POST /api/start as the web server runs it: parse, then reply from the pool
+	static ResponsePool pool;
+	static const char body[] = "{\"zone\":5,\"minutes\":10,\"note\":\"ignored by the filter\"}";
+	BenchResult result = bench("start request path", [](int i) {
+		StartRequest start;
+		ApiResult parsed = parseStartRequest(body, sizeof(body) - 1, start);
+		char *slot = pool.acquire();
+		sink += parsed.code + writeAcceptedResponse(slot, RESPONSE_SLOT_SIZE, i, start.controller, start.zone, start.minutes);
+		pool.release(slot);
+	});
+	TEST_ASSERT_EQUAL_FLOAT(0, result.allocsPerOp);
+	TEST_ASSERT_EQUAL(0, pool.inUse());
+}
+
+void test_response_pool_exhaustion(void) {
+	static ResponsePool pool;
+	char *slots[RESPONSE_POOL_SLOTS];
+	for (int i = 0; i < RESPONSE_POOL_SLOTS; i++) {
+		slots[i] = pool.acquire();
+		TEST_ASSERT_NOT_NULL(slots[i]);
+	}
+	TEST_ASSERT_NULL(pool.acquire());
+	TEST_ASSERT_EQUAL_UINT32(1, pool.exhausted());
+
+	pool.release(slots[3]);
+	TEST_ASSERT_EQUAL_PTR(slots[3], pool.acquire());
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_bench_zone_frame);
+	RUN_TEST(test_bench_start_zone);
+	RUN_TEST(test_bench_parse_start);
+	RUN_TEST(test_bench_parse_stop);
+	RUN_TEST(test_bench_validation);
+	RUN_TEST(test_bench_accepted_response);
+	RUN_TEST(test_bench_status_response);
+	RUN_TEST(test_bench_batch);
+	RUN_TEST(test_bench_zones_response);
+	RUN_TEST(test_bench_start_request_path);
+	RUN_TEST(test_response_pool_exhaustion);
+	return UNITY_END();
+}
@@ -0,0 +1,105 @@
+/**
+ * Tests for the POST body accumulator. Run on the host with:
+ *
+ * 		pio test -e native -f test_body_accumulator
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "BodyAccumulator.h"
+
+static BodyAccumulator bodies;
+
+// Stand-ins for two AsyncWebServerRequest pointers
+static int requestA;
+static int requestB;
+
+static const char json[] = "{\"zone\":5,\"minutes\":10}";
+
+static BodyResult chunk(const void *owner, size_t from, size_t to, uint32_t nowMs = 0) {
+	return bodies.append(owner, (const uint8_t *)json + from, to - from, from, sizeof(json) - 1, nowMs);
+}
+
+void setUp(void) {
+	bodies = BodyAccumulator();
+}
+
+void tearDown(void) {}
+
+void test_single_chunk_is_used_in_place(void) {
+	TEST_ASSERT_EQUAL(BODY_COMPLETE, chunk(&requestA, 0, sizeof(json) - 1));
+
+	size_t len;
+	const char *body = bodies.body(&requestA, len);
+	TEST_ASSERT_EQUAL_PTR(json, body);
+	TEST_ASSERT_EQUAL(sizeof(json) - 1, len);
+	TEST_ASSERT_EQUAL(0, bodies.inUse());
+}
+
+void test_fragmented_body_is_joined(void) {
+	TEST_ASSERT_EQUAL(BODY_PENDING, chunk(&requestA, 0, 7));
+	TEST_ASSERT_EQUAL(BODY_PENDING, chunk(&requestA, 7, 15));
+
+	size_t len;
+	TEST_ASSERT_NULL(bodies.body(&requestA, len));
+
+	TEST_ASSERT_EQUAL(BODY_COMPLETE, chunk(&requestA, 15, sizeof(json) - 1));
+	const char *body = bodies.body(&requestA, len);
+	TEST_ASSERT_EQUAL(sizeof(json) - 1, len);
+	TEST_ASSERT_EQUAL_MEMORY(json, body, len);
+
+	bodies.release(&requestA);
+	TEST_ASSERT_EQUAL(0, bodies.inUse());
+}
+
+void test_interleaved_requests_stay_apart(void) {
+	chunk(&requestA, 0, 10);
+	chunk(&requestB, 0, 5);
+	chunk(&requestB, 5, sizeof(json) - 1);
+	TEST_ASSERT_EQUAL(BODY_COMPLETE, chunk(&requestA, 10, sizeof(json) - 1));
+
+	size_t lenA, lenB;
+	const char *bodyA = bodies.body(&requestA, lenA);
+	const char *bodyB = bodies.body(&requestB, lenB);
+	TEST_ASSERT_NOT_EQUAL(bodyA, bodyB);
+	TEST_ASSERT_EQUAL(sizeof(json) - 1, lenA);
+	TEST_ASSERT_EQUAL_MEMORY(json, bodyA, lenA);
+	TEST_ASSERT_EQUAL_MEMORY(json, bodyB, lenB);
+}
+
+void test_oversize_body_is_rejected_up_front(void) {
+	static uint8_t data[16];
+	TEST_ASSERT_EQUAL(BODY_TOO_LARGE, bodies.append(&requestA, data, sizeof(data), 0, BODY_MAX_SIZE + 1, 0));
+	TEST_ASSERT_EQUAL(0, bodies.inUse());
+
+	// The rest of the rejected body is dropped
+	TEST_ASSERT_EQUAL(BODY_IGNORED, bodies.append(&requestA, data, sizeof(data), 16, BODY_MAX_SIZE + 1, 0));
+}
+
+void test_busy_when_every_slot_is_collecting(void) {
+	static int requests[BODY_SLOTS + 1];
+	for (int i = 0; i < BODY_SLOTS; i++) {
+		TEST_ASSERT_EQUAL(BODY_PENDING, chunk(&requests[i], 0, 5));
+	}
+	TEST_ASSERT_EQUAL(BODY_BUSY, chunk(&requests[BODY_SLOTS], 0, 5));
+
+	// An abandoned body gives up its slot after the timeout
+	TEST_ASSERT_EQUAL(BODY_PENDING, chunk(&requests[BODY_SLOTS], 0, 5, BODY_TIMEOUT_MS));
+}
+
+void test_out_of_order_chunk_drops_the_body(void) {
+	chunk(&requestA, 0, 5);
+	TEST_ASSERT_EQUAL(BODY_IGNORED, chunk(&requestA, 10, 15));
+	TEST_ASSERT_EQUAL(0, bodies.inUse());
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_single_chunk_is_used_in_place);
+	RUN_TEST(test_fragmented_body_is_joined);
+	RUN_TEST(test_interleaved_requests_stay_apart);
+	RUN_TEST(test_oversize_body_is_rejected_up_front);
+	RUN_TEST(test_busy_when_every_slot_is_collecting);
+	RUN_TEST(test_out_of_order_chunk_drops_the_body);
+	return UNITY_END();
+}
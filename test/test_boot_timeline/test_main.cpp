@@ -0,0 +1,53 @@
+/**
+ * Tests for the boot timeline. Run on the host with:
+ *
+ * 		pio test -e native -f test_boot_timeline
+ */
+
+#include <unity.h>
+#include "Hal.h"
+#include "BootTimeline.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_milestones_start_unset(void) {
+	for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+		TEST_ASSERT_EQUAL(0, bootMilestoneMs((BootMilestone)i));
+	}
+}
+
+void test_first_mark_wins(void) {
+	halNativeReset();
+	halNativeAdvance(1250000);
+	bootMark(BOOT_ADDRESS);
+	TEST_ASSERT_EQUAL(1250, bootMilestoneMs(BOOT_ADDRESS));
+
+	// A reconnect later on does not move it
+	halNativeAdvance(60000000);
+	bootMark(BOOT_ADDRESS);
+	TEST_ASSERT_EQUAL(1250, bootMilestoneMs(BOOT_ADDRESS));
+}
+
+void test_mark_at_zero_reads_as_reached(void) {
+	halNativeReset();
+	bootMark(BOOT_SETUP);
+	TEST_ASSERT_EQUAL(1, bootMilestoneMs(BOOT_SETUP));
+}
+
+void test_names(void) {
+	TEST_ASSERT_EQUAL_STRING("setup", bootMilestoneName(BOOT_SETUP));
+	TEST_ASSERT_EQUAL_STRING("bus_ready", bootMilestoneName(BOOT_BUS_READY));
+	TEST_ASSERT_EQUAL_STRING("ready", bootMilestoneName(BOOT_READY));
+	TEST_ASSERT_EQUAL_STRING("unknown", bootMilestoneName(BOOT_MILESTONE_COUNT));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_milestones_start_unset);
+	RUN_TEST(test_first_mark_wins);
+	RUN_TEST(test_mark_at_zero_reads_as_reached);
+	RUN_TEST(test_names);
+	return UNITY_END();
+}
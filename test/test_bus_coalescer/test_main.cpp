@@ -0,0 +1,190 @@
+/**
+ * Tests for the bus command coalescer. Run on the host with:
+ *
+ * 		pio test -e native -f test_bus_coalescer
+ */
+
+#include <unity.h>
+#include "BusCoalescer.h"
+
+static BusCommand command(uint32_t id, BusCommandType type, uint8_t zone, uint8_t minutes = 0) {
+	BusCommand c;
+	c.id = id;
+	c.type = type;
+	c.zone = zone;
+	c.minutes = minutes;
+	return c;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_queued_duplicate_is_dropped(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(1, BUS_CMD_START, 5, 10), 0, existing));
+	TEST_ASSERT_EQUAL(COALESCE_DUPLICATE, coalescer.submit(command(2, BUS_CMD_START, 5, 10), 10, existing));
+	TEST_ASSERT_EQUAL_UINT32(1, existing);
+	TEST_ASSERT_EQUAL(1, coalescer.pending());
+	TEST_ASSERT_EQUAL_UINT32(1, coalescer.getStats().duplicates);
+	TEST_ASSERT_EQUAL_UINT32(1, coalescer.getStats().framesSaved);
+}
+
+void test_sent_duplicate_is_dropped_within_window(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_START, 5, 10), 0, existing);
+	TEST_ASSERT_TRUE(coalescer.pop(sent, 100));
+
+	TEST_ASSERT_EQUAL(COALESCE_DUPLICATE, coalescer.submit(command(2, BUS_CMD_START, 5, 10), 1500, existing));
+	TEST_ASSERT_EQUAL_UINT32(1, existing);
+	TEST_ASSERT_EQUAL(0, coalescer.pending());
+
+	// Outside the window the command goes out again
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(3, BUS_CMD_START, 5, 10), 2100, existing));
+}
+
+void test_different_minutes_is_not_a_duplicate(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_START, 5, 10), 0, existing);
+	coalescer.pop(sent, 0);
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(2, BUS_CMD_START, 5, 15), 10, existing));
+}
+
+void test_stop_then_start_collapses(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_STOP, 5), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_REPLACED, coalescer.submit(command(2, BUS_CMD_START, 5, 10), 10, existing));
+	TEST_ASSERT_EQUAL_UINT32(1, existing);
+	TEST_ASSERT_EQUAL_UINT32(1, coalescer.getStats().collapsed);
+
+	// Only the final state reaches the bus
+	TEST_ASSERT_TRUE(coalescer.pop(sent, 20));
+	TEST_ASSERT_EQUAL_UINT32(2, sent.id);
+	TEST_ASSERT_EQUAL(BUS_CMD_START, sent.type);
+	TEST_ASSERT_FALSE(coalescer.pop(sent, 20));
+}
+
+void test_newer_command_moves_to_the_tail(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_START, 5, 10), 0, existing);
+	coalescer.submit(command(2, BUS_CMD_START, 6, 10), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_REPLACED, coalescer.submit(command(3, BUS_CMD_START, 5, 20), 0, existing));
+	TEST_ASSERT_EQUAL_UINT32(1, existing);
+	TEST_ASSERT_EQUAL_UINT32(1, coalescer.getStats().replaced);
+
+	// The replacement goes out after the commands queued since the one it replaced
+	TEST_ASSERT_EQUAL(2, coalescer.pending());
+	coalescer.pop(sent, 0);
+	TEST_ASSERT_EQUAL_UINT32(2, sent.id);
+	coalescer.pop(sent, 0);
+	TEST_ASSERT_EQUAL_UINT32(3, sent.id);
+	TEST_ASSERT_EQUAL_UINT8(20, sent.minutes);
+}
+
+void test_batch_order_is_kept(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	// stop z1, start z2, start z1 must leave z1 running
+	coalescer.submit(command(1, BUS_CMD_STOP, 1), 0, existing);
+	coalescer.submit(command(2, BUS_CMD_START, 2, 10), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_REPLACED, coalescer.submit(command(3, BUS_CMD_START, 1, 10), 0, existing));
+
+	TEST_ASSERT_TRUE(coalescer.pop(sent, 0));
+	TEST_ASSERT_EQUAL_UINT32(2, sent.id);
+	TEST_ASSERT_TRUE(coalescer.pop(sent, 0));
+	TEST_ASSERT_EQUAL_UINT32(3, sent.id);
+	TEST_ASSERT_EQUAL_UINT8(1, sent.zone);
+	TEST_ASSERT_FALSE(coalescer.pop(sent, 0));
+}
+
+void test_queued_duplicate_moves_to_the_tail(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_START, 1, 10), 0, existing);
+	coalescer.submit(command(2, BUS_CMD_START, 2, 10), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_DUPLICATE, coalescer.submit(command(3, BUS_CMD_START, 1, 10), 0, existing));
+	TEST_ASSERT_EQUAL_UINT32(1, existing);
+
+	coalescer.pop(sent, 0);
+	TEST_ASSERT_EQUAL_UINT32(2, sent.id);
+	coalescer.pop(sent, 0);
+	TEST_ASSERT_EQUAL_UINT32(1, sent.id);
+}
+
+void test_failed_command_is_not_a_duplicate(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+	BusCommand sent;
+
+	coalescer.submit(command(1, BUS_CMD_STOP, 5), 0, existing);
+	coalescer.pop(sent, 0);
+	coalescer.failed(sent);
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(2, BUS_CMD_STOP, 5), 10, existing));
+}
+
+void test_programs_and_zones_do_not_mix(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+
+	coalescer.submit(command(1, BUS_CMD_START, 1, 10), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(2, BUS_CMD_PROGRAM, 1), 0, existing));
+	TEST_ASSERT_EQUAL(COALESCE_DUPLICATE, coalescer.submit(command(3, BUS_CMD_PROGRAM, 1), 0, existing));
+	TEST_ASSERT_EQUAL_UINT32(2, existing);
+}
+
+void test_zero_window_disables_coalescing(void) {
+	BusCoalescer coalescer(0);
+	uint32_t existing;
+
+	coalescer.submit(command(1, BUS_CMD_START, 5, 10), 0, existing);
+	TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(2, BUS_CMD_START, 5, 10), 0, existing));
+	TEST_ASSERT_EQUAL(2, coalescer.pending());
+	TEST_ASSERT_EQUAL_UINT32(0, coalescer.getStats().framesSaved);
+}
+
+void test_full_queue(void) {
+	BusCoalescer coalescer(2000);
+	uint32_t existing;
+
+	for (uint8_t zone = 1; zone <= BUS_QUEUE_LENGTH; zone++) {
+		TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.submit(command(zone, BUS_CMD_START, zone, 10), 0, existing));
+	}
+	TEST_ASSERT_EQUAL(COALESCE_FULL, coalescer.submit(command(100, BUS_CMD_START, BUS_QUEUE_LENGTH + 1, 10), 0, existing));
+
+	// A full queue still absorbs commands for zones already waiting
+	TEST_ASSERT_EQUAL(COALESCE_REPLACED, coalescer.submit(command(101, BUS_CMD_STOP, 1), 0, existing));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_queued_duplicate_is_dropped);
+	RUN_TEST(test_sent_duplicate_is_dropped_within_window);
+	RUN_TEST(test_different_minutes_is_not_a_duplicate);
+	RUN_TEST(test_stop_then_start_collapses);
+	RUN_TEST(test_newer_command_moves_to_the_tail);
+	RUN_TEST(test_batch_order_is_kept);
+	RUN_TEST(test_queued_duplicate_moves_to_the_tail);
+	RUN_TEST(test_failed_command_is_not_a_duplicate);
+	RUN_TEST(test_programs_and_zones_do_not_mix);
+	RUN_TEST(test_zero_window_disables_coalescing);
+	RUN_TEST(test_full_queue);
+	return UNITY_END();
+}
@@ -0,0 +1,145 @@
+/**
+ * Tests for the binary command framing. Run on the host with:
+ *
+ * 		pio test -e native -f test_frame_protocol
+ *
+ * The frames below were built with util/serialTester/test.py.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "FrameProtocol.h"
+
+// Handshake from conn id 0x10, and a start of zone 5 for 30 minutes
+static const uint8_t syn[] = { 0xff, 0x10, 0xee, 0x00, 0x00, 0x0d, 0xfe, 0xaf };
+static const uint8_t start[] = { 0xff, 0x10, 0x65, 0x05, 0x1e, 0x98, 0x98, 0xaf };
+
+static bool feed(FrameAssembler& assembler, const uint8_t* bytes, size_t len, Frame& frame) {
+	bool found = false;
+	for (size_t i = 0; i < len; i++) {
+		if (assembler.push(bytes[i], frame)) {
+			found = true;
+		}
+	}
+	return found;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_fletcher16(void) {
+	TEST_ASSERT_EQUAL_HEX16(0xc8f0, fletcher16((const uint8_t*)"abcde", 5));
+	TEST_ASSERT_EQUAL_HEX16(0, fletcher16(NULL, 0));
+}
+
+void test_parse_frame(void) {
+	Frame frame;
+	TEST_ASSERT_TRUE(parseFrame(start, frame));
+	TEST_ASSERT_EQUAL_HEX8(0x10, frame.conn);
+	TEST_ASSERT_EQUAL_HEX8(FRAME_START, frame.type);
+	TEST_ASSERT_EQUAL_UINT8(5, frame.data[0]);
+	TEST_ASSERT_EQUAL_UINT8(30, frame.data[1]);
+	TEST_ASSERT_EQUAL_HEX16(0x0d79, frame.checksum);
+}
+
+void test_bad_frames_are_rejected(void) {
+	Frame frame;
+	uint8_t bytes[FRAME_REQUEST_SIZE];
+
+	memcpy(bytes, start, sizeof(bytes));
+	bytes[4] = 31;
+	TEST_ASSERT_FALSE(parseFrame(bytes, frame));
+
+	memcpy(bytes, start, sizeof(bytes));
+	bytes[7] = 0x00;
+	TEST_ASSERT_FALSE(parseFrame(bytes, frame));
+}
+
+void test_reply_matches_serial_firmware(void) {
+	Frame frame;
+	uint8_t reply[FRAME_REPLY_SIZE];
+	parseFrame(syn, frame);
+	buildReply(reply, frame, FRAME_SYN, FRAME_ACK);
+
+	// test.py expects the request checksum back low byte first
+	const uint8_t expected[] = { 0xff, 0x10, 0xee, 0xae, 0xba, 0xde, 0xaf };
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, reply, FRAME_REPLY_SIZE);
+}
+
+void test_assembler_skips_noise(void) {
+	FrameAssembler assembler;
+	Frame frame;
+	const uint8_t noise[] = { 0x12, 0xaf, 0x00, 0x65 };
+
+	TEST_ASSERT_FALSE(feed(assembler, noise, sizeof(noise), frame));
+	TEST_ASSERT_TRUE(feed(assembler, start, sizeof(start), frame));
+	TEST_ASSERT_EQUAL_HEX8(FRAME_START, frame.type);
+}
+
+void test_assembler_resyncs_after_stray_begin(void) {
+	FrameAssembler assembler;
+	Frame frame;
+
+	// A BEGIN byte in the noise swallows the start of the real frame
+	const uint8_t noise[] = { 0xff, 0x01, 0x02 };
+	TEST_ASSERT_FALSE(feed(assembler, noise, sizeof(noise), frame));
+	TEST_ASSERT_TRUE(feed(assembler, start, sizeof(start), frame));
+	TEST_ASSERT_EQUAL_UINT8(5, frame.data[0]);
+}
+
+void test_assembler_joins_split_frames(void) {
+	FrameAssembler assembler;
+	Frame frame;
+
+	TEST_ASSERT_FALSE(feed(assembler, start, 3, frame));
+	TEST_ASSERT_TRUE(feed(assembler, start + 3, sizeof(start) - 3, frame));
+	TEST_ASSERT_TRUE(feed(assembler, syn, sizeof(syn), frame));
+	TEST_ASSERT_EQUAL_HEX8(FRAME_SYN, frame.type);
+}
+
+void test_replay_cache(void) {
+	FrameReplayCache cache;
+	Frame frame;
+	uint8_t reply[FRAME_REPLY_SIZE];
+	uint8_t replayed[FRAME_REPLY_SIZE];
+	parseFrame(start, frame);
+	buildReply(reply, frame, FRAME_ACK, FRAME_EMPTY);
+
+	TEST_ASSERT_FALSE(cache.lookup(1, frame, 0, replayed));
+	cache.store(1, frame, reply, 0);
+	TEST_ASSERT_TRUE(cache.lookup(1, frame, 100, replayed));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(reply, replayed, FRAME_REPLY_SIZE);
+
+	// Another client, or the same one after the window, runs the command again
+	TEST_ASSERT_FALSE(cache.lookup(2, frame, 100, replayed));
+	TEST_ASSERT_FALSE(cache.lookup(1, frame, FRAME_REPLAY_MS, replayed));
+}
+
+void test_replay_cache_evicts_oldest(void) {
+	FrameReplayCache cache;
+	Frame frame;
+	uint8_t reply[FRAME_REPLY_SIZE];
+	parseFrame(start, frame);
+	buildReply(reply, frame, FRAME_ACK, FRAME_EMPTY);
+
+	for (uint32_t source = 0; source <= FRAME_REPLAY_SLOTS; source++) {
+		cache.store(source, frame, reply, 0);
+	}
+	TEST_ASSERT_FALSE(cache.lookup(0, frame, 0, reply));
+	TEST_ASSERT_TRUE(cache.lookup(FRAME_REPLAY_SLOTS, frame, 0, reply));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_fletcher16);
+	RUN_TEST(test_parse_frame);
+	RUN_TEST(test_bad_frames_are_rejected);
+	RUN_TEST(test_reply_matches_serial_firmware);
+	RUN_TEST(test_assembler_skips_noise);
+	RUN_TEST(test_assembler_resyncs_after_stray_begin);
+	RUN_TEST(test_assembler_joins_split_frames);
+	RUN_TEST(test_replay_cache);
+	RUN_TEST(test_replay_cache_evicts_oldest);
+	return UNITY_END();
+}
@@ -0,0 +1,94 @@
+/**
+ * Tests for the per-route heap counters. Run on the host with:
+ *
+ * 		pio test -e native -f test_heap_stats
+ */
+
+#include <unity.h>
+#include <new>
+#include "Hal.h"
+#include "HeapStats.h"
+
+static HeapStats *stats;
+
+// Stand-ins for task handles
+static int asyncTcp;
+static int busWorker;
+
+void setUp(void) {
+	static HeapStats instance;
+	new (&instance) HeapStats();
+	stats = &instance;
+	halNativeReset();
+}
+
+void tearDown(void) {}
+
+void test_only_the_handler_is_counted(void) {
+	stats->allocated(&asyncTcp, 64);
+
+	stats->enter(&asyncTcp, ROUTE_STATUS);
+	stats->allocated(&asyncTcp, 1536);
+	stats->allocated(&busWorker, 100);
+	stats->allocated(&asyncTcp, 32);
+	stats->leave();
+
+	stats->allocated(&asyncTcp, 64);
+
+	HeapRouteStats status = stats->route(ROUTE_STATUS);
+	TEST_ASSERT_EQUAL(2, status.allocations);
+	TEST_ASSERT_EQUAL(1568, status.bytes);
+	TEST_ASSERT_EQUAL(1536, status.largest);
+	TEST_ASSERT_EQUAL(0, stats->route(ROUTE_OTHER).allocations);
+}
+
+void test_routes_are_kept_apart(void) {
+	stats->enter(&asyncTcp, ROUTE_START);
+	stats->allocated(&asyncTcp, 200);
+	stats->leave();
+	stats->enter(&asyncTcp, ROUTE_BUS_STATS);
+	stats->leave();
+	stats->enter(&asyncTcp, ROUTE_START);
+	stats->allocated(&asyncTcp, 300);
+	stats->leave();
+
+	HeapRouteStats start = stats->route(ROUTE_START);
+	TEST_ASSERT_EQUAL(2, start.allocations);
+	TEST_ASSERT_EQUAL(500, start.bytes);
+	TEST_ASSERT_EQUAL(300, start.largest);
+
+	HeapRouteStats busStats = stats->route(ROUTE_BUS_STATS);
+	TEST_ASSERT_EQUAL(0, busStats.allocations);
+}
+
+void test_no_task_is_ignored(void) {
+	// Allocations before the scheduler starts report no task
+	stats->allocated(NULL, 16);
+	stats->enter(&asyncTcp, ROUTE_PING);
+	stats->allocated(NULL, 16);
+	stats->leave();
+	TEST_ASSERT_EQUAL(0, stats->route(ROUTE_PING).allocations);
+}
+
+void test_failures(void) {
+	TEST_ASSERT_EQUAL(0, stats->failures());
+	TEST_ASSERT_EQUAL(0, stats->lastFailure().ms);
+
+	halNativeAdvance(5000000);
+	stats->failed(24576, 0x1800);
+	stats->failed(8192, 0x0c00);
+	TEST_ASSERT_EQUAL(2, stats->failures());
+	HeapFailure last = stats->lastFailure();
+	TEST_ASSERT_EQUAL(8192, last.size);
+	TEST_ASSERT_EQUAL(0x0c00, last.caps);
+	TEST_ASSERT_EQUAL(5000, last.ms);
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_only_the_handler_is_counted);
+	RUN_TEST(test_routes_are_kept_apart);
+	RUN_TEST(test_no_task_is_ignored);
+	RUN_TEST(test_failures);
+	return UNITY_END();
+}
@@ -0,0 +1,129 @@
+/**
+ * Golden-frame tests for HunterFrame.h.
+ *
+ * The constexpr encoders are checked against the original vector based
+ * hunterBitfield encoding over the whole input space: 48 zones x 0-240
+ * minutes and the 4 programs. Run on the host with:
+ *
+ * 		pio test -e native -f test_hunter_frame
+ */
+
+#include <unity.h>
+#include <vector>
+#include "HunterFrame.h"
+
+typedef uint8_t byte;
+
+// Known frames, checked at compile time
+constexpr HunterZoneFrame ZONE_1_10_MIN = {
+	0xff, 0x20, 0x00, 0x30, 0xb1, 0x80, 0x12, 0x2c, 0x90, 0x01, 0x8b, 0x0c, 0x01, 0xb8, 0x3f
+};
+constexpr HunterZoneFrame ZONE_13_STOP = {
+	0xff, 0x40, 0x00, 0x48, 0x12, 0x40, 0x06, 0x04, 0x30, 0x07, 0x81, 0x3c, 0x01, 0xb9, 0xbf
+};
+constexpr HunterZoneFrame ZONE_48_240_MIN = {
+	0xff, 0x40, 0x01, 0xc4, 0x1e, 0x2f, 0x65, 0x07, 0x2b, 0xdf, 0x41, 0xfa, 0xf1, 0xbf, 0xbf
+};
+constexpr HunterProgramFrame PROGRAM_4 = {
+	0xff, 0x40, 0x03, 0x97, 0x89, 0xbd, 0x7f
+};
+
+static_assert(hunterFrameEqual(hunterZoneFrame(1, 10), ZONE_1_10_MIN), "zone 1, 10 minutes");
+static_assert(hunterFrameEqual(hunterZoneFrame(13, 0), ZONE_13_STOP), "zone 13, stop");
+static_assert(hunterFrameEqual(hunterZoneFrame(48, 240), ZONE_48_240_MIN), "zone 48, 240 minutes");
+static_assert(hunterFrameEqual(hunterProgramFrame(4), PROGRAM_4), "program 4");
+
+/**
+ * Reference implementation: the original HunterRoam::hunterBitfield.
+ */
+static void hunterBitfield(std::vector <byte> &bits, byte pos, byte val, byte len) {
+	while (len > 0) {
+		if (val & 0x1) {
+			bits[pos / 8] = bits[pos / 8] | 0x80 >> (pos % 8);
+		} else {
+			bits[pos / 8] = bits[pos / 8] & ~(0x80 >> (pos % 8));
+		}
+		len--;
+		val = val >> 1;
+		pos++;
+	}
+}
+
+/**
+ * Reference implementation: the original HunterRoam::startZone frame.
+ */
+static std::vector<byte> legacyZoneFrame(byte zone, byte time) {
+	std::vector<byte> buffer = {0xff,0x00,0x00,0x00,0x10,0x00,0x00,0x04,0x00,0x00,0x01,0x00,0x01,0xb8,0x3f};
+
+	if (zone > 12) {
+		hunterBitfield(buffer, 9, 0x1, 2);
+	} else {
+		hunterBitfield(buffer, 9, 0x2, 2);
+	}
+	hunterBitfield(buffer, 23, zone + 0x17, 7);
+	hunterBitfield(buffer, 36, zone + 0x17, 7);
+	hunterBitfield(buffer, 49, zone + 0x23, 7);
+	hunterBitfield(buffer, 62, zone + 0x23, 7);
+	hunterBitfield(buffer, 75, zone + 0x2f, 7);
+	hunterBitfield(buffer, 88, zone + 0x2f, 7);
+	hunterBitfield(buffer, 31, time, 4);
+	hunterBitfield(buffer, 44, time >> 4, 4);
+	hunterBitfield(buffer, 57, time, 4);
+	hunterBitfield(buffer, 70, time >> 4, 4);
+	hunterBitfield(buffer, 83, time, 4);
+	hunterBitfield(buffer, 96, time >> 4, 4);
+	hunterBitfield(buffer, 109, zone - 1, 4);
+
+	return buffer;
+}
+
+/**
+ * Reference implementation: the original HunterRoam::startProgram frame.
+ */
+static std::vector<byte> legacyProgramFrame(byte num) {
+	std::vector<byte> buffer = {0xff, 0x40, 0x03, 0x96, 0x09 ,0xbd ,0x7f};
+	hunterBitfield(buffer, 31, num - 1, 2);
+	return buffer;
+}
+
+void test_zone_frames_match_legacy(void) {
+	for (int zone = HUNTER_MIN_ZONE; zone <= HUNTER_MAX_ZONE; zone++) {
+		for (int time = 0; time <= HUNTER_MAX_TIME; time++) {
+			HunterZoneFrame frame = hunterZoneFrame(zone, time);
+			std::vector<byte> expected = legacyZoneFrame(zone, time);
+			TEST_ASSERT_EQUAL_UINT32(expected.size(), frame.size());
+			TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), frame.data(), frame.size());
+		}
+	}
+}
+
+void test_program_frames_match_legacy(void) {
+	for (int num = HUNTER_MIN_PROGRAM; num <= HUNTER_MAX_PROGRAM; num++) {
+		HunterProgramFrame frame = hunterProgramFrame(num);
+		std::vector<byte> expected = legacyProgramFrame(num);
+		TEST_ASSERT_EQUAL_UINT32(expected.size(), frame.size());
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), frame.data(), frame.size());
+	}
+}
+
+void test_validation_ranges(void) {
+	TEST_ASSERT_FALSE(hunterValidZone(0));
+	TEST_ASSERT_TRUE(hunterValidZone(1));
+	TEST_ASSERT_TRUE(hunterValidZone(48));
+	TEST_ASSERT_FALSE(hunterValidZone(49));
+	TEST_ASSERT_FALSE(hunterValidTime(-1));
+	TEST_ASSERT_TRUE(hunterValidTime(0));
+	TEST_ASSERT_TRUE(hunterValidTime(240));
+	TEST_ASSERT_FALSE(hunterValidTime(241));
+	TEST_ASSERT_FALSE(hunterValidProgram(0));
+	TEST_ASSERT_TRUE(hunterValidProgram(4));
+	TEST_ASSERT_FALSE(hunterValidProgram(5));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_zone_frames_match_legacy);
+	RUN_TEST(test_program_frames_match_legacy);
+	RUN_TEST(test_validation_ranges);
+	return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/**
+ * Tests for the idempotency key cache. Run on the host with:
+ *
+ * 		pio test -e native -f test_idempotency_cache
+ */
+
+#include <unity.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include "IdempotencyCache.h"
+#include "ApiRequests.h"
+
+static IdempotencyCache *cache;
+static char storage[sizeof(IdempotencyCache)];
+
+static const char accepted[] = "{\"status\":\"queued\",\"id\":7}";
+
+static IdempotencyResult lookup(uint32_t client, const char* key, uint32_t fingerprint, uint32_t nowMs) {
+	int code;
+	const char* body;
+	size_t length;
+	return cache->lookup(client, key, fingerprint, nowMs, code, body, length);
+}
+
+void setUp(void) {
+	cache = new (storage) IdempotencyCache();
+}
+
+void tearDown(void) {}
+
+void test_retry_replays_response(void) {
+	uint32_t start = IdempotencyCache::fingerprint(BUS_CMD_START, 0, 5, 10);
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISS, lookup(1, "abc", start, 0));
+	cache->store(1, "abc", start, 202, accepted, strlen(accepted), 0);
+
+	int code;
+	const char* body;
+	size_t length;
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_HIT, cache->lookup(1, "abc", start, 30000, code, body, length));
+	TEST_ASSERT_EQUAL_INT(202, code);
+	TEST_ASSERT_EQUAL(strlen(accepted), length);
+	TEST_ASSERT_EQUAL_MEMORY(accepted, body, length);
+
+	IdempotencyStats stats = cache->getStats();
+	TEST_ASSERT_EQUAL_UINT32(1, stats.hits);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.misses);
+}
+
+void test_keys_are_scoped_to_client(void) {
+	uint32_t stop = IdempotencyCache::fingerprint(BUS_CMD_STOP, 0, 5);
+	cache->store(1, "abc", stop, 202, accepted, strlen(accepted), 0);
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISS, lookup(2, "abc", stop, 0));
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISS, lookup(1, "abcd", stop, 0));
+}
+
+void test_key_reused_for_other_request(void) {
+	cache->store(1, "abc", IdempotencyCache::fingerprint(BUS_CMD_START, 0, 5, 10), 202, accepted, strlen(accepted), 0);
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISMATCH, lookup(1, "abc", IdempotencyCache::fingerprint(BUS_CMD_START, 0, 5, 20), 0));
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISMATCH, lookup(1, "abc", IdempotencyCache::fingerprint(BUS_CMD_STOP, 0, 5), 0));
+	TEST_ASSERT_EQUAL_UINT32(2, cache->getStats().mismatches);
+}
+
+void test_window_expires(void) {
+	uint32_t stop = IdempotencyCache::fingerprint(BUS_CMD_STOP, 0, 5);
+	cache->store(1, "abc", stop, 202, accepted, strlen(accepted), 0);
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISS, lookup(1, "abc", stop, IDEMPOTENCY_WINDOW_MS));
+
+	// The key can be used again, for any request
+	uint32_t start = IdempotencyCache::fingerprint(BUS_CMD_START, 0, 5, 10);
+	cache->store(1, "abc", start, 202, accepted, strlen(accepted), IDEMPOTENCY_WINDOW_MS);
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_HIT, lookup(1, "abc", start, IDEMPOTENCY_WINDOW_MS + 1));
+}
+
+void test_least_recently_used_is_evicted(void) {
+	uint32_t stop = IdempotencyCache::fingerprint(BUS_CMD_STOP, 0, 5);
+	char key[8];
+	for (int i = 0; i < IDEMPOTENCY_SLOTS; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		cache->store(1, key, stop, 202, accepted, strlen(accepted), i);
+	}
+
+	// k0 is the oldest, but a retry makes it the most recently used
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_HIT, lookup(1, "k0", stop, 100));
+	cache->store(1, "new", stop, 202, accepted, strlen(accepted), 101);
+
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_HIT, lookup(1, "k0", stop, 102));
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_MISS, lookup(1, "k1", stop, 102));
+	TEST_ASSERT_EQUAL(IDEMPOTENCY_HIT, lookup(1, "new", stop, 102));
+}
+
+void test_key_validation(void) {
+	char key[API_IDEMPOTENCY_KEY_MAX + 1];
+	char longKey[API_IDEMPOTENCY_KEY_MAX + 2];
+	memset(longKey, 'a', sizeof(longKey) - 1);
+	longKey[sizeof(longKey) - 1] = '\0';
+
+	TEST_ASSERT_TRUE(copyIdempotencyKey("3f2a-91", 7, key));
+	TEST_ASSERT_EQUAL_STRING("3f2a-91", key);
+	TEST_ASSERT_TRUE(copyIdempotencyKey(longKey, API_IDEMPOTENCY_KEY_MAX, key));
+	TEST_ASSERT_FALSE(copyIdempotencyKey(longKey, API_IDEMPOTENCY_KEY_MAX + 1, key));
+	TEST_ASSERT_FALSE(copyIdempotencyKey("", 0, key));
+	TEST_ASSERT_FALSE(copyIdempotencyKey("a b", 3, key));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_retry_replays_response);
+	RUN_TEST(test_keys_are_scoped_to_client);
+	RUN_TEST(test_key_reused_for_other_request);
+	RUN_TEST(test_window_expires);
+	RUN_TEST(test_least_recently_used_is_evicted);
+	RUN_TEST(test_key_validation);
+	return UNITY_END();
+}
@@ -0,0 +1,186 @@
+/**
+ * Tests for the command journal ring, on the simulated flash in lib/Hal. Run
+ * on the host with:
+ *
+ * 		pio test -e native -f test_journal
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "JournalLog.h"
+
+#define SLOTS (HAL_NATIVE_FLASH_SIZE / JOURNAL_RECORD_SIZE)
+
+static JournalRecord record(uint32_t seq) {
+	JournalRecord r;
+	memset(&r, 0, sizeof(r));
+	r.seq = seq;
+	r.time = 1709510400 + seq;
+	r.uptimeMs = seq * 1000;
+	r.id = seq;
+	r.busUs = 41000;
+	r.source = BUS_SOURCE_API;
+	r.command = BUS_CMD_START;
+	r.zone = seq % 48 + 1;
+	r.minutes = 10;
+	return r;
+}
+
+// Append count records from the log's next seq, batch at a time
+static void fill(JournalLog& log, uint32_t count, uint8_t batch) {
+	JournalRecord records[32];
+	while (count > 0) {
+		uint8_t n = count < batch ? count : batch;
+		uint32_t seq = log.nextSeq();
+		for (uint8_t i = 0; i < n; i++) {
+			records[i] = record(seq + i);
+		}
+		TEST_ASSERT_EQUAL(n, log.append(records, n));
+		count -= n;
+	}
+}
+
+void setUp(void) {
+	halNativeFlashReset();
+}
+
+void tearDown(void) {}
+
+void test_empty_flash_mounts_empty(void) {
+	JournalLog log;
+	TEST_ASSERT_TRUE(log.mount());
+	TEST_ASSERT_EQUAL(SLOTS, log.capacity());
+	TEST_ASSERT_EQUAL(1, log.nextSeq());
+	TEST_ASSERT_EQUAL(1, log.oldestSeq());
+
+	JournalRecord r;
+	TEST_ASSERT_FALSE(log.read(1, r));
+}
+
+void test_records_survive_a_remount(void) {
+	JournalLog log;
+	log.mount();
+	fill(log, 10, 4);
+
+	JournalLog again;
+	TEST_ASSERT_TRUE(again.mount());
+	TEST_ASSERT_EQUAL(11, again.nextSeq());
+	JournalRecord r;
+	for (uint32_t seq = 1; seq <= 10; seq++) {
+		TEST_ASSERT_TRUE(again.read(seq, r));
+		TEST_ASSERT_EQUAL(seq, r.id);
+		TEST_ASSERT_EQUAL(seq % 48 + 1, r.zone);
+	}
+	TEST_ASSERT_FALSE(again.read(11, r));
+
+	// Carries on where the first one stopped
+	fill(again, 1, 1);
+	TEST_ASSERT_TRUE(again.read(11, r));
+	TEST_ASSERT_TRUE(again.read(10, r));
+}
+
+void test_batch_is_one_write_per_sector(void) {
+	JournalLog log;
+	log.mount();
+	fill(log, 20, 20);
+	TEST_ASSERT_EQUAL(1, halNativeFlashWrites());
+	TEST_ASSERT_EQUAL(1, halNativeFlashErases());
+
+	// Seqs 121 to 136 straddle the first sector boundary
+	fill(log, JOURNAL_RECORDS_PER_SECTOR - 28, 20);
+	size_t writes = halNativeFlashWrites();
+	fill(log, 16, 16);
+	TEST_ASSERT_EQUAL(writes + 2, halNativeFlashWrites());
+	TEST_ASSERT_EQUAL(2, halNativeFlashErases());
+}
+
+void test_wrap_erases_each_sector_once_per_trip(void) {
+	JournalLog log;
+	log.mount();
+	fill(log, SLOTS + 200, 32);
+
+	uint32_t sectors = HAL_NATIVE_FLASH_SIZE / HAL_FLASH_SECTOR;
+	TEST_ASSERT_EQUAL(sectors + 2, halNativeFlashErases());
+
+	// The first two sectors were reused, the rest of the first trip is left
+	uint32_t oldest = 2 * JOURNAL_RECORDS_PER_SECTOR + 1;
+	TEST_ASSERT_EQUAL(oldest, log.oldestSeq());
+	JournalRecord r;
+	TEST_ASSERT_FALSE(log.read(1, r));
+	TEST_ASSERT_FALSE(log.read(oldest - 1, r));
+	TEST_ASSERT_TRUE(log.read(oldest, r));
+	TEST_ASSERT_TRUE(log.read(SLOTS + 200, r));
+
+	JournalLog again;
+	again.mount();
+	TEST_ASSERT_EQUAL(SLOTS + 201, again.nextSeq());
+	TEST_ASSERT_EQUAL(oldest, again.oldestSeq());
+	TEST_ASSERT_TRUE(again.read(oldest, r));
+	TEST_ASSERT_EQUAL(oldest, r.seq);
+}
+
+void test_torn_record_is_skipped(void) {
+	JournalLog log;
+	log.mount();
+	fill(log, 5, 5);
+
+	// A reset part way through writing seq 6
+	JournalRecord torn = record(6);
+	JournalLog::seal(torn);
+	halFlashWrite(5 * JOURNAL_RECORD_SIZE, &torn, JOURNAL_RECORD_SIZE / 2);
+
+	JournalLog again;
+	again.mount();
+	TEST_ASSERT_EQUAL(7, again.nextSeq());
+	JournalRecord r;
+	TEST_ASSERT_FALSE(again.read(6, r));
+	TEST_ASSERT_TRUE(again.read(5, r));
+
+	fill(again, 1, 1);
+	TEST_ASSERT_TRUE(again.read(7, r));
+	TEST_ASSERT_EQUAL(7, r.id);
+}
+
+void test_foreign_data_is_ignored(void) {
+	uint8_t junk[64];
+	memset(junk, 0x5a, sizeof(junk));
+	halFlashWrite(0, junk, sizeof(junk));
+	halFlashWrite(HAL_FLASH_SECTOR, junk, sizeof(junk));
+
+	JournalLog log;
+	TEST_ASSERT_TRUE(log.mount());
+	TEST_ASSERT_EQUAL(1, log.nextSeq());
+
+	// The sector is erased before the first record goes in
+	fill(log, 3, 3);
+	JournalRecord r;
+	TEST_ASSERT_TRUE(log.read(1, r));
+	TEST_ASSERT_TRUE(log.read(3, r));
+}
+
+void test_record_json(void) {
+	JournalRecord r = record(42);
+	r.source = BUS_SOURCE_FRAME;
+	r.command = BUS_CMD_STOP;
+	r.minutes = 0;
+	r.result = 3;
+	char json[256];
+	size_t len = journalRecordJson(r, json, sizeof(json));
+	TEST_ASSERT_EQUAL_STRING(
+		"{\"seq\":42,\"time\":1709510442,\"uptimeMs\":42000,\"id\":42,\"source\":\"frame\",\"controller\":0,"
+		"\"command\":\"stop\",\"zone\":43,\"minutes\":0,\"result\":3,\"busUs\":41000}", json);
+	TEST_ASSERT_EQUAL(strlen(json), len);
+	TEST_ASSERT_EQUAL(0, journalRecordJson(r, json, 16));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_empty_flash_mounts_empty);
+	RUN_TEST(test_records_survive_a_remount);
+	RUN_TEST(test_batch_is_one_write_per_sector);
+	RUN_TEST(test_wrap_erases_each_sector_once_per_trip);
+	RUN_TEST(test_torn_record_is_skipped);
+	RUN_TEST(test_foreign_data_is_ignored);
+	RUN_TEST(test_record_json);
+	return UNITY_END();
+}
@@ -0,0 +1,177 @@
+/**
+ * Tests for the Prometheus metrics. Run on the host with:
+ *
+ * 		pio test -e native -f test_metrics
+ */
+
+#include <unity.h>
+#include <new>
+#include <string.h>
+#include "Metrics.h"
+#include "ApiLimits.h"
+
+static Metrics *metrics;
+static MetricsGauges gauges;
+
+// Large enough for the whole exposition in one go
+static char full[8192];
+
+static size_t scrapeAll(char *out, size_t chunk) {
+	MetricsScrape scrape;
+	metrics->beginScrape(scrape);
+	size_t total = 0;
+	size_t len;
+	while ((len = metrics->write(out + total, chunk, scrape, gauges)) > 0) {
+		TEST_ASSERT_NOT_EQUAL(RESPONSE_TRY_AGAIN, len);
+		total += len;
+	}
+	out[total] = '\0';
+	return total;
+}
+
+void setUp(void) {
+	static Metrics instance;
+	new (&instance) Metrics();
+	metrics = &instance;
+
+	memset(&gauges, 0, sizeof(gauges));
+	gauges.controllers = 1;
+	gauges.bus[0].frames = 3;
+	gauges.bus[0].busyUs = 1950000;
+	gauges.freeHeap = 200000;
+}
+
+void tearDown(void) {}
+
+void test_routes_are_matched_by_prefix(void) {
+	TEST_ASSERT_EQUAL(ROUTE_START, Metrics::route("/api/start"));
+	TEST_ASSERT_EQUAL(ROUTE_COMMANDS, Metrics::route("/api/commands/42"));
+	TEST_ASSERT_EQUAL(ROUTE_SEQUENCE, Metrics::route("/api/sequence/pause"));
+	TEST_ASSERT_EQUAL(ROUTE_OTHER, Metrics::route("/api/startx"));
+	TEST_ASSERT_EQUAL(ROUTE_OTHER, Metrics::route("/"));
+}
+
+void test_requests_are_counted_by_route_and_code(void) {
+	metrics->finished(ROUTE_START, 202, 3000);
+	metrics->finished(ROUTE_START, 202, 7000);
+	metrics->finished(ROUTE_START, 418, 100);
+	scrapeAll(full, sizeof(full));
+
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_http_requests_total{route=\"/api/start\",code=\"202\"} 2\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_http_requests_total{route=\"/api/start\",code=\"other\"} 1\n"));
+	TEST_ASSERT_NULL(strstr(full, "route=\"/api/stop\""));
+}
+
+void test_latency_histogram_is_cumulative(void) {
+	metrics->finished(ROUTE_STATUS, 200, 500);
+	metrics->finished(ROUTE_STATUS, 200, 4000);
+	metrics->finished(ROUTE_STATUS, 200, 2000000);
+	scrapeAll(full, sizeof(full));
+
+	TEST_ASSERT_NOT_NULL(strstr(full, "_bucket{route=\"/api/status\",le=\"0.001\"} 1\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "_bucket{route=\"/api/status\",le=\"0.005\"} 2\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "_bucket{route=\"/api/status\",le=\"1.000\"} 2\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "_bucket{route=\"/api/status\",le=\"+Inf\"} 3\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "_sum{route=\"/api/status\"} 2.004500\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_bus_busy_seconds_total{controller=\"0\"} 1.950000\n"));
+}
+
+void test_small_chunks_give_the_same_output(void) {
+	metrics->finished(ROUTE_STOP, 202, 1000);
+	metrics->finished(ROUTE_ZONES, 404, 1000);
+	size_t len = scrapeAll(full, sizeof(full));
+
+	static char chunked[8192];
+	TEST_ASSERT_EQUAL(len, scrapeAll(chunked, 128));
+	TEST_ASSERT_EQUAL_STRING(full, chunked);
+}
+
+void test_no_room_is_not_the_end(void) {
+	MetricsScrape scrape;
+	metrics->beginScrape(scrape);
+	TEST_ASSERT_EQUAL(RESPONSE_TRY_AGAIN, metrics->write(full, 8, scrape, gauges));
+	TEST_ASSERT_EQUAL_UINT32(0, scrape.line);
+
+	size_t len = metrics->write(full, sizeof(full), scrape, gauges);
+	TEST_ASSERT_GREATER_THAN(0, len);
+	TEST_ASSERT_NOT_EQUAL(RESPONSE_TRY_AGAIN, len);
+	TEST_ASSERT_EQUAL(0, metrics->write(full, 8, scrape, gauges));
+}
+
+void test_latency_sum_does_not_wrap(void) {
+	// Two hours of latency, past the 32 bit microsecond range
+	for (int i = 0; i < 720; i++) {
+		metrics->finished(ROUTE_SEQUENCE, 202, 10000000);
+	}
+	scrapeAll(full, sizeof(full));
+	TEST_ASSERT_NOT_NULL(strstr(full, "_sum{route=\"/api/sequence\"} 7200.000000\n"));
+}
+
+void test_series_are_fixed_for_the_scrape(void) {
+	MetricsScrape scrape;
+	metrics->beginScrape(scrape);
+
+	// A route that finishes mid-scrape shows up next time
+	metrics->finished(ROUTE_PING, 200, 100);
+	size_t total = 0;
+	size_t len;
+	while ((len = metrics->write(full + total, 256, scrape, gauges)) > 0) {
+		total += len;
+	}
+	full[total] = '\0';
+	TEST_ASSERT_NULL(strstr(full, "/api/ping"));
+}
+
+void test_in_flight_follows_arrivals(void) {
+	int request;
+	metrics->arrived(&request, 100);
+	TEST_ASSERT_EQUAL(1, metrics->inFlight());
+	TEST_ASSERT_EQUAL_UINT32(100, metrics->handling(&request, 900));
+	TEST_ASSERT_EQUAL(1, metrics->inFlight());
+	metrics->finished(ROUTE_START, 202, 800);
+	TEST_ASSERT_EQUAL(0, metrics->inFlight());
+
+	// Without a body the request arrives when it is handled
+	TEST_ASSERT_EQUAL_UINT32(500, metrics->handling(&request, 500));
+	metrics->finished(ROUTE_PING, 200, 0);
+	TEST_ASSERT_EQUAL(0, metrics->inFlight());
+}
+
+void test_allocations_follow_the_routes_served(void) {
+	metrics->finished(ROUTE_STATUS, 200, 500);
+	metrics->finished(ROUTE_STATUS, 304, 200);
+	TEST_ASSERT_EQUAL(2, metrics->requests(ROUTE_STATUS));
+	gauges.allocations[ROUTE_STATUS] = 4;
+	gauges.allocatedBytes[ROUTE_STATUS] = 1720;
+	gauges.allocations[ROUTE_STOP] = 9;
+	gauges.allocFailures = 2;
+	scrapeAll(full, sizeof(full));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_http_allocations_total{route=\"/api/status\"} 4\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_http_allocated_bytes_total{route=\"/api/status\"} 1720\n"));
+	TEST_ASSERT_NULL(strstr(full, "isprinklr_http_allocations_total{route=\"/api/stop\"}"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_heap_alloc_failures_total 2\n"));
+}
+
+void test_boot_milestones_once_reached(void) {
+	gauges.bootMs[BOOT_SETUP] = 412;
+	gauges.bootMs[BOOT_READY] = 3250;
+	scrapeAll(full, sizeof(full));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_boot_milestone_seconds{milestone=\"setup\"} 0.412\n"));
+	TEST_ASSERT_NOT_NULL(strstr(full, "isprinklr_boot_milestone_seconds{milestone=\"ready\"} 3.250\n"));
+	TEST_ASSERT_NULL(strstr(full, "milestone=\"address\""));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_routes_are_matched_by_prefix);
+	RUN_TEST(test_requests_are_counted_by_route_and_code);
+	RUN_TEST(test_latency_histogram_is_cumulative);
+	RUN_TEST(test_small_chunks_give_the_same_output);
+	RUN_TEST(test_no_room_is_not_the_end);
+	RUN_TEST(test_latency_sum_does_not_wrap);
+	RUN_TEST(test_series_are_fixed_for_the_scrape);
+	RUN_TEST(test_in_flight_follows_arrivals);
+	RUN_TEST(test_allocations_follow_the_routes_served);
+	RUN_TEST(test_boot_milestones_once_reached);
+	return UNITY_END();
+}
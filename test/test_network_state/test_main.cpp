@@ -0,0 +1,177 @@
+/**
+ * Tests for the network connection state machine. Run on the host with:
+ *
+ * 		pio test -e native -f test_network_state
+ */
+
+#include <unity.h>
+#include "Hal.h"
+#include "NetworkState.h"
+
+void setUp(void) {
+	halNativeReset();
+	halNativeAdvance(1000000);
+}
+
+void tearDown(void) {}
+
+void test_starts_down(void) {
+	NetworkState state;
+	TEST_ASSERT_FALSE(state.isConnected());
+	TEST_ASSERT_EQUAL(NET_LINK_NONE, state.activeLink());
+	TEST_ASSERT_EQUAL_STRING("Disconnected", state.typeName());
+	LinkStatus eth = state.status(NET_LINK_ETHERNET);
+	TEST_ASSERT_EQUAL(LINK_DOWN, eth.phase);
+	TEST_ASSERT_EQUAL(0, eth.upMs);
+	TEST_ASSERT_EQUAL(0, eth.downMs);
+}
+
+void test_cable_then_dhcp(void) {
+	NetworkState state;
+	state.onEvent(NET_EVENT_ETH_LINK_UP);
+	TEST_ASSERT_EQUAL(LINK_CONNECTING, state.status(NET_LINK_ETHERNET).phase);
+	TEST_ASSERT_FALSE(state.isConnected());
+
+	halNativeAdvance(2000000);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	LinkStatus eth = state.status(NET_LINK_ETHERNET);
+	TEST_ASSERT_EQUAL(LINK_UP, eth.phase);
+	TEST_ASSERT_EQUAL(3000, eth.upMs);
+	TEST_ASSERT_EQUAL(3000, state.lastChangeMs());
+	TEST_ASSERT_EQUAL(NET_LINK_ETHERNET, state.activeLink());
+	TEST_ASSERT_EQUAL(0, state.ethernetReconnects());
+}
+
+void test_switch_reboot_counts_a_reconnect(void) {
+	NetworkState state;
+	state.onEvent(NET_EVENT_ETH_LINK_UP);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+
+	halNativeAdvance(5000000);
+	state.onEvent(NET_EVENT_ETH_LINK_DOWN);
+	LinkStatus eth = state.status(NET_LINK_ETHERNET);
+	TEST_ASSERT_EQUAL(LINK_DOWN, eth.phase);
+	TEST_ASSERT_EQUAL(6000, eth.downMs);
+	TEST_ASSERT_FALSE(state.isConnected());
+
+	halNativeAdvance(30000000);
+	state.onEvent(NET_EVENT_ETH_LINK_UP);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	eth = state.status(NET_LINK_ETHERNET);
+	TEST_ASSERT_EQUAL(LINK_UP, eth.phase);
+	TEST_ASSERT_EQUAL(36000, eth.upMs);
+	TEST_ASSERT_EQUAL(6000, eth.downMs);
+	TEST_ASSERT_EQUAL(1, state.ethernetReconnects());
+}
+
+void test_lost_ip_keeps_the_link(void) {
+	NetworkState state;
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	state.onEvent(NET_EVENT_WIFI_LOST_IP);
+	LinkStatus wifi = state.status(NET_LINK_WIFI);
+	TEST_ASSERT_EQUAL(LINK_CONNECTING, wifi.phase);
+	TEST_ASSERT_EQUAL(1000, wifi.downMs);
+}
+
+void test_backoff_doubles_to_the_cap(void) {
+	TEST_ASSERT_EQUAL(NETWORK_RETRY_MIN_MS, NetworkState::backoffMs(0));
+	TEST_ASSERT_EQUAL(NETWORK_RETRY_MIN_MS, NetworkState::backoffMs(1));
+	TEST_ASSERT_EQUAL(2 * NETWORK_RETRY_MIN_MS, NetworkState::backoffMs(2));
+	TEST_ASSERT_EQUAL(4 * NETWORK_RETRY_MIN_MS, NetworkState::backoffMs(3));
+	TEST_ASSERT_EQUAL(NETWORK_RETRY_MAX_MS, NetworkState::backoffMs(20));
+	TEST_ASSERT_EQUAL(NETWORK_RETRY_MAX_MS, NetworkState::backoffMs(255));
+}
+
+void test_failed_attempts_back_off_until_up(void) {
+	NetworkState state;
+	TEST_ASSERT_EQUAL(NETWORK_RETRY_MIN_MS, state.failed(NET_LINK_WIFI));
+	TEST_ASSERT_EQUAL(LINK_BACKOFF, state.status(NET_LINK_WIFI).phase);
+
+	// The disconnect that ends the attempt does not cancel the backoff
+	state.onEvent(NET_EVENT_WIFI_LINK_DOWN);
+	TEST_ASSERT_EQUAL(LINK_BACKOFF, state.status(NET_LINK_WIFI).phase);
+
+	state.retrying(NET_LINK_WIFI);
+	TEST_ASSERT_EQUAL(LINK_CONNECTING, state.status(NET_LINK_WIFI).phase);
+	TEST_ASSERT_EQUAL(2 * NETWORK_RETRY_MIN_MS, state.failed(NET_LINK_WIFI));
+	TEST_ASSERT_EQUAL(2, state.status(NET_LINK_WIFI).attempts);
+
+	state.retrying(NET_LINK_WIFI);
+	state.onEvent(NET_EVENT_WIFI_LINK_UP);
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	LinkStatus wifi = state.status(NET_LINK_WIFI);
+	TEST_ASSERT_EQUAL(LINK_UP, wifi.phase);
+	TEST_ASSERT_EQUAL(0, wifi.attempts);
+
+	// A late failure report does not take the link down
+	state.failed(NET_LINK_WIFI);
+	TEST_ASSERT_EQUAL(LINK_UP, state.status(NET_LINK_WIFI).phase);
+	state.retrying(NET_LINK_WIFI);
+	TEST_ASSERT_EQUAL(LINK_UP, state.status(NET_LINK_WIFI).phase);
+}
+
+void test_ethernet_preferred(void) {
+	NetworkState state;
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	TEST_ASSERT_EQUAL(NET_LINK_ETHERNET, state.activeLink());
+	state.onEvent(NET_EVENT_ETH_LINK_DOWN);
+	TEST_ASSERT_EQUAL(NET_LINK_WIFI, state.activeLink());
+	TEST_ASSERT_EQUAL_STRING("WiFi", state.typeName());
+}
+
+void test_phase_names(void) {
+	TEST_ASSERT_EQUAL_STRING("down", NetworkState::phaseName(LINK_DOWN));
+	TEST_ASSERT_EQUAL_STRING("connecting", NetworkState::phaseName(LINK_CONNECTING));
+	TEST_ASSERT_EQUAL_STRING("up", NetworkState::phaseName(LINK_UP));
+	TEST_ASSERT_EQUAL_STRING("backoff", NetworkState::phaseName(LINK_BACKOFF));
+}
+
+void test_failover_and_failback(void) {
+	NetworkState state;
+
+	// WiFi first at boot, then Ethernet takes over without counting
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	TEST_ASSERT_EQUAL(0, state.failovers());
+	TEST_ASSERT_EQUAL(0, state.failbacks());
+
+	// Switch port flaps with WiFi standing by
+	state.onEvent(NET_EVENT_ETH_LINK_DOWN);
+	TEST_ASSERT_EQUAL(NET_LINK_WIFI, state.activeLink());
+	TEST_ASSERT_EQUAL(1, state.failovers());
+	state.onEvent(NET_EVENT_ETH_LINK_UP);
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	TEST_ASSERT_EQUAL(NET_LINK_ETHERNET, state.activeLink());
+	TEST_ASSERT_EQUAL(1, state.failbacks());
+
+	// WiFi going and coming back behind Ethernet changes nothing
+	state.onEvent(NET_EVENT_WIFI_LINK_DOWN);
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	TEST_ASSERT_EQUAL(1, state.failovers());
+	TEST_ASSERT_EQUAL(1, state.failbacks());
+}
+
+void test_failover_after_a_gap(void) {
+	NetworkState state;
+	state.onEvent(NET_EVENT_ETH_GOT_IP);
+	state.onEvent(NET_EVENT_ETH_LINK_DOWN);
+	TEST_ASSERT_FALSE(state.isConnected());
+	state.onEvent(NET_EVENT_WIFI_GOT_IP);
+	TEST_ASSERT_EQUAL(1, state.failovers());
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_starts_down);
+	RUN_TEST(test_cable_then_dhcp);
+	RUN_TEST(test_switch_reboot_counts_a_reconnect);
+	RUN_TEST(test_lost_ip_keeps_the_link);
+	RUN_TEST(test_backoff_doubles_to_the_cap);
+	RUN_TEST(test_failed_attempts_back_off_until_up);
+	RUN_TEST(test_ethernet_preferred);
+	RUN_TEST(test_phase_names);
+	RUN_TEST(test_failover_and_failback);
+	RUN_TEST(test_failover_after_a_gap);
+	return UNITY_END();
+}
@@ -0,0 +1,118 @@
+/**
+ * Tests for the schedule start times and queue. Run on the host with:
+ *
+ * 		pio test -e native -f test_schedule_queue
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ScheduleQueue.h"
+
+// Monday 2024-03-04 00:00:00 UTC
+#define MONDAY 1709510400
+#define DAY 86400
+
+static Schedule schedule(uint8_t days, uint16_t startMinute) {
+	Schedule s;
+	memset(&s, 0, sizeof(s));
+	s.used = true;
+	s.enabled = true;
+	s.days = days;
+	s.startMinute = startMinute;
+	return s;
+}
+
+static void useTimeZone(const char* tz) {
+	setenv("TZ", tz, 1);
+	tzset();
+}
+
+void setUp(void) {
+	useTimeZone("UTC0");
+}
+
+void tearDown(void) {}
+
+void test_next_run_later_today(void) {
+	Schedule s = schedule(0x7f, 6 * 60 + 30);
+	TEST_ASSERT_EQUAL(MONDAY + 6 * 3600 + 1800, scheduleNextRun(s, MONDAY));
+}
+
+void test_next_run_skips_to_tomorrow(void) {
+	Schedule s = schedule(0x7f, 6 * 60);
+	TEST_ASSERT_EQUAL(MONDAY + DAY + 6 * 3600, scheduleNextRun(s, MONDAY + 6 * 3600));
+}
+
+void test_next_run_follows_day_mask(void) {
+	// Wednesday and Saturday only
+	Schedule s = schedule((1 << 3) | (1 << 6), 0);
+	TEST_ASSERT_EQUAL(MONDAY + 2 * DAY, scheduleNextRun(s, MONDAY));
+	TEST_ASSERT_EQUAL(MONDAY + 5 * DAY, scheduleNextRun(s, MONDAY + 2 * DAY));
+
+	// Monday only, asked at the start time, is a week away
+	Schedule weekly = schedule(1 << 1, 0);
+	TEST_ASSERT_EQUAL(MONDAY + 7 * DAY, scheduleNextRun(weekly, MONDAY));
+}
+
+void test_next_run_without_days(void) {
+	Schedule s = schedule(0, 60);
+	TEST_ASSERT_EQUAL(0, scheduleNextRun(s, MONDAY));
+}
+
+void test_next_run_keeps_wall_time_across_dst(void) {
+	// US Eastern, DST starts Sunday 2024-03-10
+	useTimeZone("EST5EDT,M3.2.0,M11.1.0");
+	Schedule s = schedule(0x7f, 6 * 60);
+
+	// 06:00 EST is 11:00 UTC, 06:00 EDT is 10:00 UTC
+	time_t saturday = MONDAY + 5 * DAY + 12 * 3600;
+	TEST_ASSERT_EQUAL(MONDAY + 6 * DAY + 10 * 3600, scheduleNextRun(s, saturday));
+	TEST_ASSERT_EQUAL(MONDAY + 5 * DAY + 11 * 3600, scheduleNextRun(s, MONDAY + 5 * DAY));
+}
+
+void test_queue_pops_in_time_order(void) {
+	ScheduleQueue queue;
+	ScheduleEntry entry;
+	queue.push(300, 0);
+	queue.push(100, 1);
+	queue.push(200, 2);
+	queue.push(50, 3);
+
+	TEST_ASSERT_TRUE(queue.peek(entry));
+	TEST_ASSERT_EQUAL_UINT8(3, entry.slot);
+
+	TEST_ASSERT_FALSE(queue.popDue(49, entry));
+	TEST_ASSERT_TRUE(queue.popDue(1000, entry));
+	TEST_ASSERT_EQUAL_UINT8(3, entry.slot);
+	TEST_ASSERT_TRUE(queue.popDue(1000, entry));
+	TEST_ASSERT_EQUAL_UINT8(1, entry.slot);
+	TEST_ASSERT_TRUE(queue.popDue(1000, entry));
+	TEST_ASSERT_EQUAL_UINT8(2, entry.slot);
+	TEST_ASSERT_TRUE(queue.popDue(1000, entry));
+	TEST_ASSERT_EQUAL_UINT8(0, entry.slot);
+	TEST_ASSERT_FALSE(queue.popDue(1000, entry));
+}
+
+void test_queue_is_bounded(void) {
+	ScheduleQueue queue;
+	for (uint8_t i = 0; i < SCHEDULE_MAX; i++) {
+		TEST_ASSERT_TRUE(queue.push(i, i));
+	}
+	TEST_ASSERT_FALSE(queue.push(0, 0));
+	queue.clear();
+	TEST_ASSERT_EQUAL_UINT8(0, queue.size());
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_next_run_later_today);
+	RUN_TEST(test_next_run_skips_to_tomorrow);
+	RUN_TEST(test_next_run_follows_day_mask);
+	RUN_TEST(test_next_run_without_days);
+	RUN_TEST(test_next_run_keeps_wall_time_across_dst);
+	RUN_TEST(test_queue_pops_in_time_order);
+	RUN_TEST(test_queue_is_bounded);
+	return UNITY_END();
+}
@@ -0,0 +1,70 @@
+/**
+ * Tests for the per-task CPU share. Run on the host with:
+ *
+ * 		pio test -e native -f test_task_load
+ */
+
+#include <unity.h>
+#include "Hal.h"
+#include "TaskLoad.h"
+
+void setUp(void) {
+	halNativeReset();
+	halNativeAdvance(10000000);
+}
+
+void tearDown(void) {}
+
+void test_first_sample_covers_the_uptime(void) {
+	TaskLoad load;
+	TaskLoadSample samples[] = { { 1, 9000000 }, { 7, 1000000 } };
+	uint16_t permille[2];
+	load.update(samples, 2, 10000000, permille);
+	TEST_ASSERT_EQUAL(900, permille[0]);
+	TEST_ASSERT_EQUAL(100, permille[1]);
+	TEST_ASSERT_EQUAL(10000, load.windowMs());
+}
+
+void test_share_is_over_the_window(void) {
+	TaskLoad load;
+	TaskLoadSample first[] = { { 1, 9000000 }, { 7, 1000000 } };
+	uint16_t permille[3];
+	load.update(first, 2, 10000000, permille);
+
+	// Task 7 busy for half of the next two seconds, task 9 started meanwhile
+	halNativeAdvance(2000000);
+	TaskLoadSample second[] = { { 1, 9800000 }, { 7, 2000000 }, { 9, 200000 } };
+	load.update(second, 3, 12000000, permille);
+	TEST_ASSERT_EQUAL(400, permille[0]);
+	TEST_ASSERT_EQUAL(500, permille[1]);
+	TEST_ASSERT_EQUAL(100, permille[2]);
+	TEST_ASSERT_EQUAL(2000, load.windowMs());
+}
+
+void test_counters_wrap(void) {
+	TaskLoad load;
+	TaskLoadSample first[] = { { 3, 0xfff00000 } };
+	uint16_t permille[1];
+	load.update(first, 1, 0xfff00000, permille);
+
+	TaskLoadSample second[] = { { 3, 0x00080000 } };
+	load.update(second, 1, 0x00100000, permille);
+	TEST_ASSERT_EQUAL(750, permille[0]);
+}
+
+void test_empty_window(void) {
+	TaskLoad load;
+	TaskLoadSample samples[] = { { 1, 0 } };
+	uint16_t permille[1];
+	load.update(samples, 1, 0, permille);
+	TEST_ASSERT_EQUAL(0, permille[0]);
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_first_sample_covers_the_uptime);
+	RUN_TEST(test_share_is_over_the_window);
+	RUN_TEST(test_counters_wrap);
+	RUN_TEST(test_empty_window);
+	return UNITY_END();
+}